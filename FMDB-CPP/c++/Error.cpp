@@ -34,13 +34,10 @@ Error::Error(Error &&other)
     *this = std::move(other);
 }
 
-const string& Error::domain()
+const string& Error::domain() const
 {
-    if (!_domain) {
-        _domain.reset(new string);
-    }
-
-    return *_domain;
+    static const string empty;
+    return _domain ? *_domain : empty;
 }
 
 void Error::setDomain(const string &domain)
@@ -52,12 +49,9 @@ void Error::setDomain(const string &domain)
     }
 }
 
-const Variant& Error::userInfo()
+const Variant& Error::userInfo() const
 {
-    if (!_userInfo) {
-        _userInfo.reset(new Variant);
-    }
-    return *_userInfo;
+    return _userInfo ? *_userInfo : Variant::null;
 }
 
 void Error::setUserInfo(const Variant &userInfo)
@@ -28,10 +28,10 @@ public:
     long long code() const { return _code; }
     void setCode(long long code) { _code = code; }
 
-    const string &domain();
+    const string &domain() const;
     void setDomain(const string &domain);
 
-    const Variant& userInfo();
+    const Variant& userInfo() const;
     void setUserInfo(const Variant &userInfo);
 
     string description() const;
@@ -0,0 +1,197 @@
+//
+//  FMBlob.cpp
+//  fmdb
+//
+
+#include "FMBlob.h"
+#include <sqlite3.h>
+
+using namespace std;
+
+FMDB_BEGIN
+
+static string FMDBQuotedIdentifier(const string &identifier)
+{
+    string quoted = "\"";
+    for (char c : identifier) {
+        if (c == '"') {
+            quoted += '"';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+FMBlob::FMBlob(FMDatabase &db, const string &table, const string &column, long long rowid, bool writable/* = false*/, const string &databaseName/* = "main"*/)
+:_blob(nullptr)
+,_rowid(rowid)
+{
+    int rc = sqlite3_blob_open(db.sqliteHandle(), databaseName.c_str(), table.c_str(), column.c_str(), rowid, writable ? 1 : 0, &_blob);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Could not open the blob of %s.%s at rowid %lld: %s\n", table.c_str(), column.c_str(), rowid, sqlite3_errmsg(db.sqliteHandle()));
+        sqlite3_blob_close(_blob);
+        _blob = nullptr;
+    }
+}
+
+FMBlob::~FMBlob()
+{
+    close();
+}
+
+long long FMBlob::insertZeroBlob(FMDatabase &db, const string &table, const string &column, int size)
+{
+    string sql = "insert into " + FMDBQuotedIdentifier(table) + " (" + FMDBQuotedIdentifier(column) + ") values (zeroblob(?))";
+    if (!db.executeUpdate(sql, size)) {
+        return 0;
+    }
+    return db.lastInsertRowId();
+}
+
+int FMBlob::size() const
+{
+    return _blob ? sqlite3_blob_bytes(_blob) : 0;
+}
+
+bool FMBlob::read(void *buffer, int length, int offset)
+{
+    return _blob && sqlite3_blob_read(_blob, buffer, length, offset) == SQLITE_OK;
+}
+
+bool FMBlob::write(const void *buffer, int length, int offset)
+{
+    return _blob && sqlite3_blob_write(_blob, buffer, length, offset) == SQLITE_OK;
+}
+
+bool FMBlob::readChunks(void *buffer, int chunkSize, const std::function<bool (const void *, int, int)> &block)
+{
+    parameterAssert(chunkSize > 0);
+    int total = size();
+    for (int offset = 0; offset < total; offset += chunkSize) {
+        int length = std::min(chunkSize, total - offset);
+        if (!read(buffer, length, offset)) {
+            return false;
+        }
+        if (!block(buffer, length, offset)) {
+            break;
+        }
+    }
+    return _blob != nullptr;
+}
+
+bool FMBlob::reopen(long long rowid)
+{
+    if (!_blob) {
+        return false;
+    }
+    _rowid = rowid;
+    return sqlite3_blob_reopen(_blob, rowid) == SQLITE_OK;
+}
+
+void FMBlob::close()
+{
+    if (_blob) {
+        sqlite3_blob_close(_blob);
+        _blob = nullptr;
+    }
+}
+
+#pragma mark Stream buffer
+
+FMBlobStreamBuffer::FMBlobStreamBuffer(FMBlob &blob, size_t bufferSize/* = 64 * 1024*/)
+:_blob(blob)
+,_buffer(bufferSize)
+,_offset(0)
+{
+    parameterAssert(bufferSize > 0);
+}
+
+FMBlobStreamBuffer::~FMBlobStreamBuffer()
+{
+    flush();
+}
+
+int FMBlobStreamBuffer::position() const
+{
+    if (pbase()) {
+        return _offset + (int)(pptr() - pbase());
+    }
+    if (eback()) {
+        return _offset + (int)(gptr() - eback());
+    }
+    return _offset;
+}
+
+bool FMBlobStreamBuffer::flush()
+{
+    int position = this->position();
+    bool success = true;
+    if (pbase() && pptr() > pbase()) {
+        success = _blob.write(pbase(), (int)(pptr() - pbase()), _offset);
+    }
+    _offset = position;
+    setg(nullptr, nullptr, nullptr);
+    setp(nullptr, nullptr);
+    return success;
+}
+
+FMBlobStreamBuffer::int_type FMBlobStreamBuffer::underflow()
+{
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    if (!flush()) {
+        return traits_type::eof();
+    }
+    int length = std::min((int)_buffer.size(), _blob.size() - _offset);
+    if (length <= 0 || !_blob.read(_buffer.data(), length, _offset)) {
+        return traits_type::eof();
+    }
+    setg(_buffer.data(), _buffer.data(), _buffer.data() + length);
+    return traits_type::to_int_type(*gptr());
+}
+
+FMBlobStreamBuffer::int_type FMBlobStreamBuffer::overflow(int_type ch)
+{
+    if (!flush()) {
+        return traits_type::eof();
+    }
+    int capacity = std::min((int)_buffer.size(), _blob.size() - _offset);
+    if (capacity <= 0) {
+        return traits_type::eof(); // a BLOB can't grow.
+    }
+    setp(_buffer.data(), _buffer.data() + capacity);
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+int FMBlobStreamBuffer::sync()
+{
+    return flush() ? 0 : -1;
+}
+
+FMBlobStreamBuffer::pos_type FMBlobStreamBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode)
+{
+    off_type base = 0;
+    if (dir == std::ios_base::cur) {
+        base = position();
+    } else if (dir == std::ios_base::end) {
+        base = _blob.size();
+    }
+    off_type target = base + off;
+    if (target < 0 || target > _blob.size() || !flush()) {
+        return pos_type(off_type(-1));
+    }
+    _offset = (int)target;
+    return pos_type(target);
+}
+
+FMBlobStreamBuffer::pos_type FMBlobStreamBuffer::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+FMDB_END
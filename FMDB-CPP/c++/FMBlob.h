@@ -0,0 +1,114 @@
+//
+//  FMBlob.h
+//  fmdb
+//
+
+#ifndef FMBlob_hpp
+#define FMBlob_hpp
+
+#include "FMDatabase.h"
+#include <streambuf>
+
+typedef struct sqlite3_blob sqlite3_blob;
+
+FMDB_BEGIN
+
+/**
+ Incremental I/O on one BLOB with `sqlite3_blob_open`, `sqlite3_blob_read` and `sqlite3_blob_write`.
+
+ `dataForColumnIndex` copies a whole BLOB into memory, and binding a BLOB needs all of it in memory too. A blob handle reads and writes any range of bytes instead, so a multi-megabyte attachment moves through a buffer of constant size:
+
+    long long rowid = FMBlob::insertZeroBlob(db, "attachment", "content", size); // preallocated
+    FMBlob blob(db, "attachment", "content", rowid, true);
+    for (int offset = 0; offset < size; offset += sizeof(buffer)) {
+        int length = std::min((int)sizeof(buffer), size - offset);
+        source.read(buffer, length);
+        blob.write(buffer, length, offset);
+    }
+
+ A blob can't grow: its size is set when the row is written, hence `zeroblob` to preallocate it. Writing the row in any other way, or deleting it, makes the handle fail with `SQLITE_ABORT`.
+
+ Failures are reported by `lastError` of the database.
+
+ @warning Close the blob before its database.
+ */
+class FMBlob
+{
+public:
+    /**
+     Open `column` of the row `rowid` of `table`.
+
+     @param writable `false` for a read-only handle.
+     @param databaseName `main`, `temp` or the name of an attached database.
+     */
+    FMBlob(FMDatabase &db, const string &table, const string &column, long long rowid, bool writable = false, const string &databaseName = "main");
+    ~FMBlob();
+    FMBlob(const FMBlob &) = delete;
+    FMBlob& operator=(const FMBlob &) = delete;
+
+    /** Insert a row whose `column` is `size` zero bytes, to be written with a blob handle. @return Its rowid, zero upon failure. */
+    static long long insertZeroBlob(FMDatabase &db, const string &table, const string &column, int size);
+
+    bool isOpen() const { return _blob != nullptr; }
+    long long rowid() const { return _rowid; }
+    /** The size in bytes of the BLOB. */
+    int size() const;
+
+    /** Read `length` bytes from `offset` into `buffer`. Fails beyond the end of the BLOB. */
+    bool read(void *buffer, int length, int offset);
+    /** Write `length` bytes at `offset`. Fails beyond the end of the BLOB. */
+    bool write(const void *buffer, int length, int offset);
+
+    /**
+     Read the whole BLOB, `chunkSize` bytes at a time, into `buffer`.
+
+     @param block Called with each chunk in order; returning `false` stops the read.
+     @return `false` if a read failed.
+     */
+    bool readChunks(void *buffer, int chunkSize, const std::function<bool(const void *bytes, int length, int offset)> &block);
+
+    /** Move the handle to the same column of another row, cheaper than opening a new one. Upon failure the handle can only be moved again. */
+    bool reopen(long long rowid);
+    void close();
+private:
+    sqlite3_blob *_blob;
+    long long _rowid;
+};
+
+/**
+ A `std::streambuf` on a `<FMBlob>`, to read or write a BLOB with the standard streams:
+
+    FMBlob blob(db, "attachment", "content", rowid);
+    FMBlobStreamBuffer buffer(blob);
+    std::istream stream(&buffer);
+    std::copy(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>(), std::ostreambuf_iterator<char>(output));
+
+ The stream supports seeking. Writing past the end of the BLOB fails, since a BLOB can't grow.
+ */
+class FMBlobStreamBuffer : public std::streambuf
+{
+public:
+    explicit FMBlobStreamBuffer(FMBlob &blob, size_t bufferSize = 64 * 1024);
+    /** Writes what is left in the buffer. */
+    ~FMBlobStreamBuffer();
+protected:
+    int_type underflow() override;
+    int_type overflow(int_type ch) override;
+    int sync() override;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+private:
+    /** The offset in the BLOB of the current read or write position. */
+    int position() const;
+    /** Write the pending bytes and drop the buffered ones. */
+    bool flush();
+
+    FMBlob &_blob;
+    vector<char> _buffer;
+    /** The offset in the BLOB of the start of the buffer. */
+    int _offset;
+};
+
+FMDB_END
+
+#endif /* FMBlob_hpp */
@@ -0,0 +1,306 @@
+//
+//  FMBulkInserter.cpp
+//  fmdb
+//
+
+#include "FMBulkInserter.h"
+#include <sqlite3.h>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstring>
+
+using namespace std;
+
+FMDB_BEGIN
+
+enum : unsigned char {
+    FMBulkValueNull,
+    FMBulkValueInteger,
+    FMBulkValueDouble,
+    FMBulkValueText,
+    FMBulkValueBlob,
+};
+
+FMBulkBatch::FMBulkBatch(int columnCount, size_t reserveRows/* = 0*/)
+:_columnCount(columnCount)
+,_rowCount(0)
+{
+    parameterAssert(columnCount > 0);
+    _values.reserve(reserveRows * columnCount);
+}
+
+FMBulkBatch &FMBulkBatch::append(long long value)
+{
+    Value v;
+    v.type = FMBulkValueInteger;
+    v.integer = value;
+    _values.push_back(v);
+    return *this;
+}
+
+FMBulkBatch &FMBulkBatch::append(double value)
+{
+    Value v;
+    v.type = FMBulkValueDouble;
+    v.real = value;
+    _values.push_back(v);
+    return *this;
+}
+
+FMBulkBatch &FMBulkBatch::append(const char *value)
+{
+    if (!value) {
+        return appendNull();
+    }
+    return appendBytes(FMBulkValueText, value, strlen(value));
+}
+
+FMBulkBatch &FMBulkBatch::append(const string &value)
+{
+    return appendBytes(FMBulkValueText, value.data(), value.size());
+}
+
+FMBulkBatch &FMBulkBatch::append(const VariantData &value)
+{
+    return appendBytes(FMBulkValueBlob, value.data(), value.size());
+}
+
+FMBulkBatch &FMBulkBatch::appendNull()
+{
+    Value v;
+    v.type = FMBulkValueNull;
+    v.integer = 0;
+    _values.push_back(v);
+    return *this;
+}
+
+FMBulkBatch &FMBulkBatch::appendBytes(unsigned char type, const void *bytes, size_t length)
+{
+    Value v;
+    v.type = type;
+    v.bytes.offset = _bytes.size();
+    v.bytes.length = length;
+    _bytes.insert(_bytes.end(), (const char *)bytes, (const char *)bytes + length);
+    _values.push_back(v);
+    return *this;
+}
+
+bool FMBulkBatch::endRow()
+{
+    size_t complete = _rowCount * _columnCount;
+    if (_values.size() - complete != (size_t)_columnCount) {
+        fprintf(stderr, "Bulk batch row has %zu values instead of %d; the row is dropped.\n", _values.size() - complete, _columnCount);
+        _values.resize(complete);
+        return false;
+    }
+    ++_rowCount;
+    return true;
+}
+
+void FMBulkBatch::clear()
+{
+    _rowCount = 0;
+    _values.clear();
+    _bytes.clear();
+}
+
+const char *FMBulkBatch::bytesOf(const Value &value) const
+{
+    // The batch outlives the step, so the bytes needn't be copied by SQLite.
+    return value.bytes.length ? _bytes.data() + value.bytes.offset : "";
+}
+
+int FMBulkBatch::bindRow(sqlite3_stmt *statement, size_t row) const
+{
+    const Value *values = _values.data() + row * _columnCount;
+    for (int i = 0; i < _columnCount; ++i) {
+        auto &value = values[i];
+        int rc = SQLITE_OK;
+        switch (value.type) {
+            case FMBulkValueInteger:
+                rc = sqlite3_bind_int64(statement, i + 1, value.integer);
+                break;
+            case FMBulkValueDouble:
+                rc = sqlite3_bind_double(statement, i + 1, value.real);
+                break;
+            case FMBulkValueText:
+                rc = sqlite3_bind_text(statement, i + 1, bytesOf(value), (int)value.bytes.length, SQLITE_STATIC);
+                break;
+            case FMBulkValueBlob:
+                rc = sqlite3_bind_blob(statement, i + 1, bytesOf(value), (int)value.bytes.length, SQLITE_STATIC);
+                break;
+            default:
+                rc = sqlite3_bind_null(statement, i + 1);
+                break;
+        }
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+    return SQLITE_OK;
+}
+
+struct __bulkInserterPacket {
+    mutable mutex _mutex;
+    condition_variable _changed;
+    deque<FMBulkBatch> _pending;
+    bool _writing = false;
+    FMBulkInsertStatistics _statistics;
+};
+
+FMBulkInserter::FMBulkInserter(FMDatabaseQueue &queue, const string &sql, int columnCount)
+:_packet(new struct __bulkInserterPacket)
+,_queue(queue)
+,_sql(sql)
+,_columnCount(columnCount)
+,_batchSize(512)
+,_transactionSize(10000)
+,_maximumPendingBatches(16)
+,_priority(FMDatabaseQueuePriority::Background)
+{
+    parameterAssert(sql.length());
+    parameterAssert(columnCount > 0);
+}
+
+FMBulkInserter::~FMBulkInserter()
+{
+    finish();
+    delete _packet;
+    _packet = nullptr;
+}
+
+void FMBulkInserter::setBatchSize(size_t rows)
+{
+    parameterAssert(rows > 0);
+    _batchSize = rows;
+}
+
+void FMBulkInserter::setTransactionSize(size_t rows)
+{
+    parameterAssert(rows > 0);
+    lock_guard<mutex> locker(_packet->_mutex);
+    _transactionSize = rows;
+}
+
+void FMBulkInserter::setMaximumPendingBatches(size_t count)
+{
+    parameterAssert(count > 0);
+    lock_guard<mutex> locker(_packet->_mutex);
+    _maximumPendingBatches = count;
+    _packet->_changed.notify_all();
+}
+
+bool FMBulkInserter::append(FMBulkBatch &&batch)
+{
+    if (batch.columnCount() != _columnCount) {
+        _assert(false, "Bulk batch has %d columns, the inserter %d.", batch.columnCount(), _columnCount);
+        return false;
+    }
+    if (batch.empty()) {
+        return true;
+    }
+
+    unique_lock<mutex> locker(_packet->_mutex);
+    _packet->_changed.wait(locker, [this]() { return _packet->_pending.size() < _maximumPendingBatches; });
+    _packet->_pending.push_back(std::move(batch));
+    if (_packet->_writing) {
+        return true; // the running writer picks it up.
+    }
+    _packet->_writing = true;
+    locker.unlock();
+
+    FMDatabaseQueueTaskOptions options;
+    options.priority = _priority;
+    options.completion = [this](bool success, const Error &) {
+        if (success) {
+            return;
+        }
+        // The writer never ran (the queue is closed or full): nothing pending will be written.
+        lock_guard<mutex> locker(_packet->_mutex);
+        for (auto &batch : _packet->_pending) {
+            _packet->_statistics.failedRows += batch.rowCount();
+        }
+        _packet->_pending.clear();
+        _packet->_writing = false;
+        _packet->_changed.notify_all();
+    };
+    return _queue.inDatabaseChunked([this](FMDatabase &db) {
+        return write(db);
+    }, options);
+}
+
+bool FMBulkInserter::write(FMDatabase &db)
+{
+    vector<FMBulkBatch> batches;
+    size_t rows = 0;
+    {
+        lock_guard<mutex> locker(_packet->_mutex);
+        auto &pending = _packet->_pending;
+        while (!pending.empty() && (rows == 0 || rows + pending.front().rowCount() <= _transactionSize)) {
+            rows += pending.front().rowCount();
+            batches.push_back(std::move(pending.front()));
+            pending.pop_front();
+        }
+        if (batches.empty()) {
+            _packet->_writing = false;
+            _packet->_changed.notify_all();
+            return false;
+        }
+        _packet->_changed.notify_all();
+    }
+
+    auto start = steady_clock::now();
+    // Prepared once per transaction, and finalized before the task ends: the connection may be closed or replaced between two tasks.
+    sqlite3_stmt *statement = nullptr;
+    bool success = sqlite3_prepare_v2(db.sqliteHandle(), _sql.c_str(), -1, &statement, nullptr) == SQLITE_OK;
+    bool began = success && db.beginTransaction();
+    success = began;
+    for (size_t i = 0; success && i < batches.size(); ++i) {
+        auto &batch = batches[i];
+        for (size_t row = 0; row < batch.rowCount(); ++row) {
+            if (batch.bindRow(statement, row) != SQLITE_OK || sqlite3_step(statement) != SQLITE_DONE) {
+                success = false;
+                break;
+            }
+            sqlite3_reset(statement);
+        }
+    }
+    if (!success && db.logsErrors()) {
+        fprintf(stderr, "DB Error: %d \"%s\"\n", db.lastErrorCode(), db.lastErrorMessage().c_str());
+        fprintf(stderr, "DB Query: %s\n", _sql.c_str());
+    }
+    sqlite3_finalize(statement);
+    if (success) {
+        success = db.commit();
+    } else if (began) {
+        db.rollback();
+    }
+
+    lock_guard<mutex> locker(_packet->_mutex);
+    auto &statistics = _packet->_statistics;
+    statistics.batches += batches.size();
+    statistics.transactions += 1;
+    (success ? statistics.insertedRows : statistics.failedRows) += rows;
+    statistics.writeTime += steady_clock::now() - start;
+    if (_packet->_pending.empty()) {
+        _packet->_writing = false;
+        _packet->_changed.notify_all();
+        return false;
+    }
+    return true;
+}
+
+void FMBulkInserter::finish()
+{
+    unique_lock<mutex> locker(_packet->_mutex);
+    _packet->_changed.wait(locker, [this]() { return !_packet->_writing && _packet->_pending.empty(); });
+}
+
+FMBulkInsertStatistics FMBulkInserter::statistics() const
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    return _packet->_statistics;
+}
+
+FMDB_END
@@ -0,0 +1,150 @@
+//
+//  FMBulkInserter.h
+//  fmdb
+//
+
+#ifndef FMBulkInserter_hpp
+#define FMBulkInserter_hpp
+
+#include "FMDatabaseQueue.h"
+
+FMDB_BEGIN
+
+/**
+ Rows of values already converted to the types SQLite binds.
+
+ Producers fill a batch on their own thread: integers, doubles, text and blobs are stored as they will be bound, and the bytes of every text and blob share one buffer. Binding a row is then a few `sqlite3_bind_*` calls without any conversion.
+
+    FMBulkBatch batch = inserter.makeBatch();
+    for (auto &item : items) {
+        batch.append(item.id).append(item.name).append(item.payload);
+        batch.endRow();
+    }
+    inserter.append(std::move(batch));
+ */
+class FMBulkBatch
+{
+public:
+    explicit FMBulkBatch(int columnCount, size_t reserveRows = 0);
+
+    int columnCount() const { return _columnCount; }
+    /** The number of complete rows. */
+    size_t rowCount() const { return _rowCount; }
+    bool empty() const { return _rowCount == 0; }
+
+    FMBulkBatch &append(int value) { return append((long long)value); }
+    FMBulkBatch &append(long long value);
+    FMBulkBatch &append(double value);
+    FMBulkBatch &append(const char *value);
+    FMBulkBatch &append(const string &value);
+    FMBulkBatch &append(const VariantData &value);
+    FMBulkBatch &appendNull();
+
+    /** Close the current row. Returns `false`, and drops the row, if it doesn't have `columnCount` values. */
+    bool endRow();
+    void clear();
+private:
+    friend class FMBulkInserter;
+    int bindRow(sqlite3_stmt *statement, size_t row) const;
+    FMBulkBatch &appendBytes(unsigned char type, const void *bytes, size_t length);
+
+    struct Bytes {
+        size_t offset;
+        size_t length;
+    };
+    struct Value {
+        unsigned char type;
+        union {
+            long long integer;
+            double real;
+            Bytes bytes;
+        };
+    };
+    /** The bytes of a text or blob value. */
+    const char *bytesOf(const Value &value) const;
+    int _columnCount;
+    size_t _rowCount;
+    vector<Value> _values;
+    vector<char> _bytes;
+};
+
+struct FMBulkInsertStatistics {
+    unsigned long long insertedRows = 0;
+    /** Rows of the transactions rolled back because a row failed. */
+    unsigned long long failedRows = 0;
+    unsigned long long batches = 0;
+    unsigned long long transactions = 0;
+    /** Time spent by the writer inside its transactions. */
+    TimeInterval writeTime = TimeInterval(0);
+
+    double rowsPerSecond() const { return writeTime.count() > 0 ? insertedRows / writeTime.count() : 0; }
+};
+
+/**
+ Pipeline feeding `<FMBulkBatch>` objects to the writer thread of a `<FMDatabaseQueue>`.
+
+ Type conversion happens on the producer threads while they fill their batches; the queue thread only binds, steps and resets the insert statement, prepared once per transaction, committing every `transactionSize` rows. The writer runs as a chunked task (see `FMDatabaseQueue::inDatabaseChunked`), so other tasks of the queue still run between two transactions.
+
+    FMBulkInserter inserter(queue, "insert into log values (?, ?)", 2);
+    // on any number of producer threads:
+    inserter.append(std::move(batch));
+    // when done:
+    inserter.finish();
+    printf("%.0f rows/s\n", inserter.statistics().rowsPerSecond());
+
+ If a row fails, its whole transaction is rolled back and counted in `FMBulkInsertStatistics::failedRows`; the following transactions still run.
+ */
+class FMBulkInserter
+{
+public:
+    FMBulkInserter(FMDatabaseQueue &queue, const string &sql, int columnCount);
+    /** Waits for the batches already appended. */
+    ~FMBulkInserter();
+    FMBulkInserter(const FMBulkInserter &) = delete;
+    FMBulkInserter& operator=(const FMBulkInserter &) = delete;
+
+    /** The number of rows `makeBatch` reserves room for. Defaults to 512. */
+    size_t batchSize() const { return _batchSize; }
+    void setBatchSize(size_t rows);
+
+    /** The number of rows committed in one transaction. Defaults to 10000. */
+    size_t transactionSize() const { return _transactionSize; }
+    void setTransactionSize(size_t rows);
+
+    /** The number of batches waiting for the writer before `append` blocks. Defaults to 16. */
+    size_t maximumPendingBatches() const { return _maximumPendingBatches; }
+    void setMaximumPendingBatches(size_t count);
+
+    /** The lane of the writer task. Defaults to `FMDatabaseQueuePriority::Background`. */
+    void setPriority(FMDatabaseQueuePriority priority) { _priority = priority; }
+
+    FMBulkBatch makeBatch() const { return FMBulkBatch(_columnCount, _batchSize); }
+
+    /**
+     Hand `batch` to the writer. Can be called from any thread.
+
+     @return `false` if the batch has the wrong number of columns or the queue refused the writer task.
+     */
+    bool append(FMBulkBatch &&batch);
+
+    /** Wait until every appended batch has been written. */
+    void finish();
+
+    FMBulkInsertStatistics statistics() const;
+private:
+    bool write(FMDatabase &db);
+
+    friend struct __bulkInserterPacket;
+    struct __bulkInserterPacket *_packet;
+    FMDatabaseQueue &_queue;
+    string _sql;
+    int _columnCount;
+    size_t _batchSize;
+    size_t _transactionSize;
+    size_t _maximumPendingBatches;
+    FMDatabaseQueuePriority _priority;
+};
+
+FMDB_END
+
+#endif /* FMBulkInserter_hpp */
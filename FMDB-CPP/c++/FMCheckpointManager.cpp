@@ -0,0 +1,226 @@
+//
+//  FMCheckpointManager.cpp
+//  fmdb
+//
+
+#include "FMCheckpointManager.h"
+#include <sqlite3.h>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+
+using namespace std;
+using namespace std::chrono;
+
+FMDB_BEGIN
+
+// Every frame is a page with a 24-byte header, after the 32-byte header of the WAL.
+static long long FMDBWalSize(int frameCount, int pageSize)
+{
+    return frameCount > 0 ? 32 + (long long)frameCount * (pageSize + 24) : 0;
+}
+
+struct __checkpointManagerPacket {
+    mutable mutex _mutex;
+    FMCheckpointPolicy _policy;
+    FMCheckpointStatistics _statistics;
+    int _pageSize = 4096;
+    /** Frames of the current WAL already copied into the database. */
+    int _backfilledFrames = 0;
+    /** A failed escalation is only tried again once the WAL reached this size. */
+    int _nextEscalation = 0;
+    /** The connection the hook is installed on; set on the queue thread. */
+    sqlite3 *_hookedHandle = nullptr;
+
+    /** Called on the queue thread by the WAL hook, after each commit. */
+    void commit(sqlite3 *db, int frameCount)
+    {
+        FMCheckpointMode mode;
+        {
+            lock_guard<mutex> locker(_mutex);
+            if (frameCount < _statistics.walFrames) {
+                _backfilledFrames = 0; // the writer started the WAL over.
+                _nextEscalation = 0;
+            }
+            _statistics.walFrames = frameCount;
+            _statistics.walSize = FMDBWalSize(frameCount, _pageSize);
+            if (frameCount < _nextEscalation) {
+                return;
+            }
+            if (_policy.truncateFrameCount > 0 && frameCount >= _policy.truncateFrameCount) {
+                mode = FMCheckpointMode::Truncate;
+            } else if (_policy.restartFrameCount > 0 && frameCount >= _policy.restartFrameCount) {
+                mode = FMCheckpointMode::Restart;
+            } else {
+                return; // left to the idle handler.
+            }
+        }
+        checkpoint(db, mode);
+    }
+
+    /** Called on the queue thread while it is idle. */
+    bool idle(FMDatabase &db)
+    {
+        {
+            lock_guard<mutex> locker(_mutex);
+            int pendingFrames = _statistics.walFrames - _backfilledFrames;
+            if (_policy.passiveFrameCount <= 0 || pendingFrames < _policy.passiveFrameCount) {
+                return false;
+            }
+        }
+        checkpoint(db.sqliteHandle(), FMCheckpointMode::Passive);
+        // A passive checkpoint blocked by readers waits for the next idle turn rather than spinning.
+        return false;
+    }
+
+    void checkpoint(sqlite3 *db, FMCheckpointMode mode)
+    {
+        int sqliteMode = SQLITE_CHECKPOINT_PASSIVE;
+        switch (mode) {
+            case FMCheckpointMode::Passive:
+                break;
+            case FMCheckpointMode::Restart:
+                sqliteMode = SQLITE_CHECKPOINT_RESTART;
+                break;
+            case FMCheckpointMode::Truncate:
+                sqliteMode = SQLITE_CHECKPOINT_TRUNCATE;
+                break;
+        }
+        int logFrames = 0;
+        int checkpointedFrames = 0;
+        auto start = steady_clock::now();
+        int rc = sqlite3_wal_checkpoint_v2(db, "main", sqliteMode, &logFrames, &checkpointedFrames);
+        TimeInterval duration = steady_clock::now() - start;
+        if (rc != SQLITE_OK && rc != SQLITE_BUSY) {
+            fprintf(stderr, "WAL checkpoint failed: %d \"%s\"\n", rc, sqlite3_errmsg(db));
+            return;
+        }
+
+        lock_guard<mutex> locker(_mutex);
+        switch (mode) {
+            case FMCheckpointMode::Passive:
+                ++_statistics.passiveCheckpoints;
+                break;
+            case FMCheckpointMode::Restart:
+                ++_statistics.restartCheckpoints;
+                break;
+            case FMCheckpointMode::Truncate:
+                ++_statistics.truncateCheckpoints;
+                break;
+        }
+        if (logFrames < 0) {
+            return; // not in WAL mode.
+        }
+        if (checkpointedFrames < _backfilledFrames) {
+            _backfilledFrames = 0;
+        }
+        _statistics.framesCheckpointed += checkpointedFrames - _backfilledFrames;
+        _backfilledFrames = checkpointedFrames;
+        _statistics.walFrames = logFrames;
+        _statistics.walSize = FMDBWalSize(logFrames, _pageSize);
+        _statistics.lastCheckpointTime = duration;
+        _statistics.totalCheckpointTime += duration;
+        _statistics.longestCheckpointTime = std::max(_statistics.longestCheckpointTime, duration);
+
+        bool complete = rc == SQLITE_OK && checkpointedFrames == logFrames;
+        if (!complete) {
+            ++_statistics.incompleteCheckpoints;
+        }
+        if (mode != FMCheckpointMode::Passive) {
+            int step = _policy.restartFrameCount > 0 ? _policy.restartFrameCount : _policy.truncateFrameCount;
+            _nextEscalation = complete ? 0 : logFrames + step;
+        }
+    }
+};
+
+static int FMDBWalHook(void *context, sqlite3 *db, const char *databaseName, int frameCount)
+{
+    if (strcmp(databaseName, "main") == 0) {
+        ((__checkpointManagerPacket *)context)->commit(db, frameCount);
+    }
+    return SQLITE_OK;
+}
+
+FMCheckpointManager::FMCheckpointManager(FMDatabaseQueue &queue, const FMCheckpointPolicy &policy/* = FMCheckpointPolicy()*/)
+:_queue(queue)
+,_idleHandler(0)
+,_packet(new struct __checkpointManagerPacket)
+{
+    _packet->_policy = policy;
+    __checkpointManagerPacket *packet = _packet;
+    // Replaces the automatic checkpoint of the connection.
+    queue.inDatabase([packet](FMDatabase &db) {
+        auto rs = db.executeQuery("pragma page_size").lock();
+        if (rs) {
+            int pageSize = rs->next() ? rs->intForColumnIndex(0) : 0;
+            rs->close();
+            if (pageSize > 0) {
+                lock_guard<mutex> locker(packet->_mutex);
+                packet->_pageSize = pageSize;
+            }
+        }
+        sqlite3_wal_hook(db.sqliteHandle(), FMDBWalHook, packet);
+        packet->_hookedHandle = db.sqliteHandle();
+    });
+    _idleHandler = queue.addIdleHandler([packet](FMDatabase &db) {
+        return packet->idle(db);
+    });
+}
+
+FMCheckpointManager::~FMCheckpointManager()
+{
+    _queue.removeIdleHandler(_idleHandler);
+
+    // Wait for the hook to be removed: the completion is called even if the queue is closed.
+    mutex finishedMutex;
+    condition_variable finishedCondition;
+    bool finished = false;
+    FMDatabaseQueueTaskOptions options;
+    options.completion = [&](bool, const Error &) {
+        lock_guard<mutex> locker(finishedMutex);
+        finished = true;
+        finishedCondition.notify_all();
+    };
+    bool removed = false;
+    bool enqueued = _queue.inDatabase([&removed](FMDatabase &db) {
+        sqlite3_wal_hook(db.sqliteHandle(), nullptr, nullptr);
+        sqlite3_wal_autocheckpoint(db.sqliteHandle(), 1000); // the default of SQLite.
+        removed = true;
+    }, options);
+    if (enqueued) {
+        unique_lock<mutex> locker(finishedMutex);
+        finishedCondition.wait(locker, [&]() { return finished; });
+    }
+    if (!removed && _packet->_hookedHandle) {
+        // The queue is closed: its thread has stopped, and its connection stays open until the queue goes away.
+        sqlite3_wal_hook(_packet->_hookedHandle, nullptr, nullptr);
+        sqlite3_wal_autocheckpoint(_packet->_hookedHandle, 1000);
+    }
+
+    delete _packet;
+    _packet = nullptr;
+}
+
+FMCheckpointPolicy FMCheckpointManager::policy() const
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    return _packet->_policy;
+}
+
+void FMCheckpointManager::setPolicy(const FMCheckpointPolicy &policy)
+{
+    {
+        lock_guard<mutex> locker(_packet->_mutex);
+        _packet->_policy = policy;
+        _packet->_nextEscalation = 0;
+    }
+    _queue.scheduleIdleHandlers();
+}
+
+FMCheckpointStatistics FMCheckpointManager::statistics() const
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    return _packet->_statistics;
+}
+
+FMDB_END
@@ -0,0 +1,82 @@
+//
+//  FMCheckpointManager.h
+//  fmdb
+//
+
+#ifndef FMCheckpointManager_hpp
+#define FMCheckpointManager_hpp
+
+#include "FMDatabaseQueue.h"
+
+FMDB_BEGIN
+
+enum class FMCheckpointMode : int {
+    /** Copies what it can without waiting for readers or writers. */
+    Passive,
+    /** Copies every frame, then waits for the readers so that the next writer starts the WAL over. */
+    Restart,
+    /** Like `Restart`, then truncates the WAL file to zero bytes. */
+    Truncate,
+};
+
+/** When `<FMCheckpointManager>` checkpoints, in frames of the WAL. Zero disables a threshold. */
+struct FMCheckpointPolicy {
+    /** Frames not yet copied into the database before an idle queue runs a `Passive` checkpoint. */
+    int passiveFrameCount = 1;
+    /** Frames in the WAL after which a commit is followed by a `Restart` checkpoint. */
+    int restartFrameCount = 1000;
+    /** Frames in the WAL after which a commit is followed by a `Truncate` checkpoint. */
+    int truncateFrameCount = 10000;
+};
+
+struct FMCheckpointStatistics {
+    unsigned long long passiveCheckpoints = 0;
+    unsigned long long restartCheckpoints = 0;
+    unsigned long long truncateCheckpoints = 0;
+    /** Checkpoints that could not copy every frame, or not restart the WAL, because of readers or another writer. */
+    unsigned long long incompleteCheckpoints = 0;
+    /** Frames copied into the database. */
+    unsigned long long framesCheckpointed = 0;
+    /** Frames in the WAL after the last commit or checkpoint. */
+    int walFrames = 0;
+    /** The bytes of WAL those frames take, header included. The file itself can be larger until a `Truncate` checkpoint. */
+    long long walSize = 0;
+    TimeInterval lastCheckpointTime = TimeInterval(0);
+    TimeInterval longestCheckpointTime = TimeInterval(0);
+    TimeInterval totalCheckpointTime = TimeInterval(0);
+};
+
+/**
+ Checkpoints of the WAL of an `<FMDatabaseQueue>`, driven by `sqlite3_wal_hook`.
+
+ SQLite's automatic checkpoint runs a `Passive` checkpoint inside the commit that crosses 1000 frames, so that commit pays for copying the whole WAL. The manager replaces it on the queue connection: commits only record the size of the WAL, and the copying runs as an idle handler of the queue (see `FMDatabaseQueue::addIdleHandler`), when no task is waiting. A WAL that keeps growing, because readers or a steady stream of writes leave no chance to copy it, is checkpointed with `Restart` or `Truncate` right after the commit crossing the thresholds of the policy.
+
+    FMDatabaseQueue queue(path, 0, FMDatabase::stringNull, FMDatabaseOpenOptions::OLTPWAL());
+    FMCheckpointManager checkpoints(queue);
+
+ Only the `main` database of the connection is checkpointed.
+
+ @warning The queue must outlive the manager. Don't create or destroy the manager inside a task of its queue.
+ */
+class FMCheckpointManager
+{
+public:
+    FMCheckpointManager(FMDatabaseQueue &queue, const FMCheckpointPolicy &policy = FMCheckpointPolicy());
+    ~FMCheckpointManager();
+    FMCheckpointManager(const FMCheckpointManager &) = delete;
+    FMCheckpointManager& operator=(const FMCheckpointManager &) = delete;
+
+    FMCheckpointPolicy policy() const;
+    void setPolicy(const FMCheckpointPolicy &policy);
+
+    FMCheckpointStatistics statistics() const;
+private:
+    FMDatabaseQueue &_queue;
+    unsigned long long _idleHandler;
+    friend struct __checkpointManagerPacket;
+    struct __checkpointManagerPacket *_packet;
+};
+
+FMDB_END
+
+#endif /* FMCheckpointManager_hpp */
@@ -12,5 +12,17 @@
 #include "FMDatabase.h"
 #include "FMResultSet.h"
 #include "FMDatabaseQueue.h"
+#include "FMDatabasePool.h"
+#include "FMThreadLocalReaders.h"
+#include "FMParallelScan.h"
+#include "FMDatabaseURI.h"
+#include "FMCheckpointManager.h"
+#include "FMVacuumScheduler.h"
+#include "FMBlob.h"
+#include "FMIOAccountingVFS.h"
+#include "FMFaultInjectionVFS.h"
+#include "FMShardedDatabaseQueue.h"
+#include "FMThreadPool.hpp"
+#include "FMBulkInserter.h"
 
 #endif /* FMDB_h */
@@ -9,7 +9,21 @@
 #include "FMDatabase.h"
 #include "FMStatement.hpp"
 #include "Date.hpp"
+#include "FMIOAccountingVFS.h"
 #include <sqlite3.h>
+#include <thread>
+#include <random>
+#include <climits>
+#include <mutex>
+#include <condition_variable>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <dlfcn.h>
+#endif
 
 using namespace std;
 
@@ -25,6 +39,7 @@ FMDatabase::FMDatabase(const string &path/* = FMDatabase::stringNull*/)
 ,_shouldCacheStatements(0)
 ,_isExecutingStatement(0)
 ,_inTransaction(0)
+,_deadlineExceeded(0)
 ,_cachedStatements(new decltype(_cachedStatements)::element_type())
 ,_openResultSets(new decltype(_openResultSets)::element_type)
 ,_databasePath(nullptr)
@@ -56,6 +71,9 @@ bool FMDatabase::open()
     if (_db) {
         return true;
     }
+    if (_openOptions.ioAccounting) {
+        return openWithFlags(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    }
     int err = sqlite3_open(sqlitePath(), (sqlite3 **)&_db);
     if (err != SQLITE_OK) {
         fprintf(stderr, "open error:%d\n", err);
@@ -64,6 +82,11 @@ bool FMDatabase::open()
     if (_maxBusyRetryTimeInterval.count() > 0) {
         setMaxBusyRetryTimeInterval(_maxBusyRetryTimeInterval);
     }
+    setDeadline(_deadline);
+    if (!applyOpenOptions(_openOptions)) {
+        close();
+        return false;
+    }
     return true;
 }
 
@@ -78,6 +101,17 @@ bool FMDatabase::openWithFlags(int flags, const string &vfs /*= FMDatabase::stri
     if (&vfs != &stringNull) {
         vfsc = vfs.c_str();
     }
+    if (_openOptions.ioAccounting) {
+        string baseName = vfsc ? vfs : "";
+        if (!_ioAccounting || _ioAccounting->baseName() != baseName) {
+            _ioAccounting.reset(new FMIOAccountingVFS(baseName));
+        }
+        if (!_ioAccounting->isRegistered()) {
+            fprintf(stderr, "Could not count the I/O of %s: no VFS named \"%s\"\n", sqlitePath(), baseName.c_str());
+            return false;
+        }
+        vfsc = _ioAccounting->name().c_str();
+    }
 
     int err = sqlite3_open_v2(sqlitePath(), (sqlite3**)&_db, flags, vfsc);
     if(err != SQLITE_OK) {
@@ -89,6 +123,11 @@ bool FMDatabase::openWithFlags(int flags, const string &vfs /*= FMDatabase::stri
         // set the handler
         setMaxBusyRetryTimeInterval(_maxBusyRetryTimeInterval);
     }
+    setDeadline(_deadline);
+    if (!applyOpenOptions(_openOptions)) {
+        close();
+        return false;
+    }
 
     return true;
 #else
@@ -97,11 +136,108 @@ bool FMDatabase::openWithFlags(int flags, const string &vfs /*= FMDatabase::stri
 #endif
 }
 
+#pragma mark Open options
+
+string FMDatabaseOpenOptions::statements() const
+{
+    static const char *journalModes[] = {"", "delete", "truncate", "persist", "memory", "wal", "off"};
+    static const char *synchronousModes[] = {"", "off", "normal", "full", "extra"};
+    static const char *tempStores[] = {"", "file", "memory"};
+    static const char *lockingModes[] = {"", "normal", "exclusive"};
+
+    string sql;
+    if (pageSize > 0) {
+        sql += "pragma page_size=" + std::to_string(pageSize) + ";";
+    }
+    if (lockingMode != FMLockingMode::Default) {
+        sql += string("pragma locking_mode=") + lockingModes[(int)lockingMode] + ";";
+    }
+    if (journalMode != FMJournalMode::Default) {
+        sql += string("pragma journal_mode=") + journalModes[(int)journalMode] + ";";
+    }
+    if (synchronous != FMSynchronousMode::Default) {
+        sql += string("pragma synchronous=") + synchronousModes[(int)synchronous] + ";";
+    }
+    if (cacheSize != 0) {
+        sql += "pragma cache_size=" + std::to_string(cacheSize) + ";";
+    }
+    if (mmapSize >= 0) {
+        sql += "pragma mmap_size=" + std::to_string(mmapSize) + ";";
+    }
+    if (tempStore != FMTempStore::Default) {
+        sql += string("pragma temp_store=") + tempStores[(int)tempStore] + ";";
+    }
+    if (foreignKeys >= 0) {
+        sql += string("pragma foreign_keys=") + (foreignKeys ? "on" : "off") + ";";
+    }
+    return sql;
+}
+
+FMDatabaseOpenOptions FMDatabaseOpenOptions::OLTPWAL()
+{
+    FMDatabaseOpenOptions options;
+    options.journalMode = FMJournalMode::WAL;
+    options.synchronous = FMSynchronousMode::Normal;
+    options.cacheSize = -8192;
+    options.foreignKeys = 1;
+    return options;
+}
+
+FMDatabaseOpenOptions FMDatabaseOpenOptions::bulkLoad()
+{
+    FMDatabaseOpenOptions options;
+    options.journalMode = FMJournalMode::Off;
+    options.synchronous = FMSynchronousMode::Off;
+    options.lockingMode = FMLockingMode::Exclusive;
+    options.cacheSize = -65536;
+    options.tempStore = FMTempStore::Memory;
+    return options;
+}
+
+FMDatabaseOpenOptions FMDatabaseOpenOptions::readOnlyAnalytics()
+{
+    FMDatabaseOpenOptions options;
+    options.cacheSize = -65536;
+    options.mmapSize = 256LL * 1024 * 1024;
+    options.tempStore = FMTempStore::Memory;
+    return options;
+}
+
+bool FMDatabase::applyOpenOptions(const FMDatabaseOpenOptions &options)
+{
+    string sql = options.statements();
+    if (sql.empty()) {
+        return true;
+    }
+    if (!executeStatements(sql)) {
+        fprintf(stderr, "Could not apply the open options of %s: %s\n", sqlitePath(), lastErrorMessage().c_str());
+        return false;
+    }
+    if (options.journalMode == FMJournalMode::WAL) {
+        // SQLite keeps the former mode, without an error, when the file can't use WAL (in-memory databases for instance).
+        auto rs = executeQuery("pragma journal_mode").lock();
+        if (rs && rs->next() && *rs->stringForColumnIndex(0) != "wal") {
+            fprintf(stderr, "WARNING: %s stays in journal mode %s instead of WAL.\n", sqlitePath(), rs->stringForColumnIndex(0)->c_str());
+        }
+        if (rs) {
+            rs->close();
+        }
+    }
+    return true;
+}
+
 bool FMDatabase::close()
 {
     clearCachedStatements();
     closeOpenResultSets();
 
+    if (_inMemory) {
+        if (_inMemoryStatistics.dirty && !writeBack()) {
+            fprintf(stderr, "Could not write %s back before closing, the changes since the last write-back are lost.\n", sqlitePath());
+        }
+        _inMemory = false;
+    }
+
     if (!_db) {
         return true;
     }
@@ -143,6 +279,126 @@ bool FMDatabase::isSQLiteThreadSafe()
     return sqlite3_threadsafe();
 }
 
+#pragma mark Shared cache
+
+struct __unlockNotification {
+    bool fired = false;
+    mutex _mutex;
+    condition_variable _condition;
+};
+
+static void FMDBUnlockNotify(void **arguments, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        auto notification = (__unlockNotification *)arguments[i];
+        lock_guard<mutex> locker(notification->_mutex);
+        notification->fired = true;
+        notification->_condition.notify_all();
+    }
+}
+
+using FMDBUnlockNotifyFunction = int (*)(sqlite3 *, void (*)(void **, int), void *);
+
+/** `sqlite3_unlock_notify`, or `nullptr` if the linked SQLite was built without it. */
+static FMDBUnlockNotifyFunction FMDBUnlockNotifyEntryPoint()
+{
+#ifdef SQLITE_ENABLE_UNLOCK_NOTIFY
+    return &sqlite3_unlock_notify;
+#else
+    // The function only exists in some builds of SQLite, so it is looked up instead of linked: the system libraries usually have it.
+    static FMDBUnlockNotifyFunction function = []() -> FMDBUnlockNotifyFunction {
+        if (!sqlite3_compileoption_used("ENABLE_UNLOCK_NOTIFY")) {
+            return nullptr;
+        }
+#ifdef _WIN32
+        HMODULE module = GetModuleHandleA("sqlite3.dll");
+        return module ? (FMDBUnlockNotifyFunction)GetProcAddress(module, "sqlite3_unlock_notify") : nullptr;
+#else
+        return (FMDBUnlockNotifyFunction)dlsym(RTLD_DEFAULT, "sqlite3_unlock_notify");
+#endif
+    }();
+    return function;
+#endif
+}
+
+bool FMDatabase::supportsUnlockNotify()
+{
+    return FMDBUnlockNotifyEntryPoint() != nullptr;
+}
+
+static bool FMDBIsLockedBySharedCache(sqlite3 *db, int rc)
+{
+    return rc == SQLITE_LOCKED_SHAREDCACHE || (rc == SQLITE_LOCKED && sqlite3_extended_errcode(db) == SQLITE_LOCKED_SHAREDCACHE);
+}
+
+int FMDatabase::prepareStatement(const string &sql, sqlite3_stmt **statement)
+{
+    auto start = steady_clock::now();
+    int rc;
+    for (unsigned attempt = 0; FMDBIsLockedBySharedCache(_db, rc = sqlite3_prepare_v2(_db, sql.c_str(), -1, statement, 0)); ++attempt) {
+        if (!waitForSharedCacheUnlock(attempt, start)) {
+            break;
+        }
+    }
+    return rc;
+}
+
+int FMDatabase::stepStatement(sqlite3_stmt *statement)
+{
+    // Running the statement again would return its first rows twice.
+    bool canRestart = !sqlite3_stmt_busy(statement);
+    auto start = steady_clock::now();
+    int rc;
+    for (unsigned attempt = 0; FMDBIsLockedBySharedCache(_db, rc = sqlite3_step(statement)) && canRestart; ++attempt) {
+        if (!waitForSharedCacheUnlock(attempt, start)) {
+            break;
+        }
+        sqlite3_reset(statement);
+    }
+    return rc;
+}
+
+bool FMDatabase::waitForSharedCacheUnlock(unsigned attempt, steady_clock::time_point start)
+{
+    auto now = steady_clock::now();
+    TimeInterval waited = now - start;
+    if (attempt == 0) {
+        ++_busyStatistics.waits;
+    }
+    if (waited >= _maxBusyRetryTimeInterval) {
+        ++_busyStatistics.timeouts;
+        return false;
+    }
+
+    if (auto unlockNotify = FMDBUnlockNotifyEntryPoint()) {
+        __unlockNotification notification;
+        if (unlockNotify(_db, &FMDBUnlockNotify, &notification) != SQLITE_OK) {
+            // SQLITE_LOCKED: waiting would deadlock with the connection holding the lock.
+            return false;
+        }
+        ++_busyStatistics.unlockNotifications;
+        unique_lock<mutex> locker(notification._mutex);
+        if (!notification._condition.wait_for(locker, _maxBusyRetryTimeInterval - waited, [&]() { return notification.fired; })) {
+            locker.unlock();
+            // The callback can't run past this call. It also clears the error, so the statement runs once more to report it.
+            unlockNotify(_db, nullptr, nullptr);
+        }
+    } else {
+        TimeInterval sleep = attempt < _busyStrategy.yieldCount ? TimeInterval(0) : _busyStrategy.sleepForRetry(attempt - _busyStrategy.yieldCount);
+        if (sleep > TimeInterval(0)) {
+            this_thread::sleep_for(std::min(sleep, _maxBusyRetryTimeInterval - waited));
+        } else {
+            this_thread::yield();
+        }
+    }
+
+    auto end = steady_clock::now();
+    ++_busyStatistics.retries;
+    _busyStatistics.totalWaitTime += end - now;
+    _busyStatistics.longestWaitTime = std::max(_busyStatistics.longestWaitTime, TimeInterval(end - start));
+    return true;
+}
+
 #pragma mark Busy handler routines
 
 // NOTE: appledoc seems to choke on this function for some reason;
@@ -155,32 +411,63 @@ bool FMDatabase::isSQLiteThreadSafe()
 //       C function causes problems; the rest don't. Anyway, ignoring the .m
 //       files with appledoc will prevent this problem from occurring.
 
+TimeInterval FMDatabaseBusyStrategy::sleepForRetry(unsigned retry) const
+{
+    TimeInterval sleep = initialSleep;
+    for (unsigned i = 0; i < retry && sleep < maximumSleep; ++i) {
+        sleep *= 2;
+    }
+    return std::min(sleep, maximumSleep);
+}
+
+FMDatabaseBusyStrategy FMDatabaseBusyStrategy::yield()
+{
+    FMDatabaseBusyStrategy strategy;
+    strategy.yieldCount = UINT_MAX;
+    return strategy;
+}
+
+FMDatabaseBusyStrategy FMDatabaseBusyStrategy::fixedSleep(TimeInterval sleep)
+{
+    FMDatabaseBusyStrategy strategy;
+    strategy.yieldCount = 0;
+    strategy.initialSleep = strategy.maximumSleep = sleep;
+    return strategy;
+}
+
 int FMDBDatabaseBusyHandler(void *f, int count)
 {
     FMDatabase *self = (FMDatabase *)f;
+    auto &statistics = self->_busyStatistics;
+    auto now = steady_clock::now();
 
     if (count == 0) {
-        self->_startBusyRetryTime = Date().timeIntervalSinceReferenceDate();
-        return 1;
+        self->_startBusyRetryTime = now;
+        ++statistics.waits;
     }
 
-    TimeInterval delta = Date().timeIntervalSinceReferenceDate() - (self->_startBusyRetryTime);
+    TimeInterval waited = now - self->_startBusyRetryTime;
+    if (waited >= self->_maxBusyRetryTimeInterval) {
+        ++statistics.timeouts;
+        return 0;
+    }
 
-    if (delta < self->_maxBusyRetryTimeInterval) {
-#ifdef WIN32
-		int requestedSleepInMillseconds = 50;
-#else
-		int requestedSleepInMillseconds = (int)arc4random_uniform(50) + 50;
-#endif
-        
-        int actualSleepInMilliseconds = sqlite3_sleep(requestedSleepInMillseconds);
-        if (actualSleepInMilliseconds != requestedSleepInMillseconds) {
-            fprintf(stderr, "WARNING: Requested sleep of %i milliseconds, but SQLite returned %i. Maybe SQLite wasn't built with HAVE_USLEEP=1?\n", requestedSleepInMillseconds, actualSleepInMilliseconds);
-        }
-        return 1;
+    auto &strategy = self->_busyStrategy;
+    if ((unsigned)count < strategy.yieldCount) {
+        this_thread::yield();
+    } else {
+        static thread_local minstd_rand random((unsigned)now.time_since_epoch().count());
+        double jitter = std::max(0.0, std::min(strategy.jitter, 1.0)) * random() / minstd_rand::max();
+        TimeInterval sleep = strategy.sleepForRetry(count - strategy.yieldCount) * (1 - jitter);
+        // Don't sleep past the point where the handler gives up.
+        this_thread::sleep_for(std::min(sleep, self->_maxBusyRetryTimeInterval - waited));
     }
 
-    return 0;
+    auto end = steady_clock::now();
+    ++statistics.retries;
+    statistics.totalWaitTime += end - now;
+    statistics.longestWaitTime = std::max(statistics.longestWaitTime, TimeInterval(end - self->_startBusyRetryTime));
+    return 1;
 }
 
 void FMDatabase::setMaxBusyRetryTimeInterval(TimeInterval timeout)
@@ -197,6 +484,20 @@ void FMDatabase::setMaxBusyRetryTimeInterval(TimeInterval timeout)
     }
 }
 
+#pragma mark I/O accounting
+
+FMIOStatistics FMDatabase::ioStatistics() const
+{
+    return _ioAccounting ? _ioAccounting->statistics() : FMIOStatistics();
+}
+
+void FMDatabase::resetIOStatistics()
+{
+    if (_ioAccounting) {
+        _ioAccounting->resetStatistics();
+    }
+}
+
 #pragma mark Result set functions
 
 bool FMDatabase::hasOpenResultSets()
@@ -366,6 +667,10 @@ string FMDatabase::lastErrorMessage() const
 
 Error FMDatabase::lastError() const
 {
+    if (_deadlineExceeded && sqlite3_errcode(_db) == SQLITE_INTERRUPT) {
+        VariantMap userInfo({{LocalizedDescriptionKey, "The statement was stopped because its deadline passed."}});
+        return Error("FMDatabase", FMDatabaseErrorDeadlineExceeded, userInfo);
+    }
     VariantMap userInfo({{LocalizedDescriptionKey, lastErrorMessage()}});
     return Error("FMDatabase", sqlite3_errcode(_db), userInfo);
 }
@@ -492,8 +797,9 @@ bool FMDatabase::executeQueryPrepareAndCheck(const string &sql, sqlite3_stmt *&p
 		}
 	}
 	if (!pStmt) {
-		int rc = sqlite3_prepare_v2(_db, sql.c_str(), -1, &pStmt, 0);
+		int rc = prepareStatement(sql, &pStmt);
 		if (rc != SQLITE_OK) {
+			noteResultCode(rc);
 			if (_logsErrors) {
 				fprintf(stdout, "DB Error:%d, \"%s\"\n", lastErrorCode(), lastErrorMessage().c_str());
 				fprintf(stdout, "DB Query:%s\n", sql.c_str());
@@ -548,7 +854,8 @@ weak_ptr<FMResultSet> FMDatabase::executeQueryImpl(const string & sql, shared_pt
 
 bool FMDatabase::executeUpdateImpl(const string & sql, shared_ptr<FMStatement> &statement, sqlite3_stmt * pStmt)
 {
-	int rc = sqlite3_step(pStmt);
+	int rc = stepStatement(pStmt);
+	noteResultCode(rc);
 	if (rc == SQLITE_DONE) {
 		//
 	} else if (rc == SQLITE_INTERRUPT) {
@@ -666,6 +973,27 @@ bool FMDatabase::beginDeferredTransaction()
     return b;
 }
 
+bool FMDatabase::beginImmediateTransaction()
+{
+    bool b = executeUpdate("begin immediate transaction");
+    if (b) {
+        _inTransaction = true;
+    }
+    return b;
+}
+
+bool FMDatabase::beginTransaction(FMDatabaseTransactionMode mode)
+{
+    switch (mode) {
+        case FMDatabaseTransactionMode::Deferred:
+            return beginDeferredTransaction();
+        case FMDatabaseTransactionMode::Immediate:
+            return beginImmediateTransaction();
+        default:
+            return beginTransaction();
+    }
+}
+
 bool FMDatabase::commit()
 {
     bool b = executeUpdate("commit transaction");
@@ -689,6 +1017,76 @@ bool FMDatabase::inTransaction()
     return _inTransaction;
 }
 
+TimeInterval FMDatabaseRetryPolicy::backoffForAttempt(unsigned attempt) const
+{
+    TimeInterval backoff = initialBackoff;
+    for (unsigned i = 0; i < attempt && backoff < maximumBackoff; ++i) {
+        backoff *= 2;
+    }
+    return std::min(backoff, maximumBackoff);
+}
+
+void FMDatabase::noteResultCode(int rc)
+{
+    int primary = rc & 0xff;
+    if (primary == SQLITE_BUSY || primary == SQLITE_LOCKED) {
+        ++_busyErrorCount;
+    }
+}
+
+bool FMDatabase::inTransactionWithMode(FMDatabaseTransactionMode mode, const std::function<void (bool *)> &block, const FMDatabaseRetryPolicy &policy/* = FMDatabaseRetryPolicy()*/, Error *error/* = nullptr*/)
+{
+    auto deadline = _deadline;
+    bool success = false;
+    bool timedOut = false;
+    for (unsigned attempt = 0;; ++attempt) {
+        auto busyErrorCount = _busyErrorCount;
+        if (beginTransaction(mode)) {
+            bool shouldRollback = false;
+            block(&shouldRollback);
+            timedOut = _deadlineExceeded;
+            if (timedOut && error) {
+                *error = lastError();
+            }
+            // Commit and rollback must not be interrupted.
+            setDeadline(steady_clock::time_point::max());
+            if (shouldRollback || timedOut) {
+                rollback();
+                break;
+            }
+            // A statement of the block lost a lock: its work is incomplete, don't commit it.
+            if (_busyErrorCount == busyErrorCount && commit()) {
+                success = true;
+                break;
+            }
+            if (error) {
+                *error = lastError();
+            }
+            if (!sqlite3_get_autocommit(_db)) {
+                rollback();
+            }
+            _inTransaction = false;
+        } else if (error) {
+            *error = lastError();
+        }
+        if (_busyErrorCount == busyErrorCount || attempt + 1 >= policy.maximumAttempts) {
+            break;
+        }
+        auto backoff = duration_cast<steady_clock::duration>(policy.backoffForAttempt(attempt));
+        if (deadline != steady_clock::time_point::max() && steady_clock::now() + backoff >= deadline) {
+            break;
+        }
+        ++_transactionRetryCount;
+        this_thread::sleep_for(backoff);
+        setDeadline(deadline);
+    }
+    if (_deadline != deadline) {
+        setDeadline(deadline);
+        _deadlineExceeded = timedOut;
+    }
+    return success;
+}
+
 bool FMDatabase::interrupt()
 {
     if (_db) {
@@ -698,6 +1096,35 @@ bool FMDatabase::interrupt()
     return false;
 }
 
+#pragma mark Deadline
+
+// Number of virtual machine instructions between two checks of the clock.
+static const int FMDBProgressHandlerInstructionCount = 500;
+
+int FMDBDatabaseProgressHandler(void *f)
+{
+    FMDatabase *self = (FMDatabase *)f;
+    if (steady_clock::now() < self->_deadline) {
+        return 0;
+    }
+    self->_deadlineExceeded = true;
+    return 1;
+}
+
+void FMDatabase::setDeadline(steady_clock::time_point deadline)
+{
+    _deadline = deadline;
+    _deadlineExceeded = false;
+    if (!_db) {
+        return;
+    }
+    if (deadline != steady_clock::time_point::max()) {
+        sqlite3_progress_handler(_db, FMDBProgressHandlerInstructionCount, &FMDBDatabaseProgressHandler, this);
+    } else {
+        sqlite3_progress_handler(_db, 0, nullptr, nullptr);
+    }
+}
+
 static string FMDBEscapeSavePointName(string savepointName)
 {
     size_t pos = savepointName.find("'", 0);
@@ -942,5 +1369,450 @@ void FMDatabase::setUserVersion(uint32_t version)
     }
 }
 
+#pragma mark Warm-up
+
+static string FMDBQuotedIdentifier(const string &identifier)
+{
+    string quoted = "\"";
+    for (char c : identifier) {
+        if (c == '"') {
+            quoted += '"';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static Error FMDBWarmUpError(int code, const string &description)
+{
+    VariantMap userInfo({{LocalizedDescriptionKey, description}});
+    return Error("FMDatabase", code, userInfo);
+}
+
+/** The statement scanning the whole index `name`, or an empty string with `*error` set. */
+string FMDatabase::warmUpIndexScanStatement(const string &name, Error *error)
+{
+    string table;
+    string column;
+    auto rs = executeQuery("select tbl_name from sqlite_master where type = 'index' and name = ?", name).lock();
+    if (rs) {
+        if (rs->next()) {
+            table = *rs->stringForColumnIndex(0);
+        }
+        rs->close();
+    }
+    rs = executeQuery("pragma index_info(" + FMDBQuotedIdentifier(name) + ")").lock();
+    if (rs) {
+        if (rs->next() && !rs->columnIndexIsNull(2)) {
+            column = *rs->stringForColumnIndex(2);
+        }
+        rs->close();
+    }
+    if (table.empty() || column.empty()) {
+        *error = FMDBWarmUpError(SQLITE_ERROR, "No index named " + name + " starting with a column.");
+        return string();
+    }
+    // The limit keeps the ordered subquery from being flattened into the count, which could use another index.
+    return "select count(*) from (select " + FMDBQuotedIdentifier(column) + " from " + FMDBQuotedIdentifier(table) + " indexed by " + FMDBQuotedIdentifier(name) + " order by 1 limit -1)";
+}
+
+bool FMDatabase::warmUp(const FMWarmUpOptions &options, FMWarmUpStatistics *statistics/* = nullptr*/, Error *error/* = nullptr*/)
+{
+    if (!databaseExists()) {
+        if (error) {
+            *error = FMDBWarmUpError(SQLITE_MISUSE, "The database is not open.");
+        }
+        return false;
+    }
+    auto start = steady_clock::now();
+    FMWarmUpStatistics result;
+    Error firstError;
+    bool success = true;
+    auto fail = [&](Error &&failure) {
+        if (success) {
+            firstError = std::move(failure);
+        }
+        success = false;
+    };
+
+    bool ownsTransaction = !inTransaction() && beginDeferredTransaction();
+    // Takes the shared lock, so the file doesn't change under the reads.
+    longLongForQuery("select count(*) from sqlite_master");
+
+    sqlite3_file *file = nullptr;
+    if ((options.readAhead || options.adviseMemoryMap) && (sqlite3_file_control(_db, "main", SQLITE_FCNTL_FILE_POINTER, &file) != SQLITE_OK || !file || !file->pMethods)) {
+        file = nullptr; // an in-memory database.
+    }
+    sqlite3_int64 fileSize = 0;
+    if (file && file->pMethods->xFileSize(file, &fileSize) != SQLITE_OK) {
+        fileSize = 0;
+    }
+
+    if (options.readAhead && file) {
+        auto stepStart = steady_clock::now();
+        long long limit = options.maximumReadAheadBytes > 0 ? std::min<long long>(options.maximumReadAheadBytes, fileSize) : fileSize;
+        vector<char> buffer(std::max(options.readAheadChunkSize, 4096));
+        for (long long offset = 0; offset < limit; offset += buffer.size()) {
+            int length = (int)std::min<long long>(buffer.size(), limit - offset);
+            int rc = file->pMethods->xRead(file, buffer.data(), length, offset);
+            if (rc != SQLITE_OK) {
+                fail(FMDBWarmUpError(rc, "Could not read ahead " + databasePath() + "."));
+                break;
+            }
+            result.bytesReadAhead += length;
+        }
+        result.readAheadTime = steady_clock::now() - stepStart;
+    }
+
+#ifndef _WIN32
+    if (options.adviseMemoryMap && file && file->pMethods->iVersion >= 3) {
+        // xFetch takes an int: the start of a larger mapping is advised.
+        long long mapSize = std::min<long long>(std::min<long long>(longLongForQuery("pragma mmap_size"), fileSize), INT_MAX);
+        void *mapping = nullptr;
+        if (mapSize > 0 && file->pMethods->xFetch(file, 0, (int)mapSize, &mapping) == SQLITE_OK && mapping) {
+            if (madvise(mapping, (size_t)mapSize, MADV_WILLNEED) == 0) {
+                result.bytesAdvised = mapSize;
+            }
+            file->pMethods->xUnfetch(file, 0, mapping);
+        }
+    }
+#endif
+
+    auto scanStart = steady_clock::now();
+    vector<string> statements;
+    for (auto &table : options.tables) {
+        statements.push_back("select count(*) from " + FMDBQuotedIdentifier(table) + " not indexed");
+    }
+    for (auto &index : options.indexes) {
+        Error indexError;
+        string sql = warmUpIndexScanStatement(index, &indexError);
+        if (sql.empty()) {
+            fail(std::move(indexError));
+        } else {
+            statements.push_back(sql);
+        }
+    }
+    for (auto &sql : statements) {
+        auto rs = executeQuery(sql).lock();
+        if (rs && rs->next()) {
+            result.rowsScanned += rs->unsignedLongLongForColumnIndex(0);
+        } else {
+            fail(lastError());
+        }
+        if (rs) {
+            rs->close();
+        }
+    }
+    result.scanTime = steady_clock::now() - scanStart;
+
+    if (ownsTransaction) {
+        commit();
+    }
+    int current = 0;
+    int highwater = 0;
+    sqlite3_db_status(_db, SQLITE_DBSTATUS_CACHE_USED, &current, &highwater, 0);
+    result.cacheUsed = current;
+    result.duration = steady_clock::now() - start;
+    if (statistics) {
+        *statistics = result;
+    }
+    if (!success) {
+        fprintf(stderr, "Warming %s up failed: %s\n", sqlitePath(), firstError.description().c_str());
+        if (error) {
+            *error = std::move(firstError);
+        }
+    }
+    return success;
+}
+
+#pragma mark In-memory mode
+
+int FMDBDatabaseCommitHook(void *f)
+{
+    ((FMDatabase *)f)->_inMemoryStatistics.dirty = true;
+    return 0;
+}
+
+static Error FMDBInMemoryError(int code, const string &description)
+{
+    VariantMap userInfo({{LocalizedDescriptionKey, description}});
+    return Error("FMDatabase", code, userInfo);
+}
+
+/** Copy the whole `main` database of `source` into `destination`. */
+static int FMDBCopyDatabase(sqlite3 *destination, sqlite3 *source)
+{
+    sqlite3_backup *backup = sqlite3_backup_init(destination, "main", source, "main");
+    if (!backup) {
+        return sqlite3_errcode(destination);
+    }
+    int rc = sqlite3_backup_step(backup, -1);
+    int finishCode = sqlite3_backup_finish(backup);
+    return rc == SQLITE_DONE ? finishCode : rc;
+}
+
+bool FMDatabase::loadIntoMemory(Error *error/* = nullptr*/)
+{
+    if (_inMemory) {
+        return true;
+    }
+    if (!_databasePath || _databasePath->empty()) {
+        if (error) {
+            *error = FMDBInMemoryError(SQLITE_MISUSE, "Only a database file can be loaded into memory.");
+        }
+        return false;
+    }
+    auto start = steady_clock::now();
+    sqlite3 *file = _db;
+    const char *vfs = _ioAccounting ? _ioAccounting->name().c_str() : nullptr;
+    if (!file && sqlite3_open_v2(sqlitePath(), &file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfs) != SQLITE_OK) {
+        if (error) {
+            *error = FMDBInMemoryError(sqlite3_errcode(file), sqlite3_errmsg(file));
+        }
+        sqlite3_close(file);
+        return false;
+    }
+    sqlite3 *memory = nullptr;
+    int rc = sqlite3_open(":memory:", &memory);
+    if (rc == SQLITE_OK) {
+        rc = FMDBCopyDatabase(memory, file);
+    }
+    if (rc != SQLITE_OK) {
+        if (error) {
+            *error = FMDBInMemoryError(rc, memory ? sqlite3_errmsg(memory) : sqlite3_errstr(rc));
+        }
+        sqlite3_close(memory);
+        if (file != _db) {
+            sqlite3_close(file);
+        }
+        return false;
+    }
+    if (file == _db) {
+        close();
+    } else {
+        sqlite3_close(file);
+    }
+
+    _db = memory;
+    _inMemory = true;
+    if (_maxBusyRetryTimeInterval > TimeInterval(0)) {
+        setMaxBusyRetryTimeInterval(_maxBusyRetryTimeInterval);
+    }
+    setDeadline(_deadline);
+    // Journal, locking mode and page size belong to the file.
+    FMDatabaseOpenOptions options = _openOptions;
+    options.journalMode = FMJournalMode::Default;
+    options.lockingMode = FMLockingMode::Default;
+    options.pageSize = 0;
+    applyOpenOptions(options);
+    sqlite3_commit_hook(_db, &FMDBDatabaseCommitHook, this);
+
+    _inMemoryStatistics = FMInMemoryStatistics();
+    _inMemoryStatistics.loadTime = steady_clock::now() - start;
+    _inMemoryStatistics.databaseSize = longLongForQuery("pragma page_count") * longLongForQuery("pragma page_size");
+    _lastWriteBack = steady_clock::now();
+    return true;
+}
+
+bool FMDatabase::writeBack(Error *error/* = nullptr*/)
+{
+    if (!_inMemory) {
+        if (error) {
+            *error = FMDBInMemoryError(SQLITE_MISUSE, "The database is not in memory.");
+        }
+        return false;
+    }
+    if (!sqlite3_get_autocommit(_db)) {
+        if (error) {
+            *error = FMDBInMemoryError(SQLITE_BUSY, "The database can't be written back inside a transaction.");
+        }
+        return false;
+    }
+    auto start = steady_clock::now();
+    sqlite3 *file = nullptr;
+    const char *vfs = _ioAccounting ? _ioAccounting->name().c_str() : nullptr;
+    int rc = sqlite3_open_v2(sqlitePath(), &file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, vfs);
+    if (rc == SQLITE_OK) {
+        sqlite3_busy_timeout(file, (int)(_maxBusyRetryTimeInterval.count() * 1000));
+        rc = FMDBCopyDatabase(file, _db);
+    }
+    if (rc != SQLITE_OK && error) {
+        *error = FMDBInMemoryError(rc, file ? sqlite3_errmsg(file) : sqlite3_errstr(rc));
+    }
+    sqlite3_close(file);
+    if (rc != SQLITE_OK) {
+        return false;
+    }
+
+    TimeInterval duration = steady_clock::now() - start;
+    _lastWriteBack = steady_clock::now();
+    _inMemoryStatistics.dirty = false;
+    ++_inMemoryStatistics.writeBacks;
+    _inMemoryStatistics.lastWriteBackTime = duration;
+    _inMemoryStatistics.totalWriteBackTime += duration;
+    return true;
+}
+
+TimeInterval FMDatabase::writeBackDelay() const
+{
+    if (!_inMemory || !_inMemoryStatistics.dirty || _writeBackInterval <= TimeInterval(0)) {
+        return TimeInterval::max();
+    }
+    TimeInterval elapsed = steady_clock::now() - _lastWriteBack;
+    return std::max(TimeInterval(0), _writeBackInterval - elapsed);
+}
+
+bool FMDatabase::writeBackIfNeeded(Error *error/* = nullptr*/)
+{
+    if (writeBackDelay() > TimeInterval(0) || !sqlite3_get_autocommit(_db)) {
+        return true;
+    }
+    return writeBack(error);
+}
+
+FMInMemoryStatistics FMDatabase::inMemoryStatistics() const
+{
+    FMInMemoryStatistics statistics = _inMemoryStatistics;
+    if (_inMemory) {
+        int current = 0;
+        int highwater = 0;
+        sqlite3_db_status(_db, SQLITE_DBSTATUS_CACHE_USED, &current, &highwater, 0);
+        statistics.memoryUsed = current;
+    }
+    return statistics;
+}
+
+#pragma mark Online backup
+
+bool FMDatabase::backupToDatabase(FMDatabase &destination, const FMDatabaseBackupOptions &options/* = FMDatabaseBackupOptions()*/, Error *error/* = nullptr*/)
+{
+    FMDatabaseBackup backup(destination, *this, options);
+    bool more = true;
+    while (more) {
+        more = backup.step();
+        if (options.progress && !options.progress(backup.progress())) {
+            break;
+        }
+        if (more) {
+            this_thread::sleep_for(backup.throttleDelay());
+        }
+    }
+    return backup.finish(error);
+}
+
+bool FMDatabase::backupToPath(const string &path, const FMDatabaseBackupOptions &options/* = FMDatabaseBackupOptions()*/, Error *error/* = nullptr*/)
+{
+    FMDatabase destination(path);
+    if (!destination.open()) {
+        if (error) {
+            *error = destination.lastError();
+        }
+        return false;
+    }
+    return backupToDatabase(destination, options, error);
+}
+
+FMDatabaseBackup::FMDatabaseBackup(FMDatabase &destination, FMDatabase &source, const FMDatabaseBackupOptions &options/* = FMDatabaseBackupOptions()*/)
+:_destination(destination)
+,_options(options)
+,_backup(nullptr)
+,_startTime(steady_clock::now())
+,_resultCode(SQLITE_OK)
+,_blocked(false)
+{
+    parameterAssert(options.pagesPerStep > 0);
+    _backup = sqlite3_backup_init(destination.sqliteHandle(), options.destinationName.c_str(), source.sqliteHandle(), options.sourceName.c_str());
+    if (!_backup) {
+        _resultCode = destination.lastErrorCode();
+    }
+}
+
+FMDatabaseBackup::~FMDatabaseBackup()
+{
+    finish();
+}
+
+bool FMDatabaseBackup::step()
+{
+    if (!_backup || _resultCode != SQLITE_OK) {
+        return false;
+    }
+    int rc = sqlite3_backup_step(_backup, _options.pagesPerStep);
+    _progress.elapsed = steady_clock::now() - _startTime;
+    _blocked = rc == SQLITE_BUSY || rc == SQLITE_LOCKED;
+    if (_blocked) {
+        return true;
+    }
+    if (rc != SQLITE_OK && rc != SQLITE_DONE) {
+        _resultCode = rc;
+        return false;
+    }
+
+    int pageCount = sqlite3_backup_pagecount(_backup);
+    int remainingPages = sqlite3_backup_remaining(_backup);
+    int copied = pageCount - remainingPages;
+    int copiedBefore = _progress.pageCount - _progress.remainingPages;
+    // A step starting over from the first page ends where a previous step had already been.
+    bool restarted = _progress.pagesCopied > 0 && copied <= copiedBefore;
+    if (restarted) {
+        ++_progress.restarts;
+    }
+    _progress.pagesCopied += restarted ? copied : copied - copiedBefore;
+    _progress.pageCount = pageCount;
+    _progress.remainingPages = remainingPages;
+
+    if (rc == SQLITE_DONE) {
+        _resultCode = SQLITE_DONE;
+        return false;
+    }
+    if (_options.maximumRestarts > 0 && _progress.restarts > _options.maximumRestarts) {
+        _resultCode = SQLITE_BUSY;
+        return false;
+    }
+    return true;
+}
+
+TimeInterval FMDatabaseBackup::throttleDelay() const
+{
+    TimeInterval delay(0);
+    if (_options.maximumPagesPerSecond > 0) {
+        TimeInterval scheduled(_progress.pagesCopied / _options.maximumPagesPerSecond);
+        delay = std::max(delay, scheduled - TimeInterval(steady_clock::now() - _startTime));
+    }
+    if (_blocked) {
+        delay = std::max(delay, TimeInterval(0.01));
+    }
+    return delay;
+}
+
+bool FMDatabaseBackup::finish(Error *error/* = nullptr*/)
+{
+    if (_backup) {
+        int rc = sqlite3_backup_finish(_backup);
+        _backup = nullptr;
+        if (rc != SQLITE_OK && (_resultCode == SQLITE_OK || _resultCode == SQLITE_DONE)) {
+            _resultCode = rc;
+        }
+    }
+    if (_resultCode == SQLITE_DONE) {
+        return true;
+    }
+    if (error) {
+        string description;
+        int code = _resultCode;
+        if (code == SQLITE_OK) {
+            code = SQLITE_ABORT;
+            description = "The backup was stopped before every page was copied.";
+        } else if (code == SQLITE_BUSY && _options.maximumRestarts > 0 && _progress.restarts > _options.maximumRestarts) {
+            description = "The source was written too many times during the backup.";
+        } else {
+            description = sqlite3_errstr(code);
+        }
+        VariantMap userInfo({{LocalizedDescriptionKey, description}});
+        *error = Error("FMDatabase", code, userInfo);
+    }
+    return false;
+}
+
 
 FMDB_END
@@ -16,6 +16,7 @@
 #include "Variant.hpp"
 #include "Error.hpp"
 #include "FMResultSet.h"
+#include "FMHistogram.hpp"
 
 using std::unordered_map;
 using std::unordered_set;
@@ -24,15 +25,234 @@ using std::function;
 
 typedef struct sqlite3 sqlite3;
 typedef struct sqlite3_stmt sqlite3_stmt;
+typedef struct sqlite3_backup sqlite3_backup;
 
 FMDB_BEGIN
 
 class FMStatement;
 class FMResultSet;
+class FMIOAccountingVFS;
 /*class Variant;*/
 
 extern const string FMDatabaseNullFilePath;
 
+enum FMDatabaseErrorCode {
+    /** A statement was stopped because the deadline set with `setDeadline` passed. Outside the range of SQLite's result codes. */
+    FMDatabaseErrorDeadlineExceeded = 0x10000,
+};
+
+enum class FMDatabaseTransactionMode : int {
+    /** Take the locks when the first statements need them; a later write can fail with `SQLITE_BUSY` while upgrading its lock. */
+    Deferred,
+    /** Take the write lock at `begin`; readers go on. */
+    Immediate,
+    /** Take the write lock at `begin`; outside of WAL mode readers are blocked too. */
+    Exclusive,
+};
+
+/**
+ How a transaction block is run again after `SQLITE_BUSY` or `SQLITE_LOCKED`.
+
+ The block must be idempotent: a failed attempt is rolled back and the block is called again from the start.
+ */
+struct FMDatabaseRetryPolicy {
+    /** The number of attempts, the first one included. One disables retrying. */
+    unsigned maximumAttempts = 1;
+    /** The sleep before the first retry; it doubles after each attempt up to `maximumBackoff`. */
+    TimeInterval initialBackoff = TimeInterval(0.001);
+    TimeInterval maximumBackoff = TimeInterval(0.1);
+
+    FMDatabaseRetryPolicy() {}
+    explicit FMDatabaseRetryPolicy(unsigned maximumAttempts) : maximumAttempts(maximumAttempts) {}
+
+    /** The sleep after the failed attempt number `attempt`, counting from zero. */
+    TimeInterval backoffForAttempt(unsigned attempt) const;
+};
+
+enum class FMJournalMode : int { Default, Delete, Truncate, Persist, Memory, WAL, Off };
+enum class FMSynchronousMode : int { Default, Off, Normal, Full, Extra };
+enum class FMTempStore : int { Default, File, Memory };
+enum class FMLockingMode : int { Default, Normal, Exclusive };
+
+/**
+ The pragmas `FMDatabase` sends right after opening, in the order the settings depend on each other: `page_size` (only effective before the file has content) and `locking_mode` first, then `journal_mode` and the rest.
+
+ `Default` members and zero or negative sizes leave the setting of SQLite alone, so a default-constructed object sends nothing.
+
+    FMDatabase db(path);
+    db.setOpenOptions(FMDatabaseOpenOptions::OLTPWAL());
+    db.open();
+ */
+struct FMDatabaseOpenOptions {
+    FMJournalMode journalMode = FMJournalMode::Default;
+    FMSynchronousMode synchronous = FMSynchronousMode::Default;
+    /** In pages when positive, in KiB when negative, as with `PRAGMA cache_size`. Zero leaves the default. */
+    int cacheSize = 0;
+    /** Bytes of the file mapped in memory; zero turns memory mapping off. Negative leaves the default. */
+    long long mmapSize = -1;
+    FMTempStore tempStore = FMTempStore::Default;
+    int pageSize = 0;
+    FMLockingMode lockingMode = FMLockingMode::Default;
+    /** 1 turns foreign key enforcement on, 0 off. Negative leaves the default. */
+    int foreignKeys = -1;
+    /** Open the connection through a private `<FMIOAccountingVFS>`, see `FMDatabase::ioStatistics`. Only taken into account when opening. */
+    bool ioAccounting = false;
+
+    /** The statements sending the pragmas; empty when nothing is set. */
+    string statements() const;
+
+    /** Many small write transactions with concurrent readers: WAL, `synchronous=normal`, 8 MiB of cache and foreign keys on. */
+    static FMDatabaseOpenOptions OLTPWAL();
+    /** Loading a large amount of data once: no journal, no sync, an exclusive lock and 64 MiB of cache. A crash during the load corrupts the file. */
+    static FMDatabaseOpenOptions bulkLoad();
+    /** Long read-only queries: 256 MiB memory mapped, 64 MiB of cache and temporary b-trees in memory. The journal mode is left alone since a read-only connection can't change it. */
+    static FMDatabaseOpenOptions readOnlyAnalytics();
+};
+
+/**
+ How the busy handler waits for a lock held by another connection.
+
+ The first `yieldCount` calls only yield the thread, which is enough for locks held a few microseconds. Then the handler sleeps, starting at `initialSleep` and doubling up to `maximumSleep`; each sleep is shortened by a random part of up to `jitter` so that waiting connections don't wake up together. The wait gives up after `FMDatabase::maxBusyRetryTimeInterval`, measured on `steady_clock`.
+ */
+struct FMDatabaseBusyStrategy {
+    unsigned yieldCount = 4;
+    TimeInterval initialSleep = TimeInterval(0.0001);
+    TimeInterval maximumSleep = TimeInterval(0.02);
+    /** Between 0 and 1. */
+    double jitter = 0.5;
+
+    /** The sleep of the call number `retry` after the yield phase, counting from zero, before jitter. */
+    TimeInterval sleepForRetry(unsigned retry) const;
+
+    /** Yields, then sleeps from 100 µs up to 20 ms. The default. */
+    static FMDatabaseBusyStrategy exponentialBackoff() { return FMDatabaseBusyStrategy(); }
+    /** Only yields: lowest latency, but a waiting thread keeps its core busy. */
+    static FMDatabaseBusyStrategy yield();
+    /** Sleeps between `sleep / 2` and `sleep` on every call, without yielding first. */
+    static FMDatabaseBusyStrategy fixedSleep(TimeInterval sleep);
+};
+
+struct FMDatabaseBusyStatistics {
+    /** The statements that found the database locked and called the busy handler. */
+    unsigned long long waits = 0;
+    /** Calls of the busy handler that asked SQLite to try again. */
+    unsigned long long retries = 0;
+    /** Waits given up after `maxBusyRetryTimeInterval`. */
+    unsigned long long timeouts = 0;
+    /** Shared-cache waits that blocked on `sqlite3_unlock_notify` instead of sleeping. */
+    unsigned long long unlockNotifications = 0;
+    /** Time spent yielding and sleeping in the busy handler. */
+    TimeInterval totalWaitTime = TimeInterval(0);
+    TimeInterval longestWaitTime = TimeInterval(0);
+};
+
+struct FMDatabaseBackupProgress {
+    /** The pages of the source, and those not copied yet. */
+    int pageCount = 0;
+    int remainingPages = 0;
+    /** Pages written to the destination, those of copies started over included. */
+    unsigned long long pagesCopied = 0;
+    /** The times the copy started over because another connection wrote to the source. */
+    unsigned restarts = 0;
+    TimeInterval elapsed = TimeInterval(0);
+};
+
+struct FMDatabaseBackupOptions {
+    /** The pages copied by one step. The source is only locked during a step. */
+    int pagesPerStep = 256;
+    /** The copy pauses between steps to stay under this rate. Zero copies as fast as possible. */
+    double maximumPagesPerSecond = 0;
+    /** The backup fails with `SQLITE_BUSY` after this many restarts. Zero never gives up. */
+    unsigned maximumRestarts = 0;
+    string sourceName = "main";
+    string destinationName = "main";
+    /** Called after each step; returning `false` stops the backup and leaves the destination unchanged. */
+    std::function<bool(const FMDatabaseBackupProgress &progress)> progress;
+};
+
+struct FMInMemoryStatistics {
+    /** The time `loadIntoMemory` took to copy the file. */
+    TimeInterval loadTime = TimeInterval(0);
+    /** The size of the database when it was loaded: its pages times the page size. */
+    long long databaseSize = 0;
+    /** The heap used by the pages of the in-memory database now, from `SQLITE_DBSTATUS_CACHE_USED`. */
+    long long memoryUsed = 0;
+    unsigned long long writeBacks = 0;
+    TimeInterval lastWriteBackTime = TimeInterval(0);
+    TimeInterval totalWriteBackTime = TimeInterval(0);
+    /** Whether transactions were committed since the load or the last write-back. */
+    bool dirty = false;
+};
+
+struct FMIOOperationStatistics {
+    unsigned long long count = 0;
+    /** The bytes read or written; zero for syncs. */
+    unsigned long long bytes = 0;
+    /** In microseconds. */
+    FMHistogramSnapshot latency;
+};
+
+struct FMIOFileStatistics {
+    FMIOOperationStatistics reads;
+    FMIOOperationStatistics writes;
+    FMIOOperationStatistics syncs;
+};
+
+/**
+ The file I/O counted by an `<FMIOAccountingVFS>`.
+
+ Pages read through memory mapping (`mmap_size`) don't go through reads, and the shared memory of the WAL index is not file I/O.
+ */
+struct FMIOStatistics {
+    FMIOFileStatistics mainDatabase;
+    FMIOFileStatistics wal;
+    /** The rollback journal. */
+    FMIOFileStatistics journal;
+    /** Temporary databases, statement journals and super-journals. */
+    FMIOFileStatistics other;
+
+    unsigned long long bytesRead() const;
+    unsigned long long bytesWritten() const;
+    unsigned long long syncCount() const;
+};
+
+/**
+ The steps of `FMDatabase::warmUp`, run in this order. A default-constructed object does nothing.
+
+    FMWarmUpOptions options;
+    options.readAhead = true;
+    options.tables = {"message"};
+    options.indexes = {"message_by_date"};
+ */
+struct FMWarmUpOptions {
+    /** Read the database file from start to end through the VFS, so that the page cache of the OS holds it. */
+    bool readAhead = false;
+    /** The bytes of each read. */
+    int readAheadChunkSize = 1024 * 1024;
+    /** Stop reading ahead after this many bytes. Zero reads the whole file. */
+    long long maximumReadAheadBytes = 0;
+    /** When the file is memory mapped (`mmap_size`), ask the OS to page the mapping in with `madvise(MADV_WILLNEED)`, which returns at once. Does nothing where `madvise` does not exist. */
+    bool adviseMemoryMap = false;
+    /** Tables whose b-tree is scanned into the page cache of the connection, or touched through the mapping when the file is memory mapped. Overflow pages of large values are not read. */
+    vector<string> tables;
+    /** Indexes scanned into the page cache of the connection. Only indexes starting with a column, not an expression, can be scanned. */
+    vector<string> indexes;
+};
+
+struct FMWarmUpStatistics {
+    /** The whole warm-up, then each of its steps. */
+    TimeInterval duration = TimeInterval(0);
+    TimeInterval readAheadTime = TimeInterval(0);
+    TimeInterval scanTime = TimeInterval(0);
+    long long bytesReadAhead = 0;
+    /** The bytes of the mapping given to `madvise`, at most 2 GiB. */
+    long long bytesAdvised = 0;
+    /** The rows of the tables and the entries of the indexes scanned. */
+    unsigned long long rowsScanned = 0;
+    /** The heap used by the page cache afterwards, from `SQLITE_DBSTATUS_CACHE_USED`. */
+    long long cacheUsed = 0;
+};
+
 class FMDatabase
 {
 public:
@@ -50,11 +270,24 @@ public:
     const StatemenCacheType &cachedStatements() const { return _cachedStatements; }
 
     bool open();
+    /**
+     Open the database with the flags of `sqlite3_open_v2`.
+
+     With `SQLITE_OPEN_SHAREDCACHE` the connections of the process to the same file share one page cache, and lock each other per table. A statement that finds a table locked by another connection of the cache (`SQLITE_LOCKED_SHAREDCACHE`) waits and is run again: when the linked SQLite has `sqlite3_unlock_notify` (see `supportsUnlockNotify`) it blocks on it until the other connection ends its transaction, otherwise it sleeps following `busyStrategy`. Either way the wait counts in `busyStatistics` and gives up after `maxBusyRetryTimeInterval`.
+     */
     bool openWithFlags(int flags, const string &vfs = FMDatabase::stringNull);
+
+    /** The options applied by the next `open` or `openWithFlags`. When one of their pragmas fails, the open fails too and the connection is closed. */
+    void setOpenOptions(const FMDatabaseOpenOptions &options) { _openOptions = options; }
+    const FMDatabaseOpenOptions &openOptions() const { return _openOptions; }
+    /** Send the pragmas of `options` on the open connection. */
+    bool applyOpenOptions(const FMDatabaseOpenOptions &options);
     bool close();
 
     static string sqliteLibVersion();
     static bool isSQLiteThreadSafe();
+    /** Whether the linked SQLite was built with `SQLITE_ENABLE_UNLOCK_NOTIFY`. It is looked up at run time, unless FMDB itself is built with the define. */
+    static bool supportsUnlockNotify();
 
     bool isGoodConnection();
 
@@ -66,11 +299,30 @@ public:
     /* Transactions */
     bool beginTransaction();
     bool beginDeferredTransaction();
+    bool beginImmediateTransaction();
+    bool beginTransaction(FMDatabaseTransactionMode mode);
 
     bool commit();
     bool rollback();
     bool inTransaction();
 
+    /**
+     Run `block` in a transaction and commit it unless the block sets `*rollback`.
+
+     When `begin`, a statement of the block or `commit` fails with `SQLITE_BUSY` or `SQLITE_LOCKED`, the transaction is rolled back and the block run again, up to `policy.maximumAttempts` times. A block that lost a lock is never committed, even on its last attempt: its work is incomplete.
+
+     A deadline set with `setDeadline` covers the blocks but not `commit` and `rollback`, and no attempt starts once its backoff would end past it. The deadline is still set on return.
+
+     @param error Set to the error of the last attempt when it failed on its own, left empty when the block asked for the rollback.
+     @return `true` if the transaction was committed.
+     */
+    bool inTransactionWithMode(FMDatabaseTransactionMode mode, const std::function<void(bool *rollback)> &block, const FMDatabaseRetryPolicy &policy = FMDatabaseRetryPolicy(), Error *error = nullptr);
+
+    /** The number of statements of this connection that failed with `SQLITE_BUSY` or `SQLITE_LOCKED`. */
+    unsigned long long busyErrorCount() const { return _busyErrorCount; }
+    /** The number of times `inTransactionWithMode` ran a block again. */
+    unsigned long long transactionRetryCount() const { return _transactionRetryCount; }
+
     bool startSavePointWithName(const string &name, Error *error = nullptr);
     bool releaseSavePointWithName(const string &name, Error *error = nullptr);
     bool rollbackToSavePointWithName(const string &name, Error *error = nullptr);
@@ -85,6 +337,17 @@ public:
 
     bool interrupt();
 
+    /**
+     Stop statements that are still running at `deadline`.
+
+     A progress handler checks the clock every few hundred virtual machine instructions; once the deadline has passed the running statement fails with `SQLITE_INTERRUPT`, `deadlineExceeded` becomes `true` and `lastError` reports `FMDatabaseErrorDeadlineExceeded`. Unlike `interrupt`, it only affects statements run before the deadline is cleared.
+
+     @param deadline The deadline, or `steady_clock::time_point::max()` to remove it.
+     */
+    void setDeadline(steady_clock::time_point deadline);
+    steady_clock::time_point deadline() const { return _deadline; }
+    bool deadlineExceeded() const { return _deadlineExceeded; }
+
     /* Encryption */
     bool setKey(const string &key);
     bool setKey(const vector<char> &key);
@@ -96,6 +359,56 @@ public:
     const string &databasePath() const { return *_databasePath; };
     sqlite3 *sqliteHandle() const { return _db; };
 
+    /* Warm-up */
+
+    /**
+     Fill the caches after opening, so that the first statements don't fault pages in one by one.
+
+     Reading ahead and `madvise` warm the page cache of the OS, which other connections and processes share; the scans fill the page cache of this connection, up to its `cache_size`. The steps run in one read transaction, unless one is already open. A step that fails doesn't stop the next ones. `<FMDatabaseQueue>` can warm up in the background, see `FMDatabaseQueue::warmUp`.
+
+     @param statistics Receives how long each step took.
+     @param error Receives the first failure.
+     @return `false` if a step failed.
+     */
+    bool warmUp(const FMWarmUpOptions &options, FMWarmUpStatistics *statistics = nullptr, Error *error = nullptr);
+
+    /* In-memory mode */
+
+    /**
+     Copy the database file into an in-memory database with the backup API and serve every statement from it.
+
+     Reads never touch the disk and writes only change memory: the file is updated by a write-back, which copies the whole database over it. A write-back runs when `writeBack` is called, when `writeBackIfNeeded` is called once `writeBackInterval` passed since the previous one, and when the connection closes. An `<FMDatabaseQueue>` calls `writeBackIfNeeded` while idle, see `FMDatabaseQueue::loadIntoMemory`.
+
+     Works on an open or a closed connection. The prepared statements and open result sets are dropped, and functions made with `makeFunctionNamed` must be made again.
+
+     @warning Changes made since the last write-back are lost if the process dies. Other connections to the file see neither them nor take them into account: a write-back overwrites their changes.
+     */
+    bool loadIntoMemory(Error *error = nullptr);
+    bool isInMemory() const { return _inMemory; }
+    /** Copy the in-memory database over the file. Fails inside a transaction. */
+    bool writeBack(Error *error = nullptr);
+    /** Write back if changes were committed and `writeBackInterval` passed since the load or the last write-back. @return `false` if the write-back failed. */
+    bool writeBackIfNeeded(Error *error = nullptr);
+    /** The time until `writeBackIfNeeded` writes back: zero when due, `TimeInterval::max()` with nothing to write or a zero interval. */
+    TimeInterval writeBackDelay() const;
+    /** The least time between two write-backs of `writeBackIfNeeded`. Zero, the default, only writes back on demand and when closing. */
+    void setWriteBackInterval(TimeInterval interval) { _writeBackInterval = interval; }
+    TimeInterval writeBackInterval() const { return _writeBackInterval; }
+    FMInMemoryStatistics inMemoryStatistics() const;
+
+    /* Online backup */
+
+    /**
+     Copy this database into `destination` with `sqlite3_backup_step`, `options.pagesPerStep` pages at a time.
+
+     Other connections can read and write the source between steps. A write of another connection makes the next step start the copy over; a write of this connection is copied along. See `<FMDatabaseBackup>` to interleave the steps with other work.
+
+     @return `true` if every page was copied.
+     */
+    bool backupToDatabase(FMDatabase &destination, const FMDatabaseBackupOptions &options = FMDatabaseBackupOptions(), Error *error = nullptr);
+    /** Like `backupToDatabase`, into the database at `path`, created if needed. */
+    bool backupToPath(const string &path, const FMDatabaseBackupOptions &options = FMDatabaseBackupOptions(), Error *error = nullptr);
+
     /* Retrieving error codes */
     string lastErrorMessage() const;
     Error lastError() const;
@@ -106,6 +419,24 @@ public:
     void setMaxBusyRetryTimeInterval(TimeInterval timeoutInSeconds);
     double maxBusyRetryTimeInterval() const { return _maxBusyRetryTimeInterval.count(); };
 
+    void setBusyStrategy(const FMDatabaseBusyStrategy &strategy) { _busyStrategy = strategy; }
+    const FMDatabaseBusyStrategy &busyStrategy() const { return _busyStrategy; }
+    /** How long this connection waited for locks. Only read it on the thread using the connection. */
+    const FMDatabaseBusyStatistics &busyStatistics() const { return _busyStatistics; }
+    void resetBusyStatistics() { _busyStatistics = FMDatabaseBusyStatistics(); }
+
+    /**
+     The file I/O of this connection, when it was opened with `FMDatabaseOpenOptions::ioAccounting`; empty otherwise.
+
+     The counting goes on across `close` and a new open, and the write-backs of the in-memory mode count too. Can be read from any thread. Reset the statistics before a code path and read them after it to see the I/O it caused:
+
+        db.resetIOStatistics();
+        importBatch(db);
+        auto io = db.ioStatistics(); // io.wal.writes.bytes, io.mainDatabase.syncs.count...
+     */
+    FMIOStatistics ioStatistics() const;
+    void resetIOStatistics();
+
 	/** execute sql templates */
 
 	/**
@@ -203,6 +534,16 @@ private:
 private:
     const char *sqlitePath() const;
     friend int FMDBDatabaseBusyHandler(void *f, int count);
+    friend int FMDBDatabaseProgressHandler(void *f);
+    friend int FMDBDatabaseCommitHook(void *f);
+    friend class FMDatabasePool;
+    friend class FMResultSet;
+    void noteResultCode(int rc);
+    int prepareStatement(const string &sql, sqlite3_stmt **statement);
+    /** `sqlite3_step`, waiting for other connections of a shared cache. Only a statement that returned no row yet is run again. */
+    int stepStatement(sqlite3_stmt *statement);
+    bool waitForSharedCacheUnlock(unsigned attempt, steady_clock::time_point start);
+    string warmUpIndexScanStatement(const string &name, Error *error);
 
     shared_ptr<FMStatement> cachedStatementForQuery(const string &query);
     void setCachedStatement(shared_ptr<FMStatement> &statement, const string &query);
@@ -219,17 +560,77 @@ private:
 	volatile uint32_t _shouldCacheStatements : 1;
     volatile uint32_t _isExecutingStatement : 1;
 	volatile uint32_t _inTransaction : 1;
+    uint32_t _deadlineExceeded : 1;
 #if __PL64__
     uint32_t reserve;
 #endif
     sqlite3 *_db = nullptr;
     TimeInterval _maxBusyRetryTimeInterval = TimeInterval(2); // 2 seconds
-    TimeInterval _startBusyRetryTime;
+    steady_clock::time_point _startBusyRetryTime;
+    FMDatabaseBusyStrategy _busyStrategy;
+    FMDatabaseOpenOptions _openOptions;
+    FMDatabaseBusyStatistics _busyStatistics;
+    steady_clock::time_point _deadline = steady_clock::time_point::max();
+    unsigned long long _busyErrorCount = 0;
+    unsigned long long _transactionRetryCount = 0;
+    bool _inMemory = false;
+    TimeInterval _writeBackInterval = TimeInterval(0);
+    steady_clock::time_point _lastWriteBack;
+    FMInMemoryStatistics _inMemoryStatistics;
+    unique_ptr<FMIOAccountingVFS> _ioAccounting;
     StatemenCacheType _cachedStatements;
     unique_ptr<vector<shared_ptr<FMResultSet>>> _openResultSets;
     unique_ptr<string> _databasePath;
 };
 
+/**
+ An online backup in progress, stepped by the caller.
+
+ Each `step` copies `pagesPerStep` pages, so the steps can be spread over time or between other tasks using the source connection:
+
+    FMDatabaseBackup backup(destination, source, options);
+    while (backup.step()) {
+        this_thread::sleep_for(backup.throttleDelay());
+    }
+    backup.finish(&error);
+
+ @note Steps must not run at the same time as other statements of either connection.
+ */
+class FMDatabaseBackup
+{
+public:
+    FMDatabaseBackup(FMDatabase &destination, FMDatabase &source, const FMDatabaseBackupOptions &options = FMDatabaseBackupOptions());
+    /** Calls `finish` if needed. */
+    ~FMDatabaseBackup();
+    FMDatabaseBackup(const FMDatabaseBackup &) = delete;
+    FMDatabaseBackup& operator=(const FMDatabaseBackup &) = delete;
+
+    /**
+     Copy the next pages.
+
+     @return `true` while pages remain. A step finding the source or the destination locked copies nothing and returns `true`.
+     */
+    bool step();
+    /**
+     Release the backup. If the copy is not done, the destination is left as it was.
+
+     @return `true` if every page was copied.
+     */
+    bool finish(Error *error = nullptr);
+
+    const FMDatabaseBackupProgress &progress() const { return _progress; }
+    /** The pause before the next step that keeps the copy under `maximumPagesPerSecond`, or lets a lock go after a blocked step. */
+    TimeInterval throttleDelay() const;
+private:
+    FMDatabase &_destination;
+    FMDatabaseBackupOptions _options;
+    FMDatabaseBackupProgress _progress;
+    sqlite3_backup *_backup;
+    steady_clock::time_point _startTime;
+    int _resultCode;
+    bool _blocked;
+};
+
 template<typename ...Args>
 inline weak_ptr<FMResultSet> FMDatabase::executeQuery(const string &sql, Args... args)
 {
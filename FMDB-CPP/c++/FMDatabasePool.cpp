@@ -0,0 +1,259 @@
+//
+//  FMDatabasePool.cpp
+//  fmdb
+//
+
+#include "FMDatabasePool.h"
+#include <sqlite3.h>
+#include <mutex>
+#include <condition_variable>
+#include <list>
+
+using namespace std;
+
+FMDB_BEGIN
+
+struct __databasePoolPacket {
+    struct IdleReader {
+        FMDatabase *db;
+        steady_clock::time_point checkinTime;
+    };
+    mutable mutex _mutex;
+    condition_variable _readerAvailable;
+    list<IdleReader> _idleReaders;
+    size_t _checkedOutCount = 0;
+    mutex _writerMutex;
+};
+
+FMDatabasePool::FMDatabasePool(const string &path, int maximumNumberOfReaders/* = 4*/, int openFlags/* = 0*/, const string &vfsName/* = FMDatabase::stringNull*/)
+:_openFlags(openFlags)
+,_maximumNumberOfReaders(maximumNumberOfReaders)
+,_shouldCacheStatements(true)
+,_path(path)
+,_vfsName(vfsName)
+,_maximumIdleTimeInterval(0)
+,_writer(new FMDatabase(path))
+,_packet(new struct __databasePoolPacket)
+{
+    parameterAssert(path.length());
+    parameterAssert(maximumNumberOfReaders > 0);
+    if (_openFlags == 0) {
+        _openFlags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    }
+    if (!_writer->openWithFlags(_openFlags, _vfsName.empty() ? FMDatabase::stringNull : _vfsName)) {
+        _assert(false, "Could not open writer of database pool for path %s", path.c_str());
+        return;
+    }
+    _writer->setShouldCacheStatements(_shouldCacheStatements);
+
+    // Readers only scale when they don't take the writer's lock: that needs WAL.
+    auto rs = _writer->executeQuery("pragma journal_mode=wal").lock();
+    if (rs) {
+        String mode;
+        if (rs->next()) {
+            mode = rs->stringForColumnIndex(0);
+        }
+        rs->close();
+        if (!mode || *mode != "wal") {
+            fprintf(stderr, "WARNING: database pool could not switch %s into WAL mode.\n", path.c_str());
+        }
+    }
+}
+
+FMDatabasePool::~FMDatabasePool()
+{
+    releaseAllDatabases();
+    delete _writer;
+    _writer = nullptr;
+
+    delete _packet;
+    _packet = nullptr;
+}
+
+void FMDatabasePool::setMaximumNumberOfReaders(int count)
+{
+    parameterAssert(count > 0);
+    lock_guard<mutex> locker(_packet->_mutex);
+    _maximumNumberOfReaders = count;
+    _packet->_readerAvailable.notify_all();
+}
+
+void FMDatabasePool::setShouldCacheStatements(bool value)
+{
+    {
+        lock_guard<mutex> locker(_packet->_mutex);
+        _shouldCacheStatements = value;
+        for (auto &idle : _packet->_idleReaders) {
+            idle.db->setShouldCacheStatements(value);
+        }
+    }
+    lock_guard<mutex> locker(_packet->_writerMutex);
+    _writer->setShouldCacheStatements(value);
+}
+
+size_t FMDatabasePool::countOfCheckedInDatabases() const
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    return _packet->_idleReaders.size();
+}
+
+size_t FMDatabasePool::countOfCheckedOutDatabases() const
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    return _packet->_checkedOutCount;
+}
+
+size_t FMDatabasePool::countOfOpenDatabases() const
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    return _packet->_idleReaders.size() + _packet->_checkedOutCount;
+}
+
+void FMDatabasePool::releaseAllDatabases()
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    releaseIdleDatabasesLocked(true);
+}
+
+void FMDatabasePool::releaseIdleDatabases()
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    releaseIdleDatabasesLocked(false);
+}
+
+void FMDatabasePool::releaseIdleDatabasesLocked(bool all)
+{
+    if (!all && _maximumIdleTimeInterval <= TimeInterval(0)) {
+        return;
+    }
+    auto now = steady_clock::now();
+    auto &idleReaders = _packet->_idleReaders;
+    for (auto iter = idleReaders.begin(); iter != idleReaders.end();) {
+        if (all || now - iter->checkinTime > _maximumIdleTimeInterval) {
+            delete iter->db;
+            iter = idleReaders.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+FMDatabase *FMDatabasePool::openReader()
+{
+    FMDatabase *db = new FMDatabase(_path);
+    // A reader is only used by one thread at a time, so skip SQLite's connection mutex.
+    int flags = SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX;
+    if (!db->openWithFlags(flags, _vfsName.empty() ? FMDatabase::stringNull : _vfsName)) {
+        fprintf(stderr, "Could not open reader of database pool for path %s\n", _path.c_str());
+        delete db;
+        return nullptr;
+    }
+    db->setShouldCacheStatements(_shouldCacheStatements);
+    return db;
+}
+
+FMDatabase *FMDatabasePool::checkoutReader()
+{
+    unique_lock<mutex> locker(_packet->_mutex);
+    releaseIdleDatabasesLocked(false);
+    _packet->_readerAvailable.wait(locker, [this]() {
+        return !_packet->_idleReaders.empty() || _packet->_checkedOutCount < (size_t)_maximumNumberOfReaders;
+    });
+
+    FMDatabase *db = nullptr;
+    if (!_packet->_idleReaders.empty()) {
+        // Most recently used first: its page cache is the warmest.
+        db = _packet->_idleReaders.back().db;
+        _packet->_idleReaders.pop_back();
+    } else {
+        ++_packet->_checkedOutCount; // reserve the slot while opening outside the lock.
+        locker.unlock();
+        db = openReader();
+        locker.lock();
+        --_packet->_checkedOutCount;
+        if (!db) {
+            _packet->_readerAvailable.notify_one();
+            return nullptr;
+        }
+    }
+    ++_packet->_checkedOutCount;
+    db->_checkedOut = true;
+    return db;
+}
+
+void FMDatabasePool::checkin(FMDatabase *db)
+{
+    if (!db) {
+        return;
+    }
+    _assert(db != _writer, "The writer connection can't be checked in.");
+    db->closeOpenResultSets();
+    db->_checkedOut = false;
+
+    lock_guard<mutex> locker(_packet->_mutex);
+    --_packet->_checkedOutCount;
+    if (_packet->_idleReaders.size() + _packet->_checkedOutCount >= (size_t)_maximumNumberOfReaders) {
+        delete db; // the pool shrank while this reader was out.
+    } else {
+        _packet->_idleReaders.push_back({db, steady_clock::now()});
+    }
+    releaseIdleDatabasesLocked(false);
+    _packet->_readerAvailable.notify_one();
+}
+
+void FMDatabasePool::inReadDatabase(const std::function<void (FMDatabase &)> &block)
+{
+    FMDatabase *db = checkoutReader();
+    if (!db) {
+        return;
+    }
+    block(*db);
+    checkin(db);
+}
+
+void FMDatabasePool::inDatabase(const std::function<void (FMDatabase &)> &block)
+{
+    lock_guard<mutex> locker(_packet->_writerMutex);
+    block(*_writer);
+    _writer->closeOpenResultSets();
+}
+
+void FMDatabasePool::inTransaction(bool useDeferred, const std::function<void (FMDatabase &, bool &)> &block)
+{
+    lock_guard<mutex> locker(_packet->_writerMutex);
+    if (useDeferred) {
+        _writer->beginDeferredTransaction();
+    } else {
+        _writer->beginTransaction();
+    }
+
+    bool shouldRollback = false;
+    block(*_writer, shouldRollback);
+    _writer->closeOpenResultSets();
+
+    if (shouldRollback) {
+        _writer->rollback();
+    } else {
+        _writer->commit();
+    }
+}
+
+void FMDatabasePool::inTransaction(const std::function<void (FMDatabase &, bool &)> &block)
+{
+    inTransaction(false, block);
+}
+
+void FMDatabasePool::inDeferredTransaction(const std::function<void (FMDatabase &, bool &)> &block)
+{
+    inTransaction(true, block);
+}
+
+bool FMDatabasePool::inSavePoint(const std::function<void (FMDatabase &, bool &)> &block)
+{
+    lock_guard<mutex> locker(_packet->_writerMutex);
+    return _writer->inSavePoint([&](bool *rollback) {
+        block(*_writer, *rollback);
+    });
+}
+
+FMDB_END
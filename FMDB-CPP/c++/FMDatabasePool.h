@@ -0,0 +1,110 @@
+//
+//  FMDatabasePool.h
+//  fmdb
+//
+
+#ifndef FMDatabasePool_hpp
+#define FMDatabasePool_hpp
+
+#include "FMDatabase.h"
+
+FMDB_BEGIN
+
+/** Pool of `<FMDatabase>` objects: one writer plus several read-only connections.
+
+ The writer connection switches the database into WAL mode, so readers never block the writer and the writer never blocks readers. Reads scale across threads by checking out their own read-only connection; writes stay serialized on the single writer connection.
+
+ Usage:
+
+    FMDatabasePool pool(path, 4);
+
+    pool.inReadDatabase([](FMDatabase &db) {
+        auto rs = db.executeQuery("select * from foo").lock();
+        while (rs->next()) {
+            //…
+        }
+    });
+
+    pool.inTransaction([](FMDatabase &db, bool &rollback) {
+        db.executeUpdate("insert into foo values (?)", 1);
+    });
+
+ Unlike `<FMDatabaseQueue>`, the blocks are run synchronously on the calling thread.
+
+ @warning Don't call any method of the pool inside one of its blocks while a connection is checked out on the same thread; a writer block that calls `inDatabase` again will deadlock.
+ */
+class FMDatabasePool
+{
+public:
+    /**
+     Create a pool for the database at `path`.
+
+     @param path The database path. Must be a file: WAL mode is not available for in-memory or temporary databases.
+     @param maximumNumberOfReaders The maximum number of read-only connections opened at once. `checkoutReader` blocks when all of them are in use.
+     @param openFlags Flags of the writer connection. Defaults to `SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE`.
+     @param vfsName The VFS used by every connection of the pool.
+     */
+    FMDatabasePool(const string &path, int maximumNumberOfReaders = 4, int openFlags = 0, const string &vfsName = FMDatabase::stringNull);
+    ~FMDatabasePool();
+
+    const string &databasePath() const { return _path; }
+    int openFlags() const { return _openFlags; }
+
+    int maximumNumberOfReaders() const { return _maximumNumberOfReaders; }
+    void setMaximumNumberOfReaders(int count);
+
+    /** Readers that stay checked in longer than this interval are closed. Zero (the default) keeps them open. */
+    TimeInterval maximumIdleTimeInterval() const { return _maximumIdleTimeInterval; }
+    void setMaximumIdleTimeInterval(TimeInterval interval) { _maximumIdleTimeInterval = interval; }
+
+    /** Whether the pooled connections cache their prepared statements. Defaults to `true`. */
+    bool shouldCacheStatements() const { return _shouldCacheStatements; }
+    void setShouldCacheStatements(bool value);
+
+    size_t countOfCheckedInDatabases() const;
+    size_t countOfCheckedOutDatabases() const;
+    size_t countOfOpenDatabases() const;
+
+    /** Close every checked-in reader. Checked-out readers are closed when they are checked in. */
+    void releaseAllDatabases();
+
+    /** Close the checked-in readers which have been idle longer than `maximumIdleTimeInterval`. */
+    void releaseIdleDatabases();
+
+    /**
+     Take a read-only connection out of the pool, opening a new one if needed.
+
+     @return A reader, or `nullptr` if the connection could not be opened. Blocks while `maximumNumberOfReaders` readers are checked out.
+     @note Each checked out reader must be returned with `checkin`.
+     */
+    FMDatabase *checkoutReader();
+    void checkin(FMDatabase *db);
+
+    /** Run `block` on a read-only connection. */
+    void inReadDatabase(const std::function<void(FMDatabase &db)> &block);
+
+    /** Run `block` on the writer connection. */
+    void inDatabase(const std::function<void(FMDatabase &db)> &block);
+    void inTransaction(const std::function<void(FMDatabase &db, bool &rollback)> &block);
+    void inDeferredTransaction(const std::function<void(FMDatabase &db, bool &rollback)> &block);
+    bool inSavePoint(const std::function<void(FMDatabase &db, bool &rollback)> &block);
+protected:
+    void inTransaction(bool useDeferred, const std::function<void(FMDatabase &db, bool &rollback)> &block);
+private:
+    FMDatabase *openReader();
+    void releaseIdleDatabasesLocked(bool all);
+
+    int _openFlags;
+    int _maximumNumberOfReaders;
+    bool _shouldCacheStatements;
+    string _path;
+    string _vfsName;
+    TimeInterval _maximumIdleTimeInterval;
+    FMDatabase *_writer;
+    friend struct __databasePoolPacket;
+    struct __databasePoolPacket *_packet;
+};
+
+FMDB_END
+
+#endif /* FMDatabasePool_hpp */
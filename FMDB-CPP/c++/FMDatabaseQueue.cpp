@@ -8,35 +8,294 @@
 
 #include "FMDatabaseQueue.h"
 #include "Variant.hpp"
+#include "FMHistogram.hpp"
+#include "FMThreadPool.hpp"
+#include "FMResultSet.h"
 #include <sqlite3.h>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <list>
+#include <map>
 
 using namespace std;
 
 FMDB_BEGIN
 
+const string FMDatabaseQueueErrorDomain = "FMDatabaseQueue";
+
+struct __queueTask {
+    function<void(FMDatabase &)> block;
+    function<void(FMDatabase &, bool &)> transaction;
+    function<bool(FMDatabase &)> chunk;
+    FMDatabaseTransactionMode mode = FMDatabaseTransactionMode::Exclusive;
+    FMDatabaseQueueTaskOptions options;
+    steady_clock::time_point enqueueTime;
+    steady_clock::time_point startTime;
+    struct __tagHistograms *tagHistograms = nullptr;
+
+    // A statement stopped by its deadline may roll back the whole transaction, and a retry would run the whole group again, so such blocks run alone.
+    bool isGroupable() const { return transaction && mode == FMDatabaseTransactionMode::Exclusive && !hasDeadline() && options.retryPolicy.maximumAttempts <= 1; }
+    bool hasDeadline() const { return options.deadline != steady_clock::time_point::max(); }
+    void complete(bool success, const Error &error)
+    {
+        if (options.completion) {
+            options.completion(success, error);
+        }
+    }
+};
+
+struct __queueLane {
+    list<__queueTask> tasks;
+    unsigned weight = 1;
+    unsigned long long pass = 0; // stride scheduling: the lane with the smallest pass runs next.
+    FMDatabaseQueueLaneStatistics statistics;
+};
+
+static const unsigned long long FMDBQueueStride = 1 << 20;
+
+struct __tagHistograms {
+    FMHistogram waitTime;
+    FMHistogram runTime;
+};
+
+// Lanes and statistics are guarded by _mutex.
 struct __threadQueuePacket {
-    volatile bool _stop = false;
+    bool _stop = false;
     thread *_thread = nullptr;
     mutex *_mutex = nullptr;
-    list<function<void(void)>> *_tasks = nullptr;
+    condition_variable *_condition = nullptr;
+    condition_variable *_spaceAvailable = nullptr;
+    __queueLane _lanes[FMDatabaseQueuePriorityCount];
+    size_t _depth = 0;
+    size_t _peakDepth = 0;
+    size_t _maximumDepth = 0;
+    FMHistogram _waitTime;
+    FMHistogram _runTime;
+    unordered_map<string, unique_ptr<__tagHistograms>> _tags; // entries are never erased.
+    unsigned long long _virtualTime = 0;
+    int _runningLane = FMDatabaseQueuePriorityCount;
+    vector<pair<unsigned long long, std::function<bool(FMDatabase &)>>> _idleHandlers;
+    unsigned long long _writeBackHandler = 0;
+    unsigned long long _nextIdleHandler = 1;
+    bool _idlePending = false;
+    /** When `_idlePending` is set by `scheduleIdleHandlers` with a delay. */
+    steady_clock::time_point _idleWakeup = steady_clock::time_point::max();
+    bool _runningIdleHandlers = false;
+    unsigned _pendingWarmUps = 0;
+    FMWarmUpStatistics _warmUpStatistics;
     ~__threadQueuePacket()
     {
         delete _thread;
         delete _mutex;
-        delete _tasks;
+        delete _condition;
+        delete _spaceAvailable;
+    }
+
+    bool full() const
+    {
+        return _maximumDepth > 0 && _depth >= _maximumDepth;
+    }
+
+    bool empty() const
+    {
+        for (auto &lane : _lanes) {
+            if (!lane.tasks.empty()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void push(__queueTask &&task)
+    {
+        auto &lane = _lanes[(int)task.options.priority];
+        if (lane.tasks.empty()) {
+            // An idle lane doesn't bank turns for later.
+            lane.pass = std::max(lane.pass, _virtualTime);
+        }
+        task.enqueueTime = steady_clock::now();
+        lane.tasks.push_back(std::move(task));
+        _peakDepth = std::max(_peakDepth, ++_depth);
+    }
+
+    /** The task that `pop` would return, or nullptr. */
+    __queueTask *front()
+    {
+        __queueLane *next = nullptr;
+        for (auto &lane : _lanes) {
+            if (!lane.tasks.empty() && (!next || lane.pass < next->pass)) {
+                next = &lane;
+            }
+        }
+        return next ? &next->tasks.front() : nullptr;
+    }
+
+    __queueTask pop()
+    {
+        __queueTask *task = front();
+        auto &lane = _lanes[(int)task->options.priority];
+        _virtualTime = lane.pass;
+        lane.pass += FMDBQueueStride / std::max(lane.weight, 1u);
+
+        task->startTime = steady_clock::now();
+        auto elapsed = task->startTime - task->enqueueTime;
+        _waitTime.recordDuration(elapsed);
+        if (!task->options.tag.empty()) {
+            auto &histograms = _tags[task->options.tag];
+            if (!histograms) {
+                histograms.reset(new __tagHistograms);
+            }
+            task->tagHistograms = histograms.get();
+            task->tagHistograms->waitTime.recordDuration(elapsed);
+        }
+
+        auto wait = duration_cast<TimeInterval>(elapsed);
+        auto &statistics = lane.statistics;
+        ++statistics.executedTasks;
+        statistics.totalWaitTime += wait;
+        statistics.maximumWaitTime = std::max(statistics.maximumWaitTime, wait);
+        _runningLane = (int)task->options.priority;
+
+        __queueTask result = std::move(*task);
+        lane.tasks.pop_front();
+        --_depth;
+        _spaceAvailable->notify_one();
+        return result;
+    }
+
+    /** Record how long the task ran, then call its completion. Runs on the queue thread without the lock. */
+    void finish(__queueTask &task, bool success, const Error &error)
+    {
+        recordRunTime(task);
+        task.complete(success, error);
+    }
+
+    void recordRunTime(__queueTask &task)
+    {
+        auto elapsed = steady_clock::now() - task.startTime;
+        _runTime.recordDuration(elapsed);
+        if (task.tagHistograms) {
+            task.tagHistograms->runTime.recordDuration(elapsed);
+        }
     }
 };
 
-FMDatabaseQueue::FMDatabaseQueue(const string &path, int openFlags/* = 0*/, const string &vfsName/* = FMDatabase::stringNull*/)
+static Error FMDBQueueClosedError()
+{
+    VariantMap userInfo({{LocalizedDescriptionKey, "The database queue has been closed."}});
+    return Error(FMDatabaseQueueErrorDomain, FMDatabaseQueueErrorClosed, userInfo);
+}
+
+static Error FMDBQueueDeadlineError()
+{
+    VariantMap userInfo({{LocalizedDescriptionKey, "The deadline of the task passed."}});
+    return Error(FMDatabaseQueueErrorDomain, FMDatabaseQueueErrorDeadlineExceeded, userInfo);
+}
+
+static Error FMDBQueueFullError()
+{
+    VariantMap userInfo({{LocalizedDescriptionKey, "The database queue is full."}});
+    return Error(FMDatabaseQueueErrorDomain, FMDatabaseQueueErrorFull, userInfo);
+}
+
+struct __rowPipeline {
+    mutex _mutex;
+    condition_variable _batchConsumed;
+    function<Variant(const VariantVector &)> _transform;
+    function<void(VariantVector &)> _consumer;
+    FMDatabaseQueueCompletionBlock _completion;
+    FMThreadPool *_pool;
+    bool _ordered;
+    size_t _maximumPendingBatches;
+    size_t _submittedBatches = 0;
+    size_t _pendingBatches = 0;
+    size_t _nextBatch = 0;
+    map<size_t, VariantVector> _transformed;
+    bool _delivering = false;
+    bool _queryDone = false;
+    bool _completed = false;
+    bool _success = true;
+    Error _error;
+
+    // Queue thread: wait for room, then hand the batch to the pool.
+    void submit(FMThreadPool &pool, shared_ptr<__rowPipeline> self, vector<VariantVector> &&rows)
+    {
+        unique_lock<mutex> locker(_mutex);
+        _batchConsumed.wait(locker, [this]() { return _pendingBatches < _maximumPendingBatches; });
+        size_t index = _submittedBatches++;
+        ++_pendingBatches;
+        locker.unlock();
+
+        auto batch = make_shared<vector<VariantVector>>(std::move(rows));
+        pool.async([self, index, batch]() {
+            VariantVector values;
+            values.reserve(batch->size());
+            for (auto &row : *batch) {
+                values.emplace_back(self->_transform(row));
+            }
+            batch->clear();
+            self->deliver(index, std::move(values));
+        });
+    }
+
+    // Pool thread: one thread at a time drains the batches that can be delivered, so the consumer is never run concurrently.
+    void deliver(size_t index, VariantVector &&values)
+    {
+        unique_lock<mutex> locker(_mutex);
+        _transformed.emplace(index, std::move(values));
+        if (_delivering) {
+            return;
+        }
+        _delivering = true;
+        while (true) {
+            auto iter = _ordered ? _transformed.find(_nextBatch) : _transformed.begin();
+            if (iter == _transformed.end()) {
+                break;
+            }
+            VariantVector batch = std::move(iter->second);
+            _transformed.erase(iter);
+            ++_nextBatch;
+            locker.unlock();
+            _consumer(batch);
+            locker.lock();
+            --_pendingBatches;
+            _batchConsumed.notify_all();
+        }
+        _delivering = false;
+        completeIfDone(locker);
+    }
+
+    void completeIfDone(unique_lock<mutex> &locker)
+    {
+        if (!_queryDone || _pendingBatches > 0 || _delivering || _completed) {
+            return;
+        }
+        _completed = true;
+        if (!_completion) {
+            return;
+        }
+        // Through the pool even when the query finishes last, so that the completion never runs on the queue thread and can call the queue.
+        auto completion = _completion;
+        bool success = _success;
+        auto error = make_shared<Error>(std::move(_error));
+        locker.unlock();
+        _pool->async([completion, success, error]() {
+            completion(success, *error);
+        });
+    }
+};
+
+FMDatabaseQueue::FMDatabaseQueue(const string &path, int openFlags/* = 0*/, const string &vfsName/* = FMDatabase::stringNull*/, const FMDatabaseOpenOptions &openOptions/* = FMDatabaseOpenOptions()*/)
 :_path(path)
 ,_openFlags(openFlags)
 ,_vfsName(vfsName)
 ,_db(new FMDatabase(path))
 ,_packet(new struct __threadQueuePacket)
+,_groupCommitWindow(0)
+,_maximumGroupCommitSize(64)
 {
+    _db->setOpenOptions(openOptions);
 #if SQLITE_VERSION_NUMBER >= 3005000
     if (openFlags == 0) {
         openFlags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
@@ -50,7 +309,10 @@ FMDatabaseQueue::FMDatabaseQueue(const string &path, int openFlags/* = 0*/, cons
         return;
     }
     _packet->_mutex = new mutex;
-    _packet->_tasks = new list<function<void(void)>>;
+    _packet->_condition = new condition_variable;
+    _packet->_spaceAvailable = new condition_variable;
+    _packet->_lanes[(int)FMDatabaseQueuePriority::Interactive].weight = 4;
+    _packet->_lanes[(int)FMDatabaseQueuePriority::Background].weight = 1;
     _packet->_thread = new thread(std::bind(&FMDatabaseQueue::exec, this));
 }
 
@@ -66,7 +328,15 @@ FMDatabaseQueue::~FMDatabaseQueue()
 
 void FMDatabaseQueue::close()
 {
-    _packet->_stop = true;
+    if (!_packet->_thread) {
+        return;
+    }
+    {
+        lock_guard<mutex> locker(*_packet->_mutex);
+        _packet->_stop = true;
+    }
+    _packet->_condition->notify_all();
+    _packet->_spaceAvailable->notify_all();
     if (_packet->_thread->joinable()) { // wait for finishing current task.
         _packet->_thread->join();
     }
@@ -75,94 +345,738 @@ void FMDatabaseQueue::close()
 
 void FMDatabaseQueue::checkWhenInvoke() const
 {
-    _assert(this_thread::get_id() != _packet->_thread->get_id(), "Don't call any methods in database queue!");
+    _assert(!_packet->_thread || this_thread::get_id() != _packet->_thread->get_id(), "Don't call any methods in database queue!");
 }
 
-void FMDatabaseQueue::put(const function<void ()> &block)
+void FMDatabaseQueue::setGroupCommitWindow(TimeInterval window, size_t maximumGroupSize/* = 64*/)
 {
-    if (!block) {
+    parameterAssert(maximumGroupSize > 0);
+    if (!_packet->_mutex) {
         return;
     }
     lock_guard<mutex> locker(*_packet->_mutex);
-    _packet->_tasks->push_back(block);
+    _groupCommitWindow = window;
+    _maximumGroupCommitSize = maximumGroupSize;
 }
 
-void FMDatabaseQueue::exec()
+bool FMDatabaseQueue::runAndWait(const std::function<void (FMDatabase &)> &block, FMDatabaseQueuePriority priority)
 {
-    int taskExecutedCount = 0;
-    while (!_packet->_stop) {
-        if (_packet->_tasks->empty()) {
-            taskExecutedCount = 0;
-            this_thread::sleep_for(std::chrono::milliseconds(10));
-            continue;
+    mutex finishedMutex;
+    condition_variable finishedCondition;
+    bool finished = false;
+    bool ran = false;
+    FMDatabaseQueueTaskOptions options;
+    options.priority = priority;
+    options.completion = [&](bool success, const Error &) {
+        lock_guard<mutex> locker(finishedMutex);
+        finished = true;
+        ran = success;
+        finishedCondition.notify_all();
+    };
+    if (!inDatabase(block, options)) {
+        return false;
+    }
+    unique_lock<mutex> locker(finishedMutex);
+    finishedCondition.wait(locker, [&]() { return finished; });
+    return ran;
+}
+
+bool FMDatabaseQueue::backupToPath(const string &path, const FMDatabaseBackupOptions &options/* = FMDatabaseBackupOptions()*/, Error *error/* = nullptr*/)
+{
+    checkWhenInvoke();
+    FMDatabase destination(path);
+    if (!destination.open()) {
+        if (error) {
+            *error = destination.lastError();
+        }
+        return false;
+    }
+
+    unique_ptr<FMDatabaseBackup> backup;
+    bool more = true;
+    while (more) {
+        bool ran = runAndWait([&](FMDatabase &db) {
+            if (!backup) {
+                backup.reset(new FMDatabaseBackup(destination, db, options));
+            }
+            more = backup->step();
+        }, FMDatabaseQueuePriority::Background);
+        if (!ran) {
+            if (!backup) {
+                if (error) {
+                    *error = FMDBQueueClosedError();
+                }
+                return false;
+            }
+            break;
+        }
+        if (options.progress && !options.progress(backup->progress())) {
+            break;
+        }
+        if (more) {
+            this_thread::sleep_for(backup->throttleDelay());
         }
-        auto &task = _packet->_tasks->front();
-        task();
-        _packet->_tasks->pop_front();
-        if (++taskExecutedCount % 5 == 0) { // take a rest.
-            this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    // The backup locks the source connection while finishing: do it on the queue, unless the queue has stopped.
+    bool success = false;
+    if (!runAndWait([&](FMDatabase &) { success = backup->finish(error); }, FMDatabaseQueuePriority::Background)) {
+        success = backup->finish(error);
+    }
+    return success;
+}
+
+bool FMDatabaseQueue::warmUp(const FMWarmUpOptions &options, const std::function<void (bool, const FMWarmUpStatistics &)> &completion/* = nullptr*/)
+{
+    if (!_packet->_mutex) {
+        if (completion) {
+            completion(false, FMWarmUpStatistics());
+        }
+        return false;
+    }
+    {
+        lock_guard<mutex> locker(*_packet->_mutex);
+        ++_packet->_pendingWarmUps;
+    }
+    auto statistics = make_shared<FMWarmUpStatistics>();
+    auto warmed = make_shared<bool>(false);
+    FMDatabaseQueueTaskOptions taskOptions;
+    taskOptions.priority = FMDatabaseQueuePriority::Interactive;
+    taskOptions.tag = "warm-up";
+    taskOptions.completion = [this, statistics, warmed, completion](bool success, const Error &) {
+        if (completion) {
+            completion(success && *warmed, *statistics);
+        }
+        {
+            lock_guard<mutex> locker(*_packet->_mutex);
+            --_packet->_pendingWarmUps;
+            _packet->_warmUpStatistics = *statistics;
+        }
+        _packet->_condition->notify_all();
+    };
+    return inDatabase([options, statistics, warmed](FMDatabase &db) {
+        *warmed = db.warmUp(options, statistics.get());
+    }, taskOptions);
+}
+
+bool FMDatabaseQueue::isReady() const
+{
+    if (!_packet->_mutex) {
+        return false;
+    }
+    lock_guard<mutex> locker(*_packet->_mutex);
+    return _packet->_pendingWarmUps == 0;
+}
+
+bool FMDatabaseQueue::waitUntilReady(TimeInterval timeout/* = TimeInterval::max()*/) const
+{
+    checkWhenInvoke();
+    if (!_packet->_mutex) {
+        return false;
+    }
+    unique_lock<mutex> locker(*_packet->_mutex);
+    auto ready = [this]() { return _packet->_pendingWarmUps == 0; };
+    if (timeout == TimeInterval::max()) {
+        _packet->_condition->wait(locker, ready);
+        return true;
+    }
+    return _packet->_condition->wait_for(locker, timeout, ready);
+}
+
+FMWarmUpStatistics FMDatabaseQueue::warmUpStatistics() const
+{
+    if (!_packet->_mutex) {
+        return FMWarmUpStatistics();
+    }
+    lock_guard<mutex> locker(*_packet->_mutex);
+    return _packet->_warmUpStatistics;
+}
+
+bool FMDatabaseQueue::loadIntoMemory(TimeInterval writeBackInterval, Error *error/* = nullptr*/)
+{
+    checkWhenInvoke();
+    bool success = false;
+    bool ran = runAndWait([&](FMDatabase &db) {
+        db.setWriteBackInterval(writeBackInterval);
+        success = db.loadIntoMemory(error);
+    }, FMDatabaseQueuePriority::Interactive);
+    if (!ran) {
+        if (error) {
+            *error = FMDBQueueClosedError();
         }
+        return false;
+    }
+    if (success && writeBackInterval > TimeInterval(0) && !_packet->_writeBackHandler) {
+        _packet->_writeBackHandler = addIdleHandler([this](FMDatabase &db) {
+            TimeInterval delay = db.writeBackDelay();
+            if (delay == TimeInterval(0)) {
+                Error error;
+                if (!db.writeBackIfNeeded(&error)) {
+                    fprintf(stderr, "Could not write %s back: %s\n", db.databasePath().c_str(), error.description().c_str());
+                    scheduleIdleHandlers(db.writeBackInterval()); // try again later.
+                }
+            } else if (delay != TimeInterval::max()) {
+                scheduleIdleHandlers(delay);
+            }
+            return false;
+        });
     }
+    return success;
 }
 
-void FMDatabaseQueue::inDatabase(const std::function<void (FMDatabase &)> &block)
+bool FMDatabaseQueue::writeBack(Error *error/* = nullptr*/)
 {
     checkWhenInvoke();
-    this->put([=](){
-        block(*_db);
-    });
+    bool success = false;
+    if (!runAndWait([&](FMDatabase &db) { success = db.writeBack(error); }, FMDatabaseQueuePriority::Interactive)) {
+        if (error) {
+            *error = FMDBQueueClosedError();
+        }
+        return false;
+    }
+    return success;
 }
 
-void FMDatabaseQueue::inTransaction(bool useDeferred, const std::function<void (FMDatabase &, bool &)> &block)
+FMInMemoryStatistics FMDatabaseQueue::inMemoryStatistics()
 {
     checkWhenInvoke();
-    this->put([=, &block](){
-        if (useDeferred) {
-            _db->beginDeferredTransaction();
+    FMInMemoryStatistics statistics;
+    runAndWait([&](FMDatabase &db) { statistics = db.inMemoryStatistics(); }, FMDatabaseQueuePriority::Interactive);
+    return statistics;
+}
+
+unsigned long long FMDatabaseQueue::addIdleHandler(const std::function<bool (FMDatabase &)> &handler)
+{
+    parameterAssert(handler);
+    if (!_packet->_mutex) {
+        return 0;
+    }
+    unsigned long long identifier;
+    {
+        lock_guard<mutex> locker(*_packet->_mutex);
+        identifier = _packet->_nextIdleHandler++;
+        _packet->_idleHandlers.emplace_back(identifier, handler);
+        _packet->_idlePending = true;
+    }
+    _packet->_condition->notify_all();
+    return identifier;
+}
+
+void FMDatabaseQueue::removeIdleHandler(unsigned long long identifier)
+{
+    if (!_packet->_mutex) {
+        return;
+    }
+    unique_lock<mutex> locker(*_packet->_mutex);
+    auto &handlers = _packet->_idleHandlers;
+    for (auto iter = handlers.begin(); iter != handlers.end(); ++iter) {
+        if (iter->first == identifier) {
+            handlers.erase(iter);
+            break;
+        }
+    }
+    bool onQueue = _packet->_thread && this_thread::get_id() == _packet->_thread->get_id();
+    if (!onQueue) {
+        _packet->_condition->wait(locker, [this]() { return !_packet->_runningIdleHandlers; });
+    }
+}
+
+void FMDatabaseQueue::scheduleIdleHandlers(TimeInterval delay/* = TimeInterval(0)*/)
+{
+    if (!_packet->_mutex) {
+        return;
+    }
+    {
+        lock_guard<mutex> locker(*_packet->_mutex);
+        if (delay <= TimeInterval(0)) {
+            _packet->_idlePending = true;
         } else {
-            _db->beginTransaction();
+            auto wakeup = steady_clock::now() + duration_cast<steady_clock::duration>(delay);
+            _packet->_idleWakeup = std::min(_packet->_idleWakeup, wakeup);
         }
+    }
+    _packet->_condition->notify_all();
+}
 
-        bool shouldRollback = false;
-        block(*_db, shouldRollback);
+void FMDatabaseQueue::runIdleHandlers(unique_lock<mutex> &locker)
+{
+    // Run copies, so that handlers can be added and removed during the turn.
+    auto handlers = _packet->_idleHandlers;
+    _packet->_idlePending = false;
+    _packet->_runningIdleHandlers = true;
+    locker.unlock();
+    bool more = false;
+    for (auto &handler : handlers) {
+        more = handler.second(*_db) || more;
+    }
+    locker.lock();
+    _packet->_runningIdleHandlers = false;
+    _packet->_idlePending = _packet->_idlePending || more;
+    _packet->_condition->notify_all(); // wakes `removeIdleHandler`.
+}
 
-        if (shouldRollback) {
-            _db->rollback();
+bool FMDatabaseQueue::put(__queueTask &&task, TimeInterval timeout)
+{
+    if (!_packet->_mutex) {
+        task.complete(false, FMDBQueueClosedError());
+        return false;
+    }
+    auto &statistics = _packet->_lanes[(int)task.options.priority].statistics;
+    {
+        unique_lock<mutex> locker(*_packet->_mutex);
+        auto spaceAvailable = [this]() {
+            return _packet->_stop || !_packet->full();
+        };
+        if (!spaceAvailable()) {
+            if (timeout <= TimeInterval(0)) {
+                ++statistics.rejectedTasks;
+            } else if (timeout == TimeInterval::max()) {
+                ++statistics.blockedTasks;
+                _packet->_spaceAvailable->wait(locker, spaceAvailable);
+            } else {
+                ++statistics.blockedTasks;
+                if (!_packet->_spaceAvailable->wait_for(locker, timeout, spaceAvailable)) {
+                    ++statistics.timedOutTasks;
+                }
+            }
+        }
+        if (!_packet->_stop && !_packet->full()) {
+            _packet->push(std::move(task));
+            _packet->_condition->notify_one();
+            return true;
+        }
+    }
+    task.complete(false, _packet->_stop ? FMDBQueueClosedError() : FMDBQueueFullError());
+    return false;
+}
+
+void FMDatabaseQueue::requeue(__queueTask &&task)
+{
+    {
+        lock_guard<mutex> locker(*_packet->_mutex);
+        if (!_packet->_stop) {
+            _packet->push(std::move(task));
+            _packet->_condition->notify_one();
+            return;
+        }
+    }
+    task.complete(false, FMDBQueueClosedError());
+}
+
+FMDatabaseQueueStatistics FMDatabaseQueue::statistics() const
+{
+    FMDatabaseQueueStatistics statistics;
+    statistics.waitTime = _packet->_waitTime.snapshot();
+    statistics.runTime = _packet->_runTime.snapshot();
+    if (!_packet->_mutex) {
+        return statistics;
+    }
+
+    lock_guard<mutex> locker(*_packet->_mutex);
+    statistics.depth = _packet->_depth;
+    statistics.peakDepth = _packet->_peakDepth;
+    for (auto &pair : _packet->_tags) {
+        auto &tag = statistics.tags[pair.first];
+        tag.waitTime = pair.second->waitTime.snapshot();
+        tag.runTime = pair.second->runTime.snapshot();
+    }
+    return statistics;
+}
+
+void FMDatabaseQueue::resetStatistics()
+{
+    _packet->_waitTime.reset();
+    _packet->_runTime.reset();
+    if (!_packet->_mutex) {
+        return;
+    }
+
+    lock_guard<mutex> locker(*_packet->_mutex);
+    _packet->_peakDepth = _packet->_depth;
+    for (auto &pair : _packet->_tags) {
+        pair.second->waitTime.reset();
+        pair.second->runTime.reset();
+    }
+    for (auto &lane : _packet->_lanes) {
+        lane.statistics = FMDatabaseQueueLaneStatistics();
+    }
+}
+
+bool FMDatabaseQueue::submit(__queueTask &&task)
+{
+    checkWhenInvoke();
+    TimeInterval timeout = task.options.enqueueTimeout;
+    return put(std::move(task), timeout);
+}
+
+void FMDatabaseQueue::setMaximumQueueDepth(size_t depth)
+{
+    if (!_packet->_mutex) {
+        return;
+    }
+    lock_guard<mutex> locker(*_packet->_mutex);
+    _packet->_maximumDepth = depth;
+    _packet->_spaceAvailable->notify_all();
+}
+
+size_t FMDatabaseQueue::maximumQueueDepth() const
+{
+    if (!_packet->_mutex) {
+        return _packet->_maximumDepth;
+    }
+    lock_guard<mutex> locker(*_packet->_mutex);
+    return _packet->_maximumDepth;
+}
+
+size_t FMDatabaseQueue::queueDepth() const
+{
+    if (!_packet->_mutex) {
+        return 0;
+    }
+    lock_guard<mutex> locker(*_packet->_mutex);
+    return _packet->_depth;
+}
+
+void FMDatabaseQueue::exec()
+{
+    unique_lock<mutex> locker(*_packet->_mutex);
+    while (true) {
+        _packet->_runningLane = FMDatabaseQueuePriorityCount;
+        auto ready = [this]() {
+            return _packet->_stop || !_packet->empty() || (_packet->_idlePending && !_packet->_idleHandlers.empty());
+        };
+        while (!ready()) {
+            if (_packet->_idleWakeup == steady_clock::time_point::max()) {
+                _packet->_condition->wait(locker);
+            } else if (_packet->_condition->wait_until(locker, _packet->_idleWakeup) == cv_status::timeout) {
+                _packet->_idleWakeup = steady_clock::time_point::max();
+                _packet->_idlePending = true;
+            }
+        }
+        if (_packet->_stop) {
+            break;
+        }
+        if (_packet->empty()) {
+            runIdleHandlers(locker);
+            continue;
+        }
+        __queueTask task = _packet->pop();
+        bool expired = task.options.deadline <= task.startTime;
+        if (expired) {
+            ++_packet->_lanes[(int)task.options.priority].statistics.expiredTasks;
+        }
+        bool groupCommit = task.isGroupable() && _groupCommitWindow > TimeInterval(0);
+        locker.unlock();
+
+        if (expired) {
+            task.complete(false, FMDBQueueDeadlineError());
+        } else if (groupCommit) {
+            runTransactionGroup(task);
         } else {
-            _db->commit();
+            runTask(task);
         }
-    });
+        locker.lock();
+        _packet->_idlePending = true;
+    }
+
+    list<__queueTask> dropped;
+    for (auto &lane : _packet->_lanes) {
+        dropped.splice(dropped.end(), lane.tasks);
+    }
+    locker.unlock();
+    for (auto &task : dropped) {
+        task.complete(false, FMDBQueueClosedError());
+    }
 }
 
-void FMDatabaseQueue::inTransaction(const std::function<void (FMDatabase &, bool &)> &block)
+void FMDatabaseQueue::runTask(__queueTask &task)
 {
-    inTransaction(false, block);
+    if (task.chunk) {
+        _db->setDeadline(task.options.deadline);
+        bool more = task.chunk(*_db);
+        bool timedOut = endDeadline(task);
+        if (timedOut) {
+            _packet->finish(task, false, FMDBQueueDeadlineError());
+        } else if (more) {
+            _packet->recordRunTime(task);
+            this->requeue(std::move(task)); // back to the end of its lane, ignoring the depth limit.
+        } else {
+            _packet->finish(task, true, Error());
+        }
+        return;
+    }
+    if (!task.transaction) {
+        _db->setDeadline(task.options.deadline);
+        task.block(*_db);
+        bool timedOut = endDeadline(task);
+        _packet->finish(task, !timedOut, timedOut ? FMDBQueueDeadlineError() : Error());
+        return;
+    }
+
+    // The connection runs the attempts: a block that lost a lock is rolled back, and retried while its policy and deadline allow.
+    auto retryCount = _db->transactionRetryCount();
+    Error error;
+    _db->setDeadline(task.options.deadline);
+    bool committed = _db->inTransactionWithMode(task.mode, [&](bool *rollback) {
+        task.transaction(*_db, *rollback);
+    }, task.options.retryPolicy, &error);
+    bool timedOut = endDeadline(task);
+    auto retries = _db->transactionRetryCount() - retryCount;
+    if (retries) {
+        lock_guard<mutex> locker(*_packet->_mutex);
+        _packet->_lanes[(int)task.options.priority].statistics.retries += retries;
+    }
+    if (timedOut) {
+        _packet->finish(task, false, FMDBQueueDeadlineError());
+    } else {
+        _packet->finish(task, committed, std::move(error));
+    }
 }
 
-void FMDatabaseQueue::inDeferredTransaction(const std::function<void (FMDatabase &, bool &)> &block)
+bool FMDatabaseQueue::endDeadline(__queueTask &task)
 {
-    inTransaction(true, block);
+    if (!task.hasDeadline()) {
+        return false;
+    }
+    bool timedOut = _db->deadlineExceeded();
+    // Clear it before commit or rollback: those must not be interrupted.
+    _db->setDeadline(steady_clock::time_point::max());
+    if (timedOut) {
+        lock_guard<mutex> locker(*_packet->_mutex);
+        ++_packet->_lanes[(int)task.options.priority].statistics.interruptedTasks;
+    }
+    return timedOut;
+}
+
+void FMDatabaseQueue::runTransactionGroup(__queueTask &first)
+{
+    if (!_db->beginTransaction()) {
+        runTask(first);
+        return;
+    }
+
+    vector<__queueTask> group;
+    vector<bool> rolledBack;
+    vector<Error> errors;
+    auto runInSavePoint = [&](__queueTask &task) {
+        string name("groupCommit");
+        name.append(Variant((unsigned long long)group.size()).toString());
+
+        bool shouldRollback = false;
+        Error error;
+        // Without its savepoint the block could not be undone alone: it doesn't run.
+        bool started = _db->startSavePointWithName(name);
+        if (!started) {
+            error = _db->lastError();
+        } else {
+            auto busyErrorCount = _db->busyErrorCount();
+            task.transaction(*_db, shouldRollback);
+            // As in `FMDatabase::inTransactionWithMode`, a block that lost a lock is not committed.
+            if (!shouldRollback && _db->busyErrorCount() != busyErrorCount) {
+                error = _db->lastError();
+                shouldRollback = true;
+            }
+            if (shouldRollback) {
+                _db->rollbackToSavePointWithName(name);
+            }
+            _db->releaseSavePointWithName(name);
+        }
+        group.push_back(std::move(task));
+        rolledBack.push_back(shouldRollback || !started);
+        errors.push_back(std::move(error));
+    };
+    runInSavePoint(first);
+
+    {
+        unique_lock<mutex> locker(*_packet->_mutex);
+        auto deadline = steady_clock::now() + duration_cast<steady_clock::duration>(_groupCommitWindow);
+        while (group.size() < _maximumGroupCommitSize && steady_clock::now() < deadline) {
+            _packet->_condition->wait_until(locker, deadline, [this]() {
+                return _packet->_stop || !_packet->empty();
+            });
+            auto next = _packet->front();
+            if (_packet->_stop || !next || !next->isGroupable()) {
+                break;
+            }
+            __queueTask task = _packet->pop();
+            locker.unlock();
+            runInSavePoint(task);
+            locker.lock();
+        }
+    }
+
+    if (_db->commit()) {
+        for (size_t i = 0; i < group.size(); ++i) {
+            _packet->finish(group[i], !rolledBack[i], errors[i]);
+        }
+        return;
+    }
+
+    Error error = _db->lastError();
+    long long code = error.code();
+    Variant userInfo = error.userInfo();
+    _db->rollback();
+    for (auto &task : group) {
+        _packet->finish(task, false, Error("FMDatabase", code, userInfo));
+    }
+}
+
+bool FMDatabaseQueue::shouldYield() const
+{
+    if (!_packet->_mutex) {
+        return false;
+    }
+    lock_guard<mutex> locker(*_packet->_mutex);
+    for (int i = 0; i < _packet->_runningLane; ++i) {
+        if (!_packet->_lanes[i].tasks.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FMDatabaseQueue::setLaneWeight(FMDatabaseQueuePriority priority, unsigned weight)
+{
+    parameterAssert(weight > 0);
+    if (!_packet->_mutex) {
+        return;
+    }
+    lock_guard<mutex> locker(*_packet->_mutex);
+    _packet->_lanes[(int)priority].weight = weight;
+}
+
+unsigned FMDatabaseQueue::laneWeight(FMDatabaseQueuePriority priority) const
+{
+    if (!_packet->_mutex) {
+        return _packet->_lanes[(int)priority].weight;
+    }
+    lock_guard<mutex> locker(*_packet->_mutex);
+    return _packet->_lanes[(int)priority].weight;
+}
+
+FMDatabaseQueueLaneStatistics FMDatabaseQueue::laneStatistics(FMDatabaseQueuePriority priority) const
+{
+    if (!_packet->_mutex) {
+        return FMDatabaseQueueLaneStatistics();
+    }
+    lock_guard<mutex> locker(*_packet->_mutex);
+    auto &lane = _packet->_lanes[(int)priority];
+    FMDatabaseQueueLaneStatistics statistics = lane.statistics;
+    statistics.pendingTasks = lane.tasks.size();
+    return statistics;
+}
+
+bool FMDatabaseQueue::inDatabase(const std::function<void (FMDatabase &)> &block, const FMDatabaseQueueTaskOptions &options/* = FMDatabaseQueueTaskOptions()*/)
+{
+    __queueTask task;
+    task.block = block;
+    task.options = options;
+    return submit(std::move(task));
+}
+
+bool FMDatabaseQueue::inDatabaseChunked(const std::function<bool (FMDatabase &)> &chunk, const FMDatabaseQueueTaskOptions &options/* = FMDatabaseQueueTaskOptions()*/)
+{
+    __queueTask task;
+    task.chunk = chunk;
+    task.options = options;
+    return submit(std::move(task));
+}
+
+bool FMDatabaseQueue::inTransaction(FMDatabaseTransactionMode mode, const std::function<void (FMDatabase &, bool &)> &block, const FMDatabaseQueueTaskOptions &options)
+{
+    __queueTask task;
+    task.transaction = block;
+    task.mode = mode;
+    task.options = options;
+    return submit(std::move(task));
+}
+
+bool FMDatabaseQueue::inTransaction(const std::function<void (FMDatabase &, bool &)> &block, const FMDatabaseQueueTaskOptions &options/* = FMDatabaseQueueTaskOptions()*/)
+{
+    return inTransaction(FMDatabaseTransactionMode::Exclusive, block, options);
+}
+
+bool FMDatabaseQueue::inDeferredTransaction(const std::function<void (FMDatabase &, bool &)> &block, const FMDatabaseQueueTaskOptions &options/* = FMDatabaseQueueTaskOptions()*/)
+{
+    return inTransaction(FMDatabaseTransactionMode::Deferred, block, options);
+}
+
+bool FMDatabaseQueue::inImmediateTransaction(const std::function<void (FMDatabase &, bool &)> &block, const FMDatabaseQueueTaskOptions &options/* = FMDatabaseQueueTaskOptions()*/)
+{
+    return inTransaction(FMDatabaseTransactionMode::Immediate, block, options);
+}
+
+bool FMDatabaseQueue::executePipelinedQuery(const std::function<weak_ptr<FMResultSet> (FMDatabase &)> &query,
+                                            FMThreadPool &pool,
+                                            const std::function<Variant (const VariantVector &)> &transform,
+                                            const std::function<void (VariantVector &)> &consumer,
+                                            const FMDatabaseQueueRowPipelineOptions &options/* = FMDatabaseQueueRowPipelineOptions()*/)
+{
+    parameterAssert(options.batchSize > 0);
+    auto pipeline = make_shared<__rowPipeline>();
+    pipeline->_transform = transform;
+    pipeline->_consumer = consumer;
+    pipeline->_completion = options.taskOptions.completion;
+    pipeline->_pool = &pool;
+    pipeline->_ordered = options.ordered;
+    pipeline->_maximumPendingBatches = options.maximumPendingBatches > 0 ? options.maximumPendingBatches : pool.threadCount() * 2;
+
+    __queueTask task;
+    task.options = options.taskOptions;
+    task.options.completion = [pipeline](bool success, const Error &error) {
+        unique_lock<mutex> locker(pipeline->_mutex);
+        if (!success && pipeline->_success) {
+            pipeline->_error = Error(error.domain(), error.code(), error.userInfo());
+        }
+        pipeline->_success = pipeline->_success && success;
+        pipeline->_queryDone = true;
+        pipeline->completeIfDone(locker);
+    };
+    size_t batchSize = options.batchSize;
+    task.block = [pipeline, query, batchSize, &pool](FMDatabase &db) {
+        auto rs = query(db).lock();
+        if (!rs) {
+            lock_guard<mutex> locker(pipeline->_mutex);
+            pipeline->_success = false;
+            pipeline->_error = db.lastError();
+            return;
+        }
+        vector<VariantVector> rows;
+        rows.reserve(batchSize);
+        while (rs->next()) {
+            rows.emplace_back(rs->resultArray());
+            if (rows.size() == batchSize) {
+                pipeline->submit(pool, pipeline, std::move(rows));
+                rows = vector<VariantVector>();
+                rows.reserve(batchSize);
+            }
+        }
+        rs->close();
+        if (!rows.empty()) {
+            pipeline->submit(pool, pipeline, std::move(rows));
+        }
+    };
+    return submit(std::move(task));
 }
 
 bool FMDatabaseQueue::inSavePoint(const std::function<void (FMDatabase &, bool &)> &block)
 {
 #if SQLITE_VERSION_NUMBER >= 3007000
     static unsigned long long savePointIndex = 0;
-    bool success = false;
-    this->put([&]() {
+    __queueTask task;
+    task.block = [=](FMDatabase &db) {
         string name("savePoint");
         name.append(Variant(++savePointIndex).toString());
-        success = _db->startSavePointWithName(name);
-        if (success) {
+        if (db.startSavePointWithName(name)) {
             bool shouldRollback = false;
-            block(*_db, shouldRollback);
+            block(db, shouldRollback);
             if (shouldRollback) {
-                _db->rollbackToSavePointWithName(name);
+                db.rollbackToSavePointWithName(name);
             }
-            _db->releaseSavePointWithName(name);
+            db.releaseSavePointWithName(name);
         }
-    });
-    return success;
+    };
+    return submit(std::move(task));
 #else
     if (_db->logsErrors()) {
         fprintf(stderr, "Save point functions require SQLite 3.7");
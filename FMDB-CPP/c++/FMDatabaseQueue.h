@@ -10,9 +10,102 @@
 #define FMDatabaseQueue_hpp
 
 #include "FMDatabase.h"
+#include "FMHistogram.hpp"
+#include <mutex>
 
 FMDB_BEGIN
 
+extern const string FMDatabaseQueueErrorDomain;
+
+enum FMDatabaseQueueErrorCode {
+    /** The queue was closed before the task could run. */
+    FMDatabaseQueueErrorClosed = 1,
+    /** The queue was at its maximum depth and the task could not be enqueued in time. */
+    FMDatabaseQueueErrorFull = 2,
+    /** The deadline of the task passed before it started, or while one of its statements was running. */
+    FMDatabaseQueueErrorDeadlineExceeded = 3,
+};
+
+/** Called on the queue thread once a task has finished. For transactions this happens after the commit (or rollback) has been executed, so `success` means the work is durable. */
+using FMDatabaseQueueCompletionBlock = std::function<void(bool success, const Error &error)>;
+
+/** Lanes of the queue. Waiting tasks are dequeued by weighted fair scheduling between lanes, FIFO inside a lane. */
+enum class FMDatabaseQueuePriority : int {
+    /** Latency sensitive work such as reads serving a user. This is the default lane. */
+    Interactive = 0,
+    /** Maintenance and bulk writes. */
+    Background = 1,
+};
+static const int FMDatabaseQueuePriorityCount = 2;
+
+struct __queueTask;
+class FMThreadPool;
+
+struct FMDatabaseQueueTaskOptions {
+    FMDatabaseQueueCompletionBlock completion;
+    FMDatabaseQueuePriority priority = FMDatabaseQueuePriority::Interactive;
+    /** How long to wait for room when the queue is at its maximum depth. `TimeInterval::max()` (the default) blocks until there is room, zero fails at once. */
+    TimeInterval enqueueTimeout = TimeInterval::max();
+    /**
+     The task is dropped if it hasn't started by `deadline`, and its running statements are stopped once `deadline` passes (see `FMDatabase::setDeadline`). A transaction that runs past its deadline is rolled back. Either way the completion receives `FMDatabaseQueueErrorDeadlineExceeded`.
+     */
+    steady_clock::time_point deadline = steady_clock::time_point::max();
+    /** Optional label: the queue keeps separate wait and run time histograms per tag. */
+    string tag;
+    /** How a transaction block that lost a lock is run again, see `FMDatabase::inTransactionWithMode`. Defaults to no retry: the block is rolled back and fails. */
+    FMDatabaseRetryPolicy retryPolicy;
+};
+
+/** Options of `FMDatabaseQueue::executePipelinedQuery`. */
+struct FMDatabaseQueueRowPipelineOptions {
+    /** The number of rows copied into one batch. */
+    size_t batchSize = 256;
+    /** Deliver the batches in the order of the rows, or as soon as each one is transformed. */
+    bool ordered = true;
+    /** Bound of the batches copied but not consumed yet; the queue thread waits when it is reached. Zero means twice the number of pool threads. */
+    size_t maximumPendingBatches = 0;
+    /** Options of the task running the query. Its completion is called on a pool thread after the last batch was consumed. */
+    FMDatabaseQueueTaskOptions taskOptions;
+};
+
+struct FMDatabaseQueueLaneStatistics {
+    unsigned long long executedTasks = 0;
+    size_t pendingTasks = 0;
+    /** Time between enqueueing and starting, summed over the executed tasks. */
+    TimeInterval totalWaitTime = TimeInterval(0);
+    TimeInterval maximumWaitTime = TimeInterval(0);
+    /** Submissions that had to wait for room in the queue. */
+    unsigned long long blockedTasks = 0;
+    /** Submissions refused at once because the queue was full. */
+    unsigned long long rejectedTasks = 0;
+    /** Submissions that waited for room and gave up after `enqueueTimeout`. */
+    unsigned long long timedOutTasks = 0;
+    /** Tasks dropped because their deadline passed before they started. */
+    unsigned long long expiredTasks = 0;
+    /** Tasks whose statements were stopped by their deadline. */
+    unsigned long long interruptedTasks = 0;
+    /** Transaction blocks run again after `SQLITE_BUSY` or `SQLITE_LOCKED`, see `FMDatabaseQueueTaskOptions::retryPolicy`. */
+    unsigned long long retries = 0;
+
+    TimeInterval averageWaitTime() const { return executedTasks ? totalWaitTime / (double)executedTasks : TimeInterval(0); }
+};
+
+struct FMDatabaseQueueTagStatistics {
+    FMHistogramSnapshot waitTime;
+    FMHistogramSnapshot runTime;
+};
+
+/** Telemetry of a queue. Times are in microseconds. */
+struct FMDatabaseQueueStatistics {
+    size_t depth = 0;
+    size_t peakDepth = 0;
+    /** From enqueueing to the start of the task. */
+    FMHistogramSnapshot waitTime;
+    /** From the start of the task to its completion, commit included. */
+    FMHistogramSnapshot runTime;
+    unordered_map<string, FMDatabaseQueueTagStatistics> tags;
+};
+
 /** To perform queries and updates on multiple threads, you'll want to use `FMDatabaseQueue`.
 
  Using a single instance of `<FMDatabase>` from multiple threads at once is a bad idea.  It has always been OK to make a `<FMDatabase>` object *per thread*.  Just don't share a single instance across threads, and definitely not across multiple threads at the same time.
@@ -70,21 +163,174 @@ class FMDatabaseQueue {
     friend struct __threadQueuePacket;
     struct __threadQueuePacket *_packet;
 public:
-    FMDatabaseQueue(const string &path, int openFlags = 0, const string &vfsName = FMDatabase::stringNull);
+    /** @param openOptions The pragmas sent when the connection opens, see `<FMDatabaseOpenOptions>`. */
+    FMDatabaseQueue(const string &path, int openFlags = 0, const string &vfsName = FMDatabase::stringNull, const FMDatabaseOpenOptions &openOptions = FMDatabaseOpenOptions());
     ~FMDatabaseQueue();
     void close();
 
-    /** API */
-    void inDatabase(const std::function<void(FMDatabase &db)> &block);
-    void inTransaction(const std::function<void(FMDatabase &db, bool &rollback)> &block);
-    void inDeferredTransaction(const std::function<void(FMDatabase &db, bool &rollback)> &block);
+    /** API
+
+     Each method returns `false` when the task was not enqueued: the queue is closed, or it is full and `enqueueTimeout` of the options elapsed. The completion of the options is called with the reason in that case too.
+     */
+    bool inDatabase(const std::function<void(FMDatabase &db)> &block, const FMDatabaseQueueTaskOptions &options = FMDatabaseQueueTaskOptions());
+    bool inTransaction(const std::function<void(FMDatabase &db, bool &rollback)> &block, const FMDatabaseQueueTaskOptions &options = FMDatabaseQueueTaskOptions());
+    bool inDeferredTransaction(const std::function<void(FMDatabase &db, bool &rollback)> &block, const FMDatabaseQueueTaskOptions &options = FMDatabaseQueueTaskOptions());
+    /** Like `inTransaction`, but with `begin immediate`: other connections can still read while the block runs, even outside of WAL mode. */
+    bool inImmediateTransaction(const std::function<void(FMDatabase &db, bool &rollback)> &block, const FMDatabaseQueueTaskOptions &options = FMDatabaseQueueTaskOptions());
     bool inSavePoint(const std::function<void(FMDatabase &db, bool &rollback)> &block);
+
+    /**
+     Run a long job in chunks so that other tasks can run in between.
+
+     `chunk` is called once per turn; returning `true` means there is more work, and the job is queued again at the end of its lane. The completion is called after the last chunk.
+
+        queue.inDatabaseChunked([=](FMDatabase &db) {
+            db.executeUpdate("delete from log where rowid in (select rowid from log where old limit 500)");
+            return db.changes() > 0;
+        }, options);
+     */
+    bool inDatabaseChunked(const std::function<bool(FMDatabase &db)> &chunk, const FMDatabaseQueueTaskOptions &options = FMDatabaseQueueTaskOptions());
+
+    /**
+     Step a query on the queue thread and transform its rows on `pool`.
+
+     The queue thread only steps the statement and copies the rows into batches of `Variant` values; `transform` runs on the pool threads, so costly per-row work (building JSON, decompressing blobs) doesn't hold the database. `consumer` receives the transformed values batch by batch, one batch at a time, in row order unless `options.ordered` is `false`.
+
+        queue.executePipelinedQuery([](FMDatabase &db) {
+            return db.executeQuery("select payload from message");
+        }, pool, [](const VariantVector &row) {
+            return Variant(decompress(row[0].toVariantData()));
+        }, [=](VariantVector &values) {
+            //…
+        });
+
+     @param query Run on the queue thread; returns the result set to step.
+     @param transform Run on a pool thread for each row.
+     @param consumer Run on a pool thread for each batch of transformed values.
+     */
+    bool executePipelinedQuery(const std::function<weak_ptr<FMResultSet>(FMDatabase &db)> &query,
+                               FMThreadPool &pool,
+                               const std::function<Variant(const VariantVector &row)> &transform,
+                               const std::function<void(VariantVector &values)> &consumer,
+                               const FMDatabaseQueueRowPipelineOptions &options = FMDatabaseQueueRowPipelineOptions());
+
+    /** Whether a task of a more urgent lane is waiting. Only meaningful inside a block running on the queue; long background blocks can poll it to stop early. */
+    bool shouldYield() const;
+
+    /** Scheduling */
+
+    /**
+     Set the share of turns a lane gets while several lanes have waiting tasks. With the default weights (interactive 4, background 1) the interactive lane runs four tasks for each background task.
+     */
+    void setLaneWeight(FMDatabaseQueuePriority priority, unsigned weight);
+    unsigned laneWeight(FMDatabaseQueuePriority priority) const;
+    FMDatabaseQueueLaneStatistics laneStatistics(FMDatabaseQueuePriority priority) const;
+
+    /** Backpressure */
+
+    /**
+     Bound the number of waiting tasks. Once `depth` tasks are waiting, submitting blocks, fails or waits up to a timeout depending on `FMDatabaseQueueTaskOptions::enqueueTimeout`, so callers can shed load instead of growing the queue without limit. Zero (the default) means unbounded.
+     */
+    void setMaximumQueueDepth(size_t depth);
+    size_t maximumQueueDepth() const;
+    size_t queueDepth() const;
+
+    /** Telemetry */
+
+    /** Take a snapshot of the depth and time histograms. Safe to call while tasks are running. */
+    FMDatabaseQueueStatistics statistics() const;
+    void resetStatistics();
+
+    /** Group commit */
+
+    /**
+     Coalesce `inTransaction` blocks into one physical transaction.
+
+     When enabled, a transaction block that starts an empty queue keeps the transaction open for up to `window` so that transaction blocks queued behind it share the same `commit` (and so the same fsync). Every block runs inside its own savepoint: setting `rollback` or losing a lock only undoes that block's work, and a block whose savepoint can't be started doesn't run and fails. The completion of each block is called after the shared commit.
+
+     A group ends when `maximumGroupSize` blocks have run, the window elapses, or a task that isn't an exclusive transaction without deadline reaches the head of the queue. Blocks with a `retryPolicy` allowing several attempts run alone, so that their retries follow the policy.
+
+     @param window How long to wait for more transaction blocks. Zero disables group commit (the default).
+     @param maximumGroupSize The maximum number of blocks sharing one commit.
+     */
+    void setGroupCommitWindow(TimeInterval window, size_t maximumGroupSize = 64);
+    TimeInterval groupCommitWindow() const { return _groupCommitWindow; }
+    size_t maximumGroupCommitSize() const { return _maximumGroupCommitSize; }
+
+    /** Online backup */
+
+    /**
+     Copy the database into the file at `path` while the queue goes on serving tasks.
+
+     Every step of the copy, `options.pagesPerStep` pages, is a task of the `Background` lane: the tasks of the `Interactive` lane run first, and the tasks already queued in the `Background` lane run between steps. The calling thread waits for each step, calls `options.progress`, and sleeps between steps to respect `options.maximumPagesPerSecond`, so throttling never holds the queue. Writes made through the queue are copied along; a write of another connection starts the copy over.
+
+     @return `true` if every page was copied.
+     */
+    bool backupToPath(const string &path, const FMDatabaseBackupOptions &options = FMDatabaseBackupOptions(), Error *error = nullptr);
+
+    /** Warm-up */
+
+    /**
+     Warm the connection up on the queue thread, see `FMDatabase::warmUp`, and return at once.
+
+     The warm-up is a task of the `Interactive` lane: submitted right after constructing the queue, it runs first, and the tasks submitted meanwhile wait for it. `isReady` tells whether it is over, `waitUntilReady` waits for it.
+
+     @param completion Called on the queue thread once the warm-up ran, before the queue is ready, or at once if it could not be enqueued.
+     @return `false` if the warm-up was not enqueued.
+     */
+    bool warmUp(const FMWarmUpOptions &options, const std::function<void(bool success, const FMWarmUpStatistics &statistics)> &completion = nullptr);
+    /** `false` while a warm-up is queued or running. */
+    bool isReady() const;
+    /** @return `false` if the warm-ups are still running after `timeout`. */
+    bool waitUntilReady(TimeInterval timeout = TimeInterval::max()) const;
+    /** The statistics of the last warm-up. */
+    FMWarmUpStatistics warmUpStatistics() const;
+
+    /** In-memory mode */
+
+    /**
+     Load the database into memory, see `FMDatabase::loadIntoMemory`, and write it back while the queue is idle.
+
+     Once changes are committed, a write-back runs on the queue when no task is waiting and at least `writeBackInterval` passed since the previous one; a task submitted meanwhile waits for it. Closing the queue writes back the last changes.
+
+     @param writeBackInterval Zero only writes back on demand, with `writeBack`, and when closing.
+     */
+    bool loadIntoMemory(TimeInterval writeBackInterval, Error *error = nullptr);
+    /** Write the in-memory database back now, after the tasks already queued. */
+    bool writeBack(Error *error = nullptr);
+    FMInMemoryStatistics inMemoryStatistics();
+
+    /** Idle work */
+
+    /**
+     Run `handler` on the queue thread while no task is waiting, for maintenance such as checkpoints.
+
+     The handlers get a turn, in the order they were added, each time the queue runs out of tasks. A handler returning `true` has more to do and asks for another turn, which only comes once the tasks submitted meanwhile have run. Keep each turn short: a task submitted during a turn waits for it.
+
+     @return The identifier to pass to `removeIdleHandler`.
+     */
+    unsigned long long addIdleHandler(const std::function<bool(FMDatabase &db)> &handler);
+    /** Remove a handler. Waits for the turn running, unless called from the queue thread. */
+    void removeIdleHandler(unsigned long long identifier);
+    /** Give the handlers a turn once the queue is idle and `delay` has passed, even if no task runs before. */
+    void scheduleIdleHandlers(TimeInterval delay = TimeInterval(0));
 protected:
     void checkWhenInvoke() const;
-    void inTransaction(bool useDeferred, const std::function<void(FMDatabase &db, bool &rollback)> &block);
+    bool inTransaction(FMDatabaseTransactionMode mode, const std::function<void(FMDatabase &db, bool &rollback)> &block, const FMDatabaseQueueTaskOptions &options);
 private:
-    void put(const function<void(void)> &block);
+    TimeInterval _groupCommitWindow;
+    size_t _maximumGroupCommitSize;
+
+    bool submit(__queueTask &&task);
+    bool put(__queueTask &&task, TimeInterval timeout);
+    void requeue(__queueTask &&task);
     void exec();
+    void runTask(__queueTask &task);
+    bool endDeadline(__queueTask &task);
+    void runTransactionGroup(__queueTask &first);
+    void runIdleHandlers(std::unique_lock<std::mutex> &locker);
+    /** Run `block` as a task with `priority` and wait for it. @return `false` if it could not run. */
+    bool runAndWait(const std::function<void(FMDatabase &db)> &block, FMDatabaseQueuePriority priority);
 };
 
 FMDB_END
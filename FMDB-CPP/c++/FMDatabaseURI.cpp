@@ -0,0 +1,89 @@
+//
+//  FMDatabaseURI.cpp
+//  fmdb
+//
+
+#include "FMDatabaseURI.h"
+#include <sqlite3.h>
+#include <algorithm>
+#include <cctype>
+
+using namespace std;
+
+FMDB_BEGIN
+
+static string FMDBPercentEncoded(const string &text, bool isPath)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    string encoded;
+    encoded.reserve(text.size());
+    for (unsigned char c : text) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || (isPath && (c == '/' || c == ':'))) {
+            encoded += (char)c;
+        } else {
+            encoded += '%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 0xf];
+        }
+    }
+    return encoded;
+}
+
+FMDatabaseURI FMDatabaseURI::immutableFile(const string &path)
+{
+    FMDatabaseURI uri(path);
+    uri.mode = Mode::ReadOnly;
+    uri.immutable = true;
+    return uri;
+}
+
+string FMDatabaseURI::toString() const
+{
+    string file = path;
+#ifdef WIN32
+    replace(file.begin(), file.end(), '\\', '/');
+    if (file.size() > 1 && file[1] == ':') {
+        file = "///" + file; // file:///C:/path
+    }
+#endif
+    string uri = "file:" + FMDBPercentEncoded(file, true);
+
+    vector<pair<string, string>> query;
+    static const char *modes[] = {"", "ro", "rw", "rwc", "memory"};
+    if (mode != Mode::Default) {
+        query.emplace_back("mode", modes[(int)mode]);
+    }
+    if (cache != Cache::Default) {
+        query.emplace_back("cache", cache == Cache::Shared ? "shared" : "private");
+    }
+    if (immutable) {
+        query.emplace_back("immutable", "1");
+    }
+    if (noLock) {
+        query.emplace_back("nolock", "1");
+    }
+    if (!vfsName.empty()) {
+        query.emplace_back("vfs", vfsName);
+    }
+    query.insert(query.end(), parameters.begin(), parameters.end());
+
+    for (size_t i = 0; i < query.size(); ++i) {
+        uri += i ? '&' : '?';
+        uri += FMDBPercentEncoded(query[i].first, false) + "=" + FMDBPercentEncoded(query[i].second, false);
+    }
+    return uri;
+}
+
+int FMDatabaseURI::openFlags() const
+{
+    switch (mode) {
+        case Mode::ReadOnly:
+            return SQLITE_OPEN_URI | SQLITE_OPEN_READONLY;
+        case Mode::ReadWrite:
+            return SQLITE_OPEN_URI | SQLITE_OPEN_READWRITE;
+        default:
+            return SQLITE_OPEN_URI | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    }
+}
+
+FMDB_END
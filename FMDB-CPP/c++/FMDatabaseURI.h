@@ -0,0 +1,61 @@
+//
+//  FMDatabaseURI.h
+//  fmdb
+//
+
+#ifndef FMDatabaseURI_hpp
+#define FMDatabaseURI_hpp
+
+#include "FMDBDefs.h"
+#include <utility>
+
+FMDB_BEGIN
+
+/**
+ Builder of the `file:` URI filenames of SQLite.
+
+ The URI is the path of an `<FMDatabase>` or `<FMDatabaseQueue>`, opened with `openFlags()`, which include `SQLITE_OPEN_URI`:
+
+    FMDatabaseURI uri = FMDatabaseURI::immutableFile(pathOfBundledData);
+    FMDatabase db(uri.toString());
+    db.openWithFlags(uri.openFlags());
+
+ `immutable` tells SQLite the file can't change, even by another process: it takes no lock and never checks the change counter, so each read transaction saves the lock and unlock system calls. If the file does change, queries can return wrong results or report corruption.
+ */
+struct FMDatabaseURI {
+    enum class Mode : int {
+        /** No `mode` parameter: read-write and create, like `FMDatabase::open`. */
+        Default,
+        ReadOnly,
+        ReadWrite,
+        ReadWriteCreate,
+        Memory,
+    };
+    enum class Cache : int { Default, Shared, Private };
+
+    string path;
+    Mode mode = Mode::Default;
+    Cache cache = Cache::Default;
+    /** `immutable=1`: the file is read-only media, see above. */
+    bool immutable = false;
+    /** `nolock=1`: no file locking, but the change counter is still checked. Only safe without concurrent writers. */
+    bool noLock = false;
+    /** `vfs=`, the VFS to open the file with. */
+    string vfsName;
+    /** Other query parameters, appended as they are after percent-encoding. */
+    vector<std::pair<string, string>> parameters;
+
+    explicit FMDatabaseURI(const string &path) : path(path) {}
+
+    /** A read-only, immutable URI: for reference data shipped along with the application. */
+    static FMDatabaseURI immutableFile(const string &path);
+
+    /** The URI, with the path and the parameter values percent-encoded. */
+    string toString() const;
+    /** The flags of `sqlite3_open_v2` matching `mode`, with `SQLITE_OPEN_URI`. */
+    int openFlags() const;
+};
+
+FMDB_END
+
+#endif /* FMDatabaseURI_hpp */
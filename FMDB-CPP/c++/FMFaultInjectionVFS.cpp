@@ -0,0 +1,184 @@
+//
+//  FMFaultInjectionVFS.cpp
+//  fmdb
+//
+
+#include "FMFaultInjectionVFS.h"
+#include <sqlite3.h>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using namespace std;
+
+FMDB_BEGIN
+
+static const int FMDBFaultOperationCount = (int)FMFaultOperation::Lock + 1;
+
+struct __FMFaultInjectionPacket {
+    mutable mutex lock;
+    FMFaultInjectionPolicy policies[FMDBFaultOperationCount];
+    /** The next latency of each script. */
+    size_t scriptIndices[FMDBFaultOperationCount] = {0};
+    bool hasPolicy[FMDBFaultOperationCount] = {false};
+    bool enabled = true;
+    minstd_rand random;
+    FMFaultInjectionStatistics statistics;
+};
+
+#pragma mark Policies
+
+FMFaultInjectionPolicy FMFaultInjectionPolicy::fixedLatency(TimeInterval latency)
+{
+    return randomLatency(latency, latency);
+}
+
+FMFaultInjectionPolicy FMFaultInjectionPolicy::randomLatency(TimeInterval minimum, TimeInterval maximum)
+{
+    FMFaultInjectionPolicy policy;
+    policy.minimumLatency = minimum;
+    policy.maximumLatency = std::max(minimum, maximum);
+    return policy;
+}
+
+FMFaultInjectionPolicy FMFaultInjectionPolicy::scriptedLatency(const vector<TimeInterval> &script)
+{
+    FMFaultInjectionPolicy policy;
+    policy.script = script;
+    return policy;
+}
+
+FMFaultInjectionPolicy FMFaultInjectionPolicy::failures(double rate, int code/* = 0*/)
+{
+    FMFaultInjectionPolicy policy;
+    policy.failureRate = rate;
+    policy.failureCode = code;
+    return policy;
+}
+
+#pragma mark FMFaultInjectionVFS
+
+FMFaultInjectionVFS::FMFaultInjectionVFS(const string &baseName/* = ""*/)
+:FMShimVFS(baseName, "fmdb-fault-")
+,_packet(new struct __FMFaultInjectionPacket)
+{
+}
+
+FMFaultInjectionVFS::~FMFaultInjectionVFS()
+{
+    delete _packet;
+}
+
+void FMFaultInjectionVFS::setPolicy(FMFaultOperation operation, const FMFaultInjectionPolicy &policy)
+{
+    lock_guard<mutex> lock(_packet->lock);
+    _packet->policies[(int)operation] = policy;
+    _packet->scriptIndices[(int)operation] = 0;
+    _packet->hasPolicy[(int)operation] = true;
+}
+
+FMFaultInjectionPolicy FMFaultInjectionVFS::policy(FMFaultOperation operation) const
+{
+    lock_guard<mutex> lock(_packet->lock);
+    return _packet->policies[(int)operation];
+}
+
+void FMFaultInjectionVFS::removeAllPolicies()
+{
+    lock_guard<mutex> lock(_packet->lock);
+    for (int i = 0; i < FMDBFaultOperationCount; ++i) {
+        _packet->policies[i] = FMFaultInjectionPolicy();
+        _packet->hasPolicy[i] = false;
+    }
+}
+
+void FMFaultInjectionVFS::setEnabled(bool enabled)
+{
+    lock_guard<mutex> lock(_packet->lock);
+    _packet->enabled = enabled;
+}
+
+bool FMFaultInjectionVFS::isEnabled() const
+{
+    lock_guard<mutex> lock(_packet->lock);
+    return _packet->enabled;
+}
+
+void FMFaultInjectionVFS::setSeed(unsigned seed)
+{
+    lock_guard<mutex> lock(_packet->lock);
+    _packet->random.seed(seed);
+}
+
+FMFaultInjectionStatistics FMFaultInjectionVFS::statistics() const
+{
+    lock_guard<mutex> lock(_packet->lock);
+    return _packet->statistics;
+}
+
+void FMFaultInjectionVFS::resetStatistics()
+{
+    lock_guard<mutex> lock(_packet->lock);
+    _packet->statistics = FMFaultInjectionStatistics();
+}
+
+int FMFaultInjectionVFS::inject(FMFaultOperation operation, FMShimFileKind kind)
+{
+    static const int defaultFailures[FMDBFaultOperationCount] = {SQLITE_IOERR_READ, SQLITE_IOERR_WRITE, SQLITE_IOERR_FSYNC, SQLITE_BUSY};
+
+    TimeInterval latency(0);
+    int rc = SQLITE_OK;
+    {
+        lock_guard<mutex> lock(_packet->lock);
+        int index = (int)operation;
+        const FMFaultInjectionPolicy &policy = _packet->policies[index];
+        if (!_packet->enabled || !_packet->hasPolicy[index] || !(policy.fileKinds & (1u << (int)kind))) {
+            return SQLITE_OK;
+        }
+        auto &random = _packet->random;
+        if (!policy.script.empty()) {
+            latency = policy.script[_packet->scriptIndices[index]++ % policy.script.size()];
+        } else {
+            double share = (double)(random() - minstd_rand::min()) / (minstd_rand::max() - minstd_rand::min());
+            latency = policy.minimumLatency + (policy.maximumLatency - policy.minimumLatency) * share;
+        }
+        if (policy.failureRate > 0 && (double)(random() - minstd_rand::min()) / (minstd_rand::max() - minstd_rand::min()) < policy.failureRate) {
+            rc = policy.failureCode ? policy.failureCode : defaultFailures[index];
+        }
+
+        FMFaultInjectionCounts *counts[FMDBFaultOperationCount] = {&_packet->statistics.reads, &_packet->statistics.writes, &_packet->statistics.syncs, &_packet->statistics.locks};
+        ++counts[index]->calls;
+        counts[index]->failures += rc != SQLITE_OK;
+        counts[index]->latency += latency;
+    }
+    if (latency > TimeInterval(0)) {
+        this_thread::sleep_for(latency);
+    }
+    return rc;
+}
+
+int FMFaultInjectionVFS::read(sqlite3_file *file, FMShimFileKind kind, void *buffer, int amount, long long offset)
+{
+    int rc = inject(FMFaultOperation::Read, kind);
+    return rc == SQLITE_OK ? FMShimVFS::read(file, kind, buffer, amount, offset) : rc;
+}
+
+int FMFaultInjectionVFS::write(sqlite3_file *file, FMShimFileKind kind, const void *buffer, int amount, long long offset)
+{
+    int rc = inject(FMFaultOperation::Write, kind);
+    return rc == SQLITE_OK ? FMShimVFS::write(file, kind, buffer, amount, offset) : rc;
+}
+
+int FMFaultInjectionVFS::sync(sqlite3_file *file, FMShimFileKind kind, int flags)
+{
+    int rc = inject(FMFaultOperation::Sync, kind);
+    return rc == SQLITE_OK ? FMShimVFS::sync(file, kind, flags) : rc;
+}
+
+int FMFaultInjectionVFS::lock(sqlite3_file *file, FMShimFileKind kind, int lock)
+{
+    int rc = inject(FMFaultOperation::Lock, kind);
+    return rc == SQLITE_OK ? FMShimVFS::lock(file, kind, lock) : rc;
+}
+
+FMDB_END
@@ -0,0 +1,100 @@
+//
+//  FMFaultInjectionVFS.h
+//  fmdb
+//
+
+#ifndef FMFaultInjectionVFS_hpp
+#define FMFaultInjectionVFS_hpp
+
+#include "FMShimVFS.h"
+
+FMDB_BEGIN
+
+enum class FMFaultOperation : int { Read, Write, Sync, Lock };
+
+/**
+ What `<FMFaultInjectionVFS>` does to the calls of one file operation: a latency, then sometimes a failure.
+
+ A call sleeps between `minimumLatency` and `maximumLatency`, uniformly, or the next latency of `script` when there is one. Then a share `failureRate` of the calls fails without reaching the file.
+
+    vfs.setPolicy(FMFaultOperation::Sync, FMFaultInjectionPolicy::fixedLatency(TimeInterval(0.008))); // a slow disk flush
+ */
+struct FMFaultInjectionPolicy {
+    TimeInterval minimumLatency = TimeInterval(0);
+    TimeInterval maximumLatency = TimeInterval(0);
+    /** The latencies of the successive calls, starting over at the end. Takes precedence over the range above. */
+    vector<TimeInterval> script;
+    /** Between 0 and 1. */
+    double failureRate = 0;
+    /** The result of a failure. Zero stands for the usual one: `SQLITE_IOERR_READ`, `SQLITE_IOERR_WRITE`, `SQLITE_IOERR_FSYNC`, and `SQLITE_BUSY` for locks. */
+    int failureCode = 0;
+    /** The files affected, a mask of `1 << (int)FMShimFileKind`; all of them by default. */
+    unsigned fileKinds = ~0u;
+
+    static FMFaultInjectionPolicy fixedLatency(TimeInterval latency);
+    static FMFaultInjectionPolicy randomLatency(TimeInterval minimum, TimeInterval maximum);
+    static FMFaultInjectionPolicy scriptedLatency(const vector<TimeInterval> &script);
+    static FMFaultInjectionPolicy failures(double rate, int code = 0);
+};
+
+struct FMFaultInjectionCounts {
+    /** The calls a policy applied to. */
+    unsigned long long calls = 0;
+    unsigned long long failures = 0;
+    TimeInterval latency = TimeInterval(0);
+};
+
+struct FMFaultInjectionStatistics {
+    FMFaultInjectionCounts reads;
+    FMFaultInjectionCounts writes;
+    FMFaultInjectionCounts syncs;
+    FMFaultInjectionCounts locks;
+};
+
+struct __FMFaultInjectionPacket;
+
+/**
+ A `<FMShimVFS>` slowing down and failing file operations, to reproduce slow or flaky storage on a fast machine.
+
+    FMFaultInjectionVFS slowDisk;
+    slowDisk.setPolicy(FMFaultOperation::Sync, FMFaultInjectionPolicy::randomLatency(TimeInterval(0.002), TimeInterval(0.02)));
+    slowDisk.setPolicy(FMFaultOperation::Lock, FMFaultInjectionPolicy::failures(0.01));
+    FMDatabaseQueue queue(path, 0, slowDisk.name());
+
+ A lock failing with `SQLITE_BUSY` goes through the busy handler of the connection, as if another process held the lock, so it shows in `FMDatabase::busyStatistics`. In WAL mode, readers and writers mostly lock the shared memory of the WAL index instead, which is left alone.
+
+ The latency is slept on the thread of the connection, outside of any lock of the VFS. Policies can be changed while connections work. `setSeed` makes the random latencies and failures repeatable.
+ */
+class FMFaultInjectionVFS : public FMShimVFS
+{
+public:
+    /** @param baseName The wrapped VFS; empty for the default one. */
+    explicit FMFaultInjectionVFS(const string &baseName = "");
+    ~FMFaultInjectionVFS();
+
+    void setPolicy(FMFaultOperation operation, const FMFaultInjectionPolicy &policy);
+    FMFaultInjectionPolicy policy(FMFaultOperation operation) const;
+    void removeAllPolicies();
+
+    /** Stops and resumes the injection without changing the policies, to set up a database at full speed for instance. On by default. */
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    void setSeed(unsigned seed);
+
+    FMFaultInjectionStatistics statistics() const;
+    void resetStatistics();
+protected:
+    int read(sqlite3_file *file, FMShimFileKind kind, void *buffer, int amount, long long offset) override;
+    int write(sqlite3_file *file, FMShimFileKind kind, const void *buffer, int amount, long long offset) override;
+    int sync(sqlite3_file *file, FMShimFileKind kind, int flags) override;
+    int lock(sqlite3_file *file, FMShimFileKind kind, int lock) override;
+private:
+    /** Sleep the latency of the next call of `operation`. @return The failure to inject, `SQLITE_OK` if none. */
+    int inject(FMFaultOperation operation, FMShimFileKind kind);
+
+    __FMFaultInjectionPacket *_packet;
+};
+
+FMDB_END
+
+#endif /* FMFaultInjectionVFS_hpp */
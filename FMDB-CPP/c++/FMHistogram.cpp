@@ -0,0 +1,102 @@
+//
+//  FMHistogram.cpp
+//  FMDB-CPP
+//
+
+#include "FMHistogram.hpp"
+
+using namespace std;
+
+FMDB_BEGIN
+
+static const unsigned long long FMDBSubBucketCount = 1ull << FMHistogram::SubBucketBits;
+
+static int FMDBHighestBit(unsigned long long value)
+{
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+}
+
+unsigned long long FMHistogramSnapshot::percentile(double p) const
+{
+    if (count == 0) {
+        return 0;
+    }
+    auto rank = (unsigned long long)(p / 100.0 * count + 0.5);
+    rank = std::max(rank, 1ull);
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            if (i + 1 >= buckets.size()) {
+                return maximum;
+            }
+            return std::min(FMHistogram::lowerBoundOfBucket((int)i + 1) - 1, maximum);
+        }
+    }
+    return maximum;
+}
+
+FMHistogram::FMHistogram()
+{
+    reset();
+}
+
+int FMHistogram::bucketIndexForValue(unsigned long long value)
+{
+    if (value < FMDBSubBucketCount) {
+        return (int)value;
+    }
+    int exponent = FMDBHighestBit(value);
+    int subBucket = (int)((value >> (exponent - SubBucketBits)) & (FMDBSubBucketCount - 1));
+    return ((exponent - SubBucketBits + 1) << SubBucketBits) + subBucket;
+}
+
+unsigned long long FMHistogram::lowerBoundOfBucket(int index)
+{
+    if (index < (int)FMDBSubBucketCount) {
+        return index;
+    }
+    int exponent = (index >> SubBucketBits) + SubBucketBits - 1;
+    unsigned long long subBucket = index & (FMDBSubBucketCount - 1);
+    return (FMDBSubBucketCount + subBucket) << (exponent - SubBucketBits);
+}
+
+void FMHistogram::record(unsigned long long value)
+{
+    _buckets[bucketIndexForValue(value)].fetch_add(1, memory_order_relaxed);
+    _sum.fetch_add(value, memory_order_relaxed);
+    auto maximum = _maximum.load(memory_order_relaxed);
+    while (value > maximum && !_maximum.compare_exchange_weak(maximum, value, memory_order_relaxed)) {
+    }
+}
+
+FMHistogramSnapshot FMHistogram::snapshot() const
+{
+    FMHistogramSnapshot snapshot;
+    snapshot.buckets.resize(BucketCount);
+    unsigned long long count = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        snapshot.buckets[i] = _buckets[i].load(memory_order_relaxed);
+        count += snapshot.buckets[i];
+    }
+    // Summing the buckets keeps count consistent with them while recording goes on.
+    snapshot.count = count;
+    snapshot.sum = _sum.load(memory_order_relaxed);
+    snapshot.maximum = _maximum.load(memory_order_relaxed);
+    return snapshot;
+}
+
+void FMHistogram::reset()
+{
+    for (auto &bucket : _buckets) {
+        bucket.store(0, memory_order_relaxed);
+    }
+    _sum.store(0, memory_order_relaxed);
+    _maximum.store(0, memory_order_relaxed);
+}
+
+FMDB_END
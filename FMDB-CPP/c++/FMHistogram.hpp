@@ -0,0 +1,72 @@
+//
+//  FMHistogram.hpp
+//  FMDB-CPP
+//
+
+#ifndef FMHistogram_hpp
+#define FMHistogram_hpp
+
+#include "FMDBDefs.h"
+#include <atomic>
+
+FMDB_BEGIN
+
+/**
+ A copy of the counters of a `FMHistogram` at one moment.
+ */
+struct FMHistogramSnapshot {
+    unsigned long long count = 0;
+    unsigned long long sum = 0;
+    unsigned long long maximum = 0;
+    vector<unsigned long long> buckets;
+
+    double mean() const { return count ? (double)sum / count : 0; }
+
+    /**
+     Estimate a percentile of the recorded values.
+
+     @param p The percentile, from 0 to 100.
+     @return The upper bound of the bucket holding the percentile, never more than `maximum`.
+     */
+    unsigned long long percentile(double p) const;
+};
+
+/**
+ Lock-free histogram with logarithmic buckets.
+
+ Each power of two is split into four buckets, so a value is known within 25%. Recording is a few relaxed atomic increments and can be done from any thread, while another thread takes a `snapshot`.
+ */
+class FMHistogram
+{
+public:
+    static const int SubBucketBits = 2;
+    static const int BucketCount = (64 - SubBucketBits + 1) << SubBucketBits;
+
+    FMHistogram();
+    FMHistogram(const FMHistogram &) = delete;
+    FMHistogram& operator=(const FMHistogram &) = delete;
+
+    void record(unsigned long long value);
+
+    /** Record a duration in microseconds. */
+    template<typename Rep, typename Period>
+    void recordDuration(const std::chrono::duration<Rep, Period> &duration)
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        record(us > 0 ? (unsigned long long)us : 0);
+    }
+
+    FMHistogramSnapshot snapshot() const;
+    void reset();
+
+    static int bucketIndexForValue(unsigned long long value);
+    static unsigned long long lowerBoundOfBucket(int index);
+private:
+    std::atomic<unsigned long long> _sum;
+    std::atomic<unsigned long long> _maximum;
+    std::atomic<unsigned long long> _buckets[BucketCount];
+};
+
+FMDB_END
+
+#endif /* FMHistogram_hpp */
@@ -0,0 +1,113 @@
+//
+//  FMIOAccountingVFS.cpp
+//  fmdb
+//
+
+#include "FMIOAccountingVFS.h"
+#include <sqlite3.h>
+#include <atomic>
+
+using namespace std;
+
+FMDB_BEGIN
+
+enum FMDBIOOperation { FMDBIOOperationRead, FMDBIOOperationWrite, FMDBIOOperationSync, FMDBIOOperationCount };
+static const int FMDBIOFileKindCount = (int)FMShimFileKind::Other + 1;
+
+struct __FMDBIOCounter {
+    FMHistogram latency;
+    std::atomic<unsigned long long> bytes;
+
+    void record(steady_clock::time_point start, unsigned long long byteCount)
+    {
+        latency.recordDuration(steady_clock::now() - start);
+        bytes.fetch_add(byteCount, memory_order_relaxed);
+    }
+};
+
+struct __FMIOAccountingPacket {
+    __FMDBIOCounter counters[FMDBIOFileKindCount][FMDBIOOperationCount];
+};
+
+#pragma mark FMIOAccountingVFS
+
+FMIOAccountingVFS::FMIOAccountingVFS(const string &baseName/* = ""*/)
+:FMShimVFS(baseName, "fmdb-io-")
+,_packet(new struct __FMIOAccountingPacket)
+{
+    resetStatistics();
+}
+
+FMIOAccountingVFS::~FMIOAccountingVFS()
+{
+    delete _packet;
+}
+
+int FMIOAccountingVFS::read(sqlite3_file *file, FMShimFileKind kind, void *buffer, int amount, long long offset)
+{
+    auto start = steady_clock::now();
+    int rc = file->pMethods->xRead(file, buffer, amount, offset);
+    _packet->counters[(int)kind][FMDBIOOperationRead].record(start, rc == SQLITE_OK ? amount : 0);
+    return rc;
+}
+
+int FMIOAccountingVFS::write(sqlite3_file *file, FMShimFileKind kind, const void *buffer, int amount, long long offset)
+{
+    auto start = steady_clock::now();
+    int rc = file->pMethods->xWrite(file, buffer, amount, offset);
+    _packet->counters[(int)kind][FMDBIOOperationWrite].record(start, rc == SQLITE_OK ? amount : 0);
+    return rc;
+}
+
+int FMIOAccountingVFS::sync(sqlite3_file *file, FMShimFileKind kind, int flags)
+{
+    auto start = steady_clock::now();
+    int rc = file->pMethods->xSync(file, flags);
+    _packet->counters[(int)kind][FMDBIOOperationSync].record(start, 0);
+    return rc;
+}
+
+FMIOStatistics FMIOAccountingVFS::statistics() const
+{
+    FMIOStatistics statistics;
+    FMIOFileStatistics *files[FMDBIOFileKindCount] = {&statistics.mainDatabase, &statistics.wal, &statistics.journal, &statistics.other};
+    for (int kind = 0; kind < FMDBIOFileKindCount; ++kind) {
+        FMIOOperationStatistics *operations[FMDBIOOperationCount] = {&files[kind]->reads, &files[kind]->writes, &files[kind]->syncs};
+        for (int operation = 0; operation < FMDBIOOperationCount; ++operation) {
+            const __FMDBIOCounter &counter = _packet->counters[kind][operation];
+            operations[operation]->latency = counter.latency.snapshot();
+            operations[operation]->count = operations[operation]->latency.count;
+            operations[operation]->bytes = counter.bytes.load(memory_order_relaxed);
+        }
+    }
+    return statistics;
+}
+
+void FMIOAccountingVFS::resetStatistics()
+{
+    for (auto &counters : _packet->counters) {
+        for (auto &counter : counters) {
+            counter.latency.reset();
+            counter.bytes.store(0, memory_order_relaxed);
+        }
+    }
+}
+
+#pragma mark FMIOStatistics
+
+unsigned long long FMIOStatistics::bytesRead() const
+{
+    return mainDatabase.reads.bytes + wal.reads.bytes + journal.reads.bytes + other.reads.bytes;
+}
+
+unsigned long long FMIOStatistics::bytesWritten() const
+{
+    return mainDatabase.writes.bytes + wal.writes.bytes + journal.writes.bytes + other.writes.bytes;
+}
+
+unsigned long long FMIOStatistics::syncCount() const
+{
+    return mainDatabase.syncs.count + wal.syncs.count + journal.syncs.count + other.syncs.count;
+}
+
+FMDB_END
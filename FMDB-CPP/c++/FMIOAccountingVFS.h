@@ -0,0 +1,47 @@
+//
+//  FMIOAccountingVFS.h
+//  fmdb
+//
+
+#ifndef FMIOAccountingVFS_hpp
+#define FMIOAccountingVFS_hpp
+
+#include "FMDatabase.h"
+#include "FMShimVFS.h"
+
+FMDB_BEGIN
+
+struct __FMIOAccountingPacket;
+
+/**
+ A `<FMShimVFS>` counting the file I/O of the connections opened with it.
+
+ Each read, write and sync is timed on `steady_clock` and counted separately for the main database, the WAL and the rollback journal, see `<FMIOStatistics>`. The counters are atomic: they can be read from any thread while the connections work.
+
+    FMIOAccountingVFS accounting;
+    db.openWithFlags(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, accounting.name());
+    ...
+    accounting.statistics().bytesWritten();
+
+ Most of the time `FMDatabaseOpenOptions::ioAccounting` is simpler: each connection gets its own shim and reports with `FMDatabase::ioStatistics`. One shim shared by several connections, a pool for instance, sums up their I/O.
+ */
+class FMIOAccountingVFS : public FMShimVFS
+{
+public:
+    /** @param baseName The wrapped VFS; empty for the default one. */
+    explicit FMIOAccountingVFS(const string &baseName = "");
+    ~FMIOAccountingVFS();
+
+    FMIOStatistics statistics() const;
+    void resetStatistics();
+protected:
+    int read(sqlite3_file *file, FMShimFileKind kind, void *buffer, int amount, long long offset) override;
+    int write(sqlite3_file *file, FMShimFileKind kind, const void *buffer, int amount, long long offset) override;
+    int sync(sqlite3_file *file, FMShimFileKind kind, int flags) override;
+private:
+    __FMIOAccountingPacket *_packet;
+};
+
+FMDB_END
+
+#endif /* FMIOAccountingVFS_hpp */
@@ -0,0 +1,339 @@
+//
+//  FMParallelScan.cpp
+//  fmdb
+//
+
+#include "FMParallelScan.h"
+#include <sqlite3.h>
+#include <thread>
+#include <map>
+
+using namespace std;
+
+FMDB_BEGIN
+
+static string FMDBQuotedIdentifier(const string &identifier)
+{
+    string quoted = "\"";
+    for (char c : identifier) {
+        if (c == '"') {
+            quoted += '"';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+FMParallelScan::FMParallelScan(FMDatabasePool &pool, const string &table, size_t partitionCount/* = 0*/)
+:_pool(pool)
+,_table(table)
+,_partitionCount(partitionCount ? partitionCount : pool.maximumNumberOfReaders())
+{
+    parameterAssert(table.length());
+}
+
+vector<FMRowidRange> FMParallelScan::partitions(Error *error/* = nullptr*/) const
+{
+    vector<FMRowidRange> ranges;
+    FMDatabase *db = _pool.checkoutReader();
+    if (!db) {
+        if (error) {
+            VariantMap userInfo({{LocalizedDescriptionKey, "Could not open a reader of the database pool."}});
+            *error = Error("FMDatabase", SQLITE_CANTOPEN, userInfo);
+        }
+        return ranges;
+    }
+
+    auto rs = db->executeQuery("select min(rowid), max(rowid) from " + FMDBQuotedIdentifier(_table)).lock();
+    if (!rs) {
+        if (error) {
+            *error = db->lastError();
+        }
+        _pool.checkin(db);
+        return ranges;
+    }
+    bool empty = !rs->next() || rs->columnIndexIsNull(0);
+    long long minimum = empty ? 0 : rs->longLongForColumnIndex(0);
+    long long maximum = empty ? 0 : rs->longLongForColumnIndex(1);
+    rs->close();
+    _pool.checkin(db);
+    if (empty) {
+        return ranges;
+    }
+
+    // Unsigned arithmetic: the span of the rowids may not fit in a long long.
+    unsigned long long span = (unsigned long long)maximum - (unsigned long long)minimum;
+    unsigned long long count = std::min<unsigned long long>(_partitionCount, span + 1);
+    if (count == 0) {
+        count = _partitionCount; // the whole 64-bit range.
+    }
+    // The `span + 1` rowids split into `size` per range, and the first `remainder` ranges take one more. Worked out from `span`, as `span + 1` overflows for the whole range.
+    unsigned long long size = span / count;
+    unsigned long long remainder = span % count + 1;
+    if (remainder == count) {
+        ++size;
+        remainder = 0;
+    }
+    unsigned long long first = (unsigned long long)minimum;
+    for (unsigned long long i = 0; i < count; ++i) {
+        unsigned long long last = first + size - (i < remainder ? 0 : 1);
+        ranges.push_back({(long long)first, (long long)last});
+        first = last + 1;
+    }
+    return ranges;
+}
+
+Error FMParallelScan::run(const Query &query, const std::function<void (FMResultSet &, size_t)> &block)
+{
+    Error error;
+    auto ranges = partitions(&error);
+    if (!error.isEmpty() || ranges.empty()) {
+        return error;
+    }
+
+    vector<Error> errors(ranges.size());
+    auto scanPartition = [&](size_t partition) {
+        FMDatabase *db = _pool.checkoutReader();
+        if (!db) {
+            VariantMap userInfo({{LocalizedDescriptionKey, "Could not open a reader of the database pool."}});
+            errors[partition] = Error("FMDatabase", SQLITE_CANTOPEN, userInfo);
+            return;
+        }
+        auto rs = query(*db, ranges[partition]).lock();
+        if (rs) {
+            while (rs->next()) {
+                block(*rs, partition);
+            }
+            rs->close();
+        }
+        if (db->hadError()) {
+            errors[partition] = db->lastError();
+        }
+        _pool.checkin(db);
+    };
+
+    // The calling thread scans the last partition itself.
+    vector<thread> threads;
+    for (size_t i = 0; i + 1 < ranges.size(); ++i) {
+        threads.emplace_back(scanPartition, i);
+    }
+    scanPartition(ranges.size() - 1);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (auto &partitionError : errors) {
+        if (!partitionError.isEmpty()) {
+            return std::move(partitionError);
+        }
+    }
+    return error;
+}
+
+FMShardedQueryResult FMParallelScan::gather(const Query &query)
+{
+    struct Partition {
+        vector<string> columnNames;
+        vector<VariantVector> rows;
+    };
+    vector<Partition> partitions(_partitionCount);
+    FMShardedQueryResult result;
+    result.error = run(query, [&](FMResultSet &rs, size_t index) {
+        auto &partition = partitions[index];
+        if (partition.columnNames.empty()) {
+            int columnCount = rs.columnCount();
+            for (int column = 0; column < columnCount; ++column) {
+                partition.columnNames.emplace_back(rs.columnNameForIndex(column));
+            }
+        }
+        partition.rows.emplace_back(rs.resultArray());
+    });
+
+    size_t rowCount = 0;
+    for (auto &partition : partitions) {
+        if (result.columnNames.empty()) {
+            result.columnNames = partition.columnNames;
+        }
+        rowCount += partition.rows.size();
+    }
+    result.rows.reserve(rowCount);
+    for (auto &partition : partitions) {
+        std::move(partition.rows.begin(), partition.rows.end(), back_inserter(result.rows));
+    }
+    return result;
+}
+
+string FMAggregate::sql() const
+{
+    switch (function) {
+        case FMAggregateFunction::Count:
+            return "count(" + expression + ")";
+        case FMAggregateFunction::Sum:
+            return "sum(" + expression + ")";
+        case FMAggregateFunction::Min:
+            return "min(" + expression + ")";
+        case FMAggregateFunction::Max:
+            return "max(" + expression + ")";
+        case FMAggregateFunction::Avg:
+            return "avg(" + expression + ")";
+    }
+    return string();
+}
+
+string FMParallelScan::aggregateQuery(const vector<string> &groupBy, const vector<FMAggregate> &aggregates, const string &where) const
+{
+    parameterAssert(aggregates.size());
+    string columns;
+    for (auto &column : groupBy) {
+        columns += column + ", ";
+    }
+    // The partial step of each aggregate; an average needs both its sum and its count.
+    for (auto &aggregate : aggregates) {
+        switch (aggregate.function) {
+            case FMAggregateFunction::Avg:
+                columns += "sum(" + aggregate.expression + "), count(" + aggregate.expression + "), ";
+                break;
+            default:
+                columns += aggregate.sql() + ", ";
+                break;
+        }
+    }
+    columns.resize(columns.size() - 2);
+
+    string sql = "select " + columns + " from " + FMDBQuotedIdentifier(_table) + " where rowid between ? and ?";
+    if (!where.empty()) {
+        sql += " and (" + where + ")";
+    }
+    for (size_t i = 0; i < groupBy.size(); ++i) {
+        sql += (i ? ", " : " group by ") + groupBy[i];
+    }
+    return sql;
+}
+
+struct __partialAggregate {
+    Variant value;
+    long long count = 0;
+};
+
+struct __groupLess {
+    bool operator()(const VariantVector &lhs, const VariantVector &rhs) const
+    {
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            int order = FMShardedDatabaseQueue::compareValues(lhs[i], rhs[i]);
+            if (order != 0) {
+                return order < 0;
+            }
+        }
+        return false;
+    }
+};
+
+typedef map<VariantVector, vector<__partialAggregate>, __groupLess> __partialGroups;
+
+static void FMDBAddSum(Variant &sum, const Variant &value)
+{
+    if (value.isNull()) {
+        return;
+    }
+    if (sum.isNull()) {
+        sum = value;
+    } else if (sum.isTypeOf(Variant::Type::DOUBLE) || value.isTypeOf(Variant::Type::DOUBLE)) {
+        sum = sum.toDouble() + value.toDouble();
+    } else {
+        sum = sum.toLongLong() + value.toLongLong();
+    }
+}
+
+static void FMDBCombine(const FMAggregate &aggregate, __partialAggregate &total, const __partialAggregate &partial)
+{
+    switch (aggregate.function) {
+        case FMAggregateFunction::Count:
+            total.count += partial.count;
+            break;
+        case FMAggregateFunction::Sum:
+            FMDBAddSum(total.value, partial.value);
+            break;
+        case FMAggregateFunction::Avg:
+            FMDBAddSum(total.value, partial.value);
+            total.count += partial.count;
+            break;
+        case FMAggregateFunction::Min:
+        case FMAggregateFunction::Max:
+            if (!partial.value.isNull()) {
+                int order = total.value.isNull() ? 0 : FMShardedDatabaseQueue::compareValues(partial.value, total.value);
+                bool isMin = aggregate.function == FMAggregateFunction::Min;
+                if (total.value.isNull() || (isMin ? order < 0 : order > 0)) {
+                    total.value = partial.value;
+                }
+            }
+            break;
+    }
+}
+
+static Variant FMDBFinalValue(const FMAggregate &aggregate, const __partialAggregate &total)
+{
+    switch (aggregate.function) {
+        case FMAggregateFunction::Count:
+            return Variant(total.count);
+        case FMAggregateFunction::Avg:
+            return total.count ? Variant(total.value.toDouble() / total.count) : Variant::null;
+        default:
+            return total.value;
+    }
+}
+
+FMShardedQueryResult FMParallelScan::combine(const vector<string> &groupBy, const vector<FMAggregate> &aggregates, const Query &query)
+{
+    // Each partition folds its rows into its own groups; they are merged once all partitions are done.
+    vector<__partialGroups> partitions(_partitionCount);
+    FMShardedQueryResult result;
+    result.error = run(query, [&](FMResultSet &rs, size_t index) {
+        VariantVector row = rs.resultArray();
+        VariantVector key(row.begin(), row.begin() + groupBy.size());
+        auto &totals = partitions[index][key];
+        totals.resize(aggregates.size());
+        size_t column = groupBy.size();
+        for (size_t i = 0; i < aggregates.size(); ++i) {
+            __partialAggregate partial;
+            if (aggregates[i].function == FMAggregateFunction::Count) {
+                partial.count = row[column++].toLongLong();
+            } else {
+                partial.value = row[column++];
+                if (aggregates[i].function == FMAggregateFunction::Avg) {
+                    partial.count = row[column++].toLongLong();
+                }
+            }
+            FMDBCombine(aggregates[i], totals[i], partial);
+        }
+    });
+
+    __partialGroups groups;
+    for (auto &partition : partitions) {
+        for (auto &group : partition) {
+            auto &totals = groups[group.first];
+            totals.resize(aggregates.size());
+            for (size_t i = 0; i < aggregates.size(); ++i) {
+                FMDBCombine(aggregates[i], totals[i], group.second[i]);
+            }
+        }
+    }
+    if (groupBy.empty() && groups.empty()) {
+        groups[VariantVector()].resize(aggregates.size()); // an aggregate without `group by` always has a row.
+    }
+
+    result.columnNames = groupBy;
+    for (auto &aggregate : aggregates) {
+        result.columnNames.push_back(aggregate.sql());
+    }
+    result.rows.reserve(groups.size());
+    for (auto &group : groups) {
+        VariantVector row = group.first;
+        for (size_t i = 0; i < aggregates.size(); ++i) {
+            row.push_back(FMDBFinalValue(aggregates[i], group.second[i]));
+        }
+        result.rows.push_back(std::move(row));
+    }
+    return result;
+}
+
+FMDB_END
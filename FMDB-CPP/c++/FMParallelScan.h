@@ -0,0 +1,126 @@
+//
+//  FMParallelScan.h
+//  fmdb
+//
+
+#ifndef FMParallelScan_hpp
+#define FMParallelScan_hpp
+
+#include "FMDatabasePool.h"
+#include "FMShardedDatabaseQueue.h"
+
+FMDB_BEGIN
+
+/** A closed interval of rowids. */
+struct FMRowidRange {
+    long long first;
+    long long last;
+};
+
+enum class FMAggregateFunction : int {
+    Count,
+    Sum,
+    Min,
+    Max,
+    Avg,
+};
+
+/** An aggregate column of `FMParallelScan::aggregate`, like `sum(price * quantity)`. */
+struct FMAggregate {
+    FMAggregateFunction function;
+    /** An SQL expression over the columns of the table; `*` only for `Count`. */
+    string expression;
+
+    FMAggregate(FMAggregateFunction function, const string &expression = "*") : function(function), expression(expression) {}
+
+    /** The SQL of the aggregate over the whole table, also the name of its result column. */
+    string sql() const;
+};
+
+/**
+ Scan of one table split into rowid ranges, each read on its own `<FMDatabasePool>` reader.
+
+ A scan runs on one core stepping the VDBE. Splitting the rowids between `min(rowid)` and `max(rowid)` into `partitionCount` ranges lets a statement restricted to each range run on its own reader and thread; when the pages are cached the speedup is close to linear.
+
+ The first two parameters of the statement are the bounds of the range, so that SQLite seeks straight to it:
+
+    FMParallelScan scan(pool, "log");
+    auto result = scan.executeQuery("select id, message from log where rowid between ? and ? and level = ?", 3);
+
+ The other arguments follow the bounds.
+
+ @note Each range is read in its own transaction. Commits made during the scan may be seen by some ranges and not by others.
+ @note The ranges split the rowid space evenly, not the rows: a table whose rowids cluster gets unbalanced partitions.
+ */
+class FMParallelScan
+{
+public:
+    /**
+     @param pool The pool whose readers run the partitions.
+     @param table A table with rowids.
+     @param partitionCount The number of ranges. Zero means `pool.maximumNumberOfReaders()`.
+     */
+    FMParallelScan(FMDatabasePool &pool, const string &table, size_t partitionCount = 0);
+
+    const string &table() const { return _table; }
+    size_t partitionCount() const { return _partitionCount; }
+
+    /**
+     Split the rowids of the table into at most `partitionCount` ranges, in rowid order.
+
+     @return No range for an empty table.
+     */
+    vector<FMRowidRange> partitions(Error *error = nullptr) const;
+
+    /**
+     Run the statement on every partition in parallel and stream the rows.
+
+     `block` is called on the thread of each partition, so calls for different partitions run concurrently; the rows of one partition arrive in order. The result set can only be used during the call.
+
+     @return An empty error, or the error of the first partition that failed.
+     */
+    template<typename... Args>
+    Error scan(const std::function<void(FMResultSet &row, size_t partition)> &block, const string &sql, Args... args)
+    {
+        return run([=](FMDatabase &db, const FMRowidRange &range) { return db.executeQuery(sql, range.first, range.last, args...); }, block);
+    }
+
+    /** Run the statement on every partition in parallel and gather the rows, in partition order. */
+    template<typename... Args>
+    FMShardedQueryResult executeQuery(const string &sql, Args... args)
+    {
+        return gather([=](FMDatabase &db, const FMRowidRange &range) { return db.executeQuery(sql, range.first, range.last, args...); });
+    }
+
+    /**
+     Compute aggregates over the table, grouped by `groupBy`, one partition per reader.
+
+     Each partition runs `select <groupBy>, <partial aggregates> from <table> where rowid between ? and ? and (<where>) group by <groupBy>`, then the partial rows are combined: counts and sums are added, minimums and maximums compared, and an average is the sum of its partial sums divided by the sum of its partial counts. The result has the `groupBy` columns followed by one column per aggregate, sorted by the group columns; without `groupBy` it has a single row, like SQL.
+
+        auto result = scan.aggregate({"day"}, {FMAggregate(FMAggregateFunction::Count), FMAggregate(FMAggregateFunction::Avg, "latency")}, "status = ?", 200);
+
+     @param where An optional condition, whose parameters are `args`.
+     @note Groups are compared by value with the `BINARY` collation, see `FMShardedDatabaseQueue::compareValues`. Integer sums that overflow are not detected.
+     */
+    template<typename... Args>
+    FMShardedQueryResult aggregate(const vector<string> &groupBy, const vector<FMAggregate> &aggregates, const string &where, Args... args)
+    {
+        string sql = aggregateQuery(groupBy, aggregates, where);
+        return combine(groupBy, aggregates, [=](FMDatabase &db, const FMRowidRange &range) { return db.executeQuery(sql, range.first, range.last, args...); });
+    }
+protected:
+    typedef std::function<weak_ptr<FMResultSet>(FMDatabase &db, const FMRowidRange &range)> Query;
+
+    Error run(const Query &query, const std::function<void(FMResultSet &row, size_t partition)> &block);
+    FMShardedQueryResult gather(const Query &query);
+    string aggregateQuery(const vector<string> &groupBy, const vector<FMAggregate> &aggregates, const string &where) const;
+    FMShardedQueryResult combine(const vector<string> &groupBy, const vector<FMAggregate> &aggregates, const Query &query);
+
+    FMDatabasePool &_pool;
+    string _table;
+    size_t _partitionCount;
+};
+
+FMDB_END
+
+#endif /* FMParallelScan_hpp */
@@ -53,7 +53,10 @@ bool FMResultSet::next()
 
 bool FMResultSet::nextWithError(Error *outErr/* = nullptr*/)
 {
-    int rc = sqlite3_step(_statement ? _statement->getStatement() : nullptr);
+    int rc = _statement && _parentDB ? _parentDB->stepStatement(_statement->getStatement()) : sqlite3_step(_statement ? _statement->getStatement() : nullptr);
+    if (_parentDB) {
+        _parentDB->noteResultCode(rc);
+    }
 
 	if (SQLITE_BUSY == rc || SQLITE_LOCKED == rc) {
         fprintf(stderr, "%s:%d Database busy(%s)", __FUNCTION__, __LINE__, _parentDB ? _parentDB->databasePath().c_str() : 0);
@@ -264,4 +267,20 @@ VariantMap FMResultSet::resultDictionary() const
     return map;
 }
 
+VariantVector FMResultSet::resultArray() const
+{
+    int columnCount = sqlite3_data_count(_statement->getStatement());
+
+    VariantVector values;
+    values.reserve(columnCount);
+    for (int columnIdx = 0; columnIdx < columnCount; columnIdx++) {
+        if (columnIndexIsNull(columnIdx)) {
+            values.emplace_back(Variant::null);
+        } else {
+            values.emplace_back(objectForColumnIndex(columnIdx));
+        }
+    }
+    return values;
+}
+
 FMDB_END
@@ -101,6 +101,9 @@ public:
 	const unordered_map<string, int>& columnNameToIndexMap() const;
 
     VariantMap resultDictionary() const;
+
+    /** The values of the current row by column index. `NULL` columns are null variants. */
+    VariantVector resultArray() const;
 private:
     FMDatabase *_parentDB;
     shared_ptr<FMStatement> _statement;
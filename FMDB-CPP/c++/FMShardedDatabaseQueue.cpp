@@ -0,0 +1,246 @@
+//
+//  FMShardedDatabaseQueue.cpp
+//  fmdb
+//
+
+#include "FMShardedDatabaseQueue.h"
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+
+using namespace std;
+
+FMDB_BEGIN
+
+struct __shardRows {
+    vector<string> columnNames;
+    vector<VariantVector> rows;
+    Error error;
+};
+
+struct __shardGather {
+    mutex _mutex;
+    condition_variable _condition;
+    size_t _remaining;
+    vector<__shardRows> _shards;
+
+    explicit __shardGather(size_t count) : _remaining(count), _shards(count) {}
+
+    void done()
+    {
+        lock_guard<mutex> locker(_mutex);
+        --_remaining;
+        _condition.notify_all();
+    }
+
+    void wait()
+    {
+        unique_lock<mutex> locker(_mutex);
+        _condition.wait(locker, [this]() { return _remaining == 0; });
+    }
+};
+
+// FNV-1a: unlike std::hash, the value is the same across runs, platforms and standard libraries,
+// so a key keeps its shard file.
+static unsigned long long FMDBShardHash(const unsigned char *bytes, size_t length)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static int FMDBValueClass(const Variant &value)
+{
+    switch (value.getType()) {
+        case Variant::Type::NONE:
+            return 0;
+        case Variant::Type::STRING:
+        case Variant::Type::CSTRING:
+            return 2;
+        case Variant::Type::DATA:
+            return 3;
+        case Variant::Type::DATE:
+        case Variant::Type::VARIANTVECTOR:
+        case Variant::Type::VARIANTMAP:
+        case Variant::Type::VARIANTMAPINTKEY:
+            return 4;
+        default:
+            return 1; // numbers
+    }
+}
+
+static string FMDBTextOfValue(const Variant &value)
+{
+    return value.isTypeOf(Variant::Type::CSTRING) ? string(value.toCString()) : value.toString();
+}
+
+template<typename T>
+static int FMDBCompare(const T &lhs, const T &rhs)
+{
+    return lhs < rhs ? -1 : (rhs < lhs ? 1 : 0);
+}
+
+FMShardedDatabaseQueue::FMShardedDatabaseQueue(const vector<string> &paths, int openFlags/* = 0*/, const string &vfsName/* = FMDatabase::stringNull*/)
+{
+    parameterAssert(!paths.empty());
+    _queues.reserve(paths.size());
+    for (auto &path : paths) {
+        _queues.push_back(new FMDatabaseQueue(path, openFlags, vfsName));
+    }
+}
+
+FMShardedDatabaseQueue::~FMShardedDatabaseQueue()
+{
+    close();
+    for (auto queue : _queues) {
+        delete queue;
+    }
+    _queues.clear();
+}
+
+void FMShardedDatabaseQueue::close()
+{
+    for (auto queue : _queues) {
+        queue->close();
+    }
+}
+
+size_t FMShardedDatabaseQueue::shardIndexForKey(const string &key) const
+{
+    return FMDBShardHash((const unsigned char *)key.data(), key.size()) % _queues.size();
+}
+
+size_t FMShardedDatabaseQueue::shardIndexForKey(long long key) const
+{
+    unsigned char bytes[sizeof(long long)];
+    auto value = (unsigned long long)key;
+    for (size_t i = 0; i < sizeof(bytes); ++i) {
+        bytes[i] = (unsigned char)(value >> (i * 8)); // little-endian whatever the host is.
+    }
+    return FMDBShardHash(bytes, sizeof(bytes)) % _queues.size();
+}
+
+void FMShardedDatabaseQueue::inEveryDatabase(const std::function<void (FMDatabase &, size_t)> &block)
+{
+    auto gather = make_shared<__shardGather>(_queues.size());
+    for (size_t i = 0; i < _queues.size(); ++i) {
+        FMDatabaseQueueTaskOptions options;
+        options.completion = [gather](bool, const Error &) {
+            gather->done();
+        };
+        _queues[i]->inDatabase([=](FMDatabase &db) {
+            block(db, i);
+        }, options);
+    }
+    gather->wait();
+}
+
+int FMShardedDatabaseQueue::compareValues(const Variant &lhs, const Variant &rhs)
+{
+    int lhsClass = FMDBValueClass(lhs);
+    int rhsClass = FMDBValueClass(rhs);
+    if (lhsClass != rhsClass) {
+        return lhsClass < rhsClass ? -1 : 1;
+    }
+    switch (lhsClass) {
+        case 1:
+            if (lhs.isTypeOf(Variant::Type::FLOAT) || lhs.isTypeOf(Variant::Type::DOUBLE) ||
+                rhs.isTypeOf(Variant::Type::FLOAT) || rhs.isTypeOf(Variant::Type::DOUBLE)) {
+                return FMDBCompare(lhs.toDouble(), rhs.toDouble());
+            }
+            return FMDBCompare(lhs.toLongLong(), rhs.toLongLong());
+        case 2:
+            return FMDBTextOfValue(lhs).compare(FMDBTextOfValue(rhs));
+        case 3:
+            return FMDBCompare(lhs.toVariantData(), rhs.toVariantData());
+        default:
+            return 0;
+    }
+}
+
+FMShardedQueryResult FMShardedDatabaseQueue::gather(const std::function<weak_ptr<FMResultSet> (FMDatabase &)> &query, const vector<FMShardSortColumn> &orderBy)
+{
+    // Scatter: every shard runs the query on its own queue thread.
+    auto gather = make_shared<__shardGather>(_queues.size());
+    for (size_t i = 0; i < _queues.size(); ++i) {
+        FMDatabaseQueueTaskOptions options;
+        options.completion = [gather, i](bool success, const Error &error) {
+            auto &shard = gather->_shards[i];
+            if (!success && shard.error.isEmpty()) {
+                shard.error = Error(error.domain(), error.code(), error.userInfo());
+            }
+            gather->done();
+        };
+        _queues[i]->inDatabase([gather, i, query](FMDatabase &db) {
+            auto &shard = gather->_shards[i];
+            auto rs = query(db).lock();
+            if (!rs) {
+                shard.error = db.lastError();
+                return;
+            }
+            int columnCount = rs->columnCount();
+            for (int column = 0; column < columnCount; ++column) {
+                shard.columnNames.emplace_back(rs->columnNameForIndex(column));
+            }
+            while (rs->next()) {
+                shard.rows.emplace_back(rs->resultArray());
+            }
+            rs->close();
+        }, options);
+    }
+    gather->wait();
+
+    FMShardedQueryResult result;
+    size_t rowCount = 0;
+    for (auto &shard : gather->_shards) {
+        if (!shard.error.isEmpty() && result.error.isEmpty()) {
+            result.error = std::move(shard.error);
+        }
+        if (result.columnNames.empty()) {
+            result.columnNames = shard.columnNames;
+        }
+        rowCount += shard.rows.size();
+    }
+    result.rows.reserve(rowCount);
+
+    if (orderBy.empty()) {
+        for (auto &shard : gather->_shards) {
+            std::move(shard.rows.begin(), shard.rows.end(), back_inserter(result.rows));
+        }
+        return result;
+    }
+
+    // Gather: k-way merge of the sorted runs. Ties keep shard order, so the merge is stable.
+    auto &shards = gather->_shards;
+    auto after = [&](const pair<size_t, size_t> &lhs, const pair<size_t, size_t> &rhs) {
+        auto &lhsRow = shards[lhs.first].rows[lhs.second];
+        auto &rhsRow = shards[rhs.first].rows[rhs.second];
+        for (auto &column : orderBy) {
+            int order = compareValues(lhsRow.at(column.columnIndex), rhsRow.at(column.columnIndex));
+            if (order != 0) {
+                return column.ascending ? order > 0 : order < 0;
+            }
+        }
+        return lhs.first > rhs.first;
+    };
+    priority_queue<pair<size_t, size_t>, vector<pair<size_t, size_t>>, decltype(after)> heads(after);
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (!shards[i].rows.empty()) {
+            heads.emplace(i, 0);
+        }
+    }
+    while (!heads.empty()) {
+        auto head = heads.top();
+        heads.pop();
+        result.rows.emplace_back(std::move(shards[head.first].rows[head.second]));
+        if (head.second + 1 < shards[head.first].rows.size()) {
+            heads.emplace(head.first, head.second + 1);
+        }
+    }
+    return result;
+}
+
+FMDB_END
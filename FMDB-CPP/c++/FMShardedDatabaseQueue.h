@@ -0,0 +1,129 @@
+//
+//  FMShardedDatabaseQueue.h
+//  fmdb
+//
+
+#ifndef FMShardedDatabaseQueue_hpp
+#define FMShardedDatabaseQueue_hpp
+
+#include "FMDatabaseQueue.h"
+#include "FMResultSet.h"
+#include "Error.hpp"
+
+FMDB_BEGIN
+
+/** A column of the merged rows and its direction, as in an `ORDER BY` clause. */
+struct FMShardSortColumn {
+    int columnIndex;
+    bool ascending;
+
+    FMShardSortColumn(int columnIndex, bool ascending = true) : columnIndex(columnIndex), ascending(ascending) {}
+};
+
+/** The rows a statement returned from every shard. */
+struct FMShardedQueryResult {
+    vector<string> columnNames;
+    vector<VariantVector> rows;
+    /** The error of the first shard that failed. The rows of the other shards are still returned. */
+    Error error;
+
+    bool succeeded() const { return error.isEmpty(); }
+};
+
+/** Hash-partitioned set of `<FMDatabaseQueue>` objects, one per database file.
+
+ A single queue serializes every write on one thread and one file lock. Spreading keys over several files gives each shard its own writer, so writes to different shards run in parallel.
+
+ Keyed blocks run on the queue of the key's shard:
+
+    FMShardedDatabaseQueue shards({path0, path1, path2, path3});
+
+    shards.inTransaction(userId, [=](FMDatabase &db, bool &rollback) {
+        db.executeUpdate("insert into message values (?, ?)", userId, text);
+    });
+
+ Queries over all of the data run on every shard at once and merge the rows:
+
+    auto result = shards.executeOrderedQuery({FMShardSortColumn(1, false)}, "select id, time from message order by time desc limit 20");
+
+ Keys are mapped with a stable hash, so the same key lands on the same file across runs and platforms. Changing the number of shards moves most keys: the data must be redistributed.
+
+ @warning A transaction only covers its own shard. Writes to several shards are not atomic.
+ @warning Don't call `executeQuery` or `executeOrderedQuery` from a block running on one of the shards: it waits for that shard and deadlocks.
+ */
+class FMShardedDatabaseQueue
+{
+public:
+    /**
+     Open one queue per path. The index of a path in `paths` is the shard index, so the order must stay the same across runs.
+     */
+    FMShardedDatabaseQueue(const vector<string> &paths, int openFlags = 0, const string &vfsName = FMDatabase::stringNull);
+    ~FMShardedDatabaseQueue();
+    FMShardedDatabaseQueue(const FMShardedDatabaseQueue &) = delete;
+    FMShardedDatabaseQueue& operator=(const FMShardedDatabaseQueue &) = delete;
+
+    void close();
+
+    size_t shardCount() const { return _queues.size(); }
+    FMDatabaseQueue &queueAtIndex(size_t index) { return *_queues.at(index); }
+
+    size_t shardIndexForKey(const string &key) const;
+    size_t shardIndexForKey(long long key) const;
+    size_t shardIndexForKey(const char *key) const { return shardIndexForKey(string(key)); }
+    size_t shardIndexForKey(int key) const { return shardIndexForKey((long long)key); }
+
+    /** Run `block` on the queue of the shard of `key`. */
+    template<typename Key>
+    bool inDatabase(const Key &key, const std::function<void(FMDatabase &db)> &block, const FMDatabaseQueueTaskOptions &options = FMDatabaseQueueTaskOptions())
+    {
+        return _queues[shardIndexForKey(key)]->inDatabase(block, options);
+    }
+
+    template<typename Key>
+    bool inTransaction(const Key &key, const std::function<void(FMDatabase &db, bool &rollback)> &block, const FMDatabaseQueueTaskOptions &options = FMDatabaseQueueTaskOptions())
+    {
+        return _queues[shardIndexForKey(key)]->inTransaction(block, options);
+    }
+
+    template<typename Key>
+    bool inDeferredTransaction(const Key &key, const std::function<void(FMDatabase &db, bool &rollback)> &block, const FMDatabaseQueueTaskOptions &options = FMDatabaseQueueTaskOptions())
+    {
+        return _queues[shardIndexForKey(key)]->inDeferredTransaction(block, options);
+    }
+
+    /** Run `block` once on every shard; the blocks of different shards run in parallel. Returns after all of them finished. */
+    void inEveryDatabase(const std::function<void(FMDatabase &db, size_t shardIndex)> &block);
+
+    /**
+     Run a query on every shard in parallel and gather the rows. Blocks until all shards answered.
+
+     The rows are grouped by shard, in shard order.
+     */
+    template<typename... Args>
+    FMShardedQueryResult executeQuery(const string &sql, Args... args)
+    {
+        return gather([=](FMDatabase &db) { return db.executeQuery(sql, args...); }, {});
+    }
+
+    /**
+     Run a query on every shard in parallel and merge the rows in order.
+
+     Every shard must return its rows sorted by `orderBy`, normally with the same `ORDER BY` clause; the sorted runs are then merged k-way. A `LIMIT n` in the statement applies per shard, so the merged result may need to be cut to `n` rows again. Values compare as in SQLite with the `BINARY` collation: `NULL` first, then numbers, text, and blobs.
+     */
+    template<typename... Args>
+    FMShardedQueryResult executeOrderedQuery(const vector<FMShardSortColumn> &orderBy, const string &sql, Args... args)
+    {
+        return gather([=](FMDatabase &db) { return db.executeQuery(sql, args...); }, orderBy);
+    }
+
+    /** Compare two column values the way SQLite sorts them. Returns a negative number, zero or a positive number. */
+    static int compareValues(const Variant &lhs, const Variant &rhs);
+private:
+    FMShardedQueryResult gather(const std::function<weak_ptr<FMResultSet>(FMDatabase &db)> &query, const vector<FMShardSortColumn> &orderBy);
+
+    vector<FMDatabaseQueue *> _queues;
+};
+
+FMDB_END
+
+#endif /* FMShardedDatabaseQueue_hpp */
@@ -0,0 +1,368 @@
+//
+//  FMShimVFS.cpp
+//  fmdb
+//
+
+#include "FMShimVFS.h"
+#include <sqlite3.h>
+#include <atomic>
+#include <cstring>
+
+using namespace std;
+
+FMDB_BEGIN
+
+struct __FMShimVFSPacket {
+    sqlite3_vfs vfs;
+    sqlite3_vfs *base = nullptr;
+    string name;
+    string baseName;
+    FMShimVFS *shim = nullptr;
+
+    /* The file methods going through the virtual functions of the shim. */
+    static int read(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset);
+    static int write(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset);
+    static int sync(sqlite3_file *file, int flags);
+    static int lock(sqlite3_file *file, int lock);
+};
+
+/** The `sqlite3_file` of the shim, followed in memory by the one of the wrapped VFS. */
+struct FMDBShimFile {
+    sqlite3_file base;
+    sqlite3_file *real;
+    __FMShimVFSPacket *packet;
+    FMShimFileKind kind;
+};
+
+static FMShimFileKind FMDBShimFileKindForFlags(int flags)
+{
+    if (flags & SQLITE_OPEN_MAIN_DB) {
+        return FMShimFileKind::MainDatabase;
+    }
+    if (flags & SQLITE_OPEN_WAL) {
+        return FMShimFileKind::WAL;
+    }
+    if (flags & SQLITE_OPEN_MAIN_JOURNAL) {
+        return FMShimFileKind::Journal;
+    }
+    return FMShimFileKind::Other;
+}
+
+static sqlite3_file *FMDBShimRealFile(sqlite3_file *file)
+{
+    return ((FMDBShimFile *)file)->real;
+}
+
+#pragma mark File methods
+
+static int FMDBShimClose(sqlite3_file *file)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    int rc = real->pMethods->xClose(real);
+    file->pMethods = nullptr;
+    return rc;
+}
+
+int __FMShimVFSPacket::read(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset)
+{
+    auto shimFile = (FMDBShimFile *)file;
+    return shimFile->packet->shim->read(shimFile->real, shimFile->kind, buffer, amount, offset);
+}
+
+int __FMShimVFSPacket::write(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset)
+{
+    auto shimFile = (FMDBShimFile *)file;
+    return shimFile->packet->shim->write(shimFile->real, shimFile->kind, buffer, amount, offset);
+}
+
+int __FMShimVFSPacket::sync(sqlite3_file *file, int flags)
+{
+    auto shimFile = (FMDBShimFile *)file;
+    return shimFile->packet->shim->sync(shimFile->real, shimFile->kind, flags);
+}
+
+int __FMShimVFSPacket::lock(sqlite3_file *file, int lock)
+{
+    auto shimFile = (FMDBShimFile *)file;
+    return shimFile->packet->shim->lock(shimFile->real, shimFile->kind, lock);
+}
+
+static int FMDBShimTruncate(sqlite3_file *file, sqlite3_int64 size)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xTruncate(real, size);
+}
+
+static int FMDBShimFileSize(sqlite3_file *file, sqlite3_int64 *size)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xFileSize(real, size);
+}
+
+static int FMDBShimUnlock(sqlite3_file *file, int lock)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xUnlock(real, lock);
+}
+
+static int FMDBShimCheckReservedLock(sqlite3_file *file, int *result)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xCheckReservedLock(real, result);
+}
+
+static int FMDBShimFileControl(sqlite3_file *file, int op, void *argument)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xFileControl(real, op, argument);
+}
+
+static int FMDBShimSectorSize(sqlite3_file *file)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xSectorSize(real);
+}
+
+static int FMDBShimDeviceCharacteristics(sqlite3_file *file)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xDeviceCharacteristics(real);
+}
+
+static int FMDBShimShmMap(sqlite3_file *file, int region, int size, int extend, void volatile **memory)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xShmMap(real, region, size, extend, memory);
+}
+
+static int FMDBShimShmLock(sqlite3_file *file, int offset, int n, int flags)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xShmLock(real, offset, n, flags);
+}
+
+static void FMDBShimShmBarrier(sqlite3_file *file)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    real->pMethods->xShmBarrier(real);
+}
+
+static int FMDBShimShmUnmap(sqlite3_file *file, int deleteFlag)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xShmUnmap(real, deleteFlag);
+}
+
+static int FMDBShimFetch(sqlite3_file *file, sqlite3_int64 offset, int amount, void **pointer)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xFetch(real, offset, amount, pointer);
+}
+
+static int FMDBShimUnfetch(sqlite3_file *file, sqlite3_int64 offset, void *pointer)
+{
+    sqlite3_file *real = FMDBShimRealFile(file);
+    return real->pMethods->xUnfetch(real, offset, pointer);
+}
+
+/** The methods of the shim for a wrapped file of methods version `version`: SQLite must not call methods the wrapped file lacks. */
+static const sqlite3_io_methods *FMDBShimMethods(int version)
+{
+    static const sqlite3_io_methods methods[3] = {
+        {1, FMDBShimClose, __FMShimVFSPacket::read, __FMShimVFSPacket::write, FMDBShimTruncate, __FMShimVFSPacket::sync, FMDBShimFileSize, __FMShimVFSPacket::lock, FMDBShimUnlock, FMDBShimCheckReservedLock, FMDBShimFileControl, FMDBShimSectorSize, FMDBShimDeviceCharacteristics,
+            nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},
+        {2, FMDBShimClose, __FMShimVFSPacket::read, __FMShimVFSPacket::write, FMDBShimTruncate, __FMShimVFSPacket::sync, FMDBShimFileSize, __FMShimVFSPacket::lock, FMDBShimUnlock, FMDBShimCheckReservedLock, FMDBShimFileControl, FMDBShimSectorSize, FMDBShimDeviceCharacteristics,
+            FMDBShimShmMap, FMDBShimShmLock, FMDBShimShmBarrier, FMDBShimShmUnmap, nullptr, nullptr},
+        {3, FMDBShimClose, __FMShimVFSPacket::read, __FMShimVFSPacket::write, FMDBShimTruncate, __FMShimVFSPacket::sync, FMDBShimFileSize, __FMShimVFSPacket::lock, FMDBShimUnlock, FMDBShimCheckReservedLock, FMDBShimFileControl, FMDBShimSectorSize, FMDBShimDeviceCharacteristics,
+            FMDBShimShmMap, FMDBShimShmLock, FMDBShimShmBarrier, FMDBShimShmUnmap, FMDBShimFetch, FMDBShimUnfetch},
+    };
+    return &methods[std::min(std::max(version, 1), 3) - 1];
+}
+
+#pragma mark VFS methods
+
+static sqlite3_vfs *FMDBShimBase(sqlite3_vfs *vfs)
+{
+    return ((__FMShimVFSPacket *)vfs->pAppData)->base;
+}
+
+static int FMDBShimOpen(sqlite3_vfs *vfs, const char *name, sqlite3_file *file, int flags, int *outFlags)
+{
+    auto packet = (__FMShimVFSPacket *)vfs->pAppData;
+    auto shimFile = (FMDBShimFile *)file;
+    shimFile->real = (sqlite3_file *)(shimFile + 1);
+    shimFile->packet = packet;
+    shimFile->kind = FMDBShimFileKindForFlags(flags);
+    int rc = packet->base->xOpen(packet->base, name, shimFile->real, flags, outFlags);
+    // SQLite calls xClose after a failed open when pMethods is set, so it mirrors the wrapped file.
+    shimFile->base.pMethods = shimFile->real->pMethods ? FMDBShimMethods(shimFile->real->pMethods->iVersion) : nullptr;
+    return rc;
+}
+
+static int FMDBShimDelete(sqlite3_vfs *vfs, const char *name, int syncDirectory)
+{
+    return FMDBShimBase(vfs)->xDelete(FMDBShimBase(vfs), name, syncDirectory);
+}
+
+static int FMDBShimAccess(sqlite3_vfs *vfs, const char *name, int flags, int *result)
+{
+    return FMDBShimBase(vfs)->xAccess(FMDBShimBase(vfs), name, flags, result);
+}
+
+static int FMDBShimFullPathname(sqlite3_vfs *vfs, const char *name, int size, char *output)
+{
+    return FMDBShimBase(vfs)->xFullPathname(FMDBShimBase(vfs), name, size, output);
+}
+
+static void *FMDBShimDlOpen(sqlite3_vfs *vfs, const char *filename)
+{
+    return FMDBShimBase(vfs)->xDlOpen(FMDBShimBase(vfs), filename);
+}
+
+static void FMDBShimDlError(sqlite3_vfs *vfs, int size, char *message)
+{
+    FMDBShimBase(vfs)->xDlError(FMDBShimBase(vfs), size, message);
+}
+
+static void (*FMDBShimDlSym(sqlite3_vfs *vfs, void *handle, const char *symbol))(void)
+{
+    return FMDBShimBase(vfs)->xDlSym(FMDBShimBase(vfs), handle, symbol);
+}
+
+static void FMDBShimDlClose(sqlite3_vfs *vfs, void *handle)
+{
+    FMDBShimBase(vfs)->xDlClose(FMDBShimBase(vfs), handle);
+}
+
+static int FMDBShimRandomness(sqlite3_vfs *vfs, int size, char *output)
+{
+    return FMDBShimBase(vfs)->xRandomness(FMDBShimBase(vfs), size, output);
+}
+
+static int FMDBShimSleep(sqlite3_vfs *vfs, int microseconds)
+{
+    return FMDBShimBase(vfs)->xSleep(FMDBShimBase(vfs), microseconds);
+}
+
+static int FMDBShimCurrentTime(sqlite3_vfs *vfs, double *time)
+{
+    return FMDBShimBase(vfs)->xCurrentTime(FMDBShimBase(vfs), time);
+}
+
+static int FMDBShimGetLastError(sqlite3_vfs *vfs, int size, char *message)
+{
+    return FMDBShimBase(vfs)->xGetLastError ? FMDBShimBase(vfs)->xGetLastError(FMDBShimBase(vfs), size, message) : 0;
+}
+
+static int FMDBShimCurrentTimeInt64(sqlite3_vfs *vfs, sqlite3_int64 *time)
+{
+    return FMDBShimBase(vfs)->xCurrentTimeInt64(FMDBShimBase(vfs), time);
+}
+
+static int FMDBShimSetSystemCall(sqlite3_vfs *vfs, const char *name, sqlite3_syscall_ptr call)
+{
+    return FMDBShimBase(vfs)->xSetSystemCall(FMDBShimBase(vfs), name, call);
+}
+
+static sqlite3_syscall_ptr FMDBShimGetSystemCall(sqlite3_vfs *vfs, const char *name)
+{
+    return FMDBShimBase(vfs)->xGetSystemCall(FMDBShimBase(vfs), name);
+}
+
+static const char *FMDBShimNextSystemCall(sqlite3_vfs *vfs, const char *name)
+{
+    return FMDBShimBase(vfs)->xNextSystemCall(FMDBShimBase(vfs), name);
+}
+
+#pragma mark FMShimVFS
+
+FMShimVFS::FMShimVFS(const string &baseName, const string &prefix)
+:_packet(new struct __FMShimVFSPacket)
+{
+    static std::atomic<unsigned> FMDBShimCount(0);
+
+    _packet->shim = this;
+    _packet->baseName = baseName;
+    _packet->name = prefix + std::to_string(++FMDBShimCount);
+    _packet->base = sqlite3_vfs_find(baseName.empty() ? nullptr : baseName.c_str());
+    if (!_packet->base) {
+        return;
+    }
+
+    sqlite3_vfs *base = _packet->base;
+    sqlite3_vfs &vfs = _packet->vfs;
+    memset(&vfs, 0, sizeof(vfs));
+    vfs.iVersion = std::min(base->iVersion, 3);
+    vfs.szOsFile = (int)sizeof(FMDBShimFile) + base->szOsFile;
+    vfs.mxPathname = base->mxPathname;
+    vfs.zName = _packet->name.c_str();
+    vfs.pAppData = _packet;
+    vfs.xOpen = FMDBShimOpen;
+    vfs.xDelete = FMDBShimDelete;
+    vfs.xAccess = FMDBShimAccess;
+    vfs.xFullPathname = FMDBShimFullPathname;
+    vfs.xDlOpen = base->xDlOpen ? FMDBShimDlOpen : nullptr;
+    vfs.xDlError = base->xDlError ? FMDBShimDlError : nullptr;
+    vfs.xDlSym = base->xDlSym ? FMDBShimDlSym : nullptr;
+    vfs.xDlClose = base->xDlClose ? FMDBShimDlClose : nullptr;
+    vfs.xRandomness = FMDBShimRandomness;
+    vfs.xSleep = FMDBShimSleep;
+    vfs.xCurrentTime = FMDBShimCurrentTime;
+    vfs.xGetLastError = FMDBShimGetLastError;
+    if (vfs.iVersion >= 2) {
+        vfs.xCurrentTimeInt64 = base->xCurrentTimeInt64 ? FMDBShimCurrentTimeInt64 : nullptr;
+    }
+    if (vfs.iVersion >= 3) {
+        vfs.xSetSystemCall = base->xSetSystemCall ? FMDBShimSetSystemCall : nullptr;
+        vfs.xGetSystemCall = base->xGetSystemCall ? FMDBShimGetSystemCall : nullptr;
+        vfs.xNextSystemCall = base->xNextSystemCall ? FMDBShimNextSystemCall : nullptr;
+    }
+    if (sqlite3_vfs_register(&vfs, 0) != SQLITE_OK) {
+        _packet->base = nullptr;
+    }
+}
+
+FMShimVFS::~FMShimVFS()
+{
+    if (_packet->base) {
+        sqlite3_vfs_unregister(&_packet->vfs);
+    }
+    delete _packet;
+}
+
+bool FMShimVFS::isRegistered() const
+{
+    return _packet->base != nullptr;
+}
+
+const string &FMShimVFS::name() const
+{
+    return _packet->name;
+}
+
+const string &FMShimVFS::baseName() const
+{
+    return _packet->baseName;
+}
+
+int FMShimVFS::read(sqlite3_file *file, FMShimFileKind, void *buffer, int amount, long long offset)
+{
+    return file->pMethods->xRead(file, buffer, amount, offset);
+}
+
+int FMShimVFS::write(sqlite3_file *file, FMShimFileKind, const void *buffer, int amount, long long offset)
+{
+    return file->pMethods->xWrite(file, buffer, amount, offset);
+}
+
+int FMShimVFS::sync(sqlite3_file *file, FMShimFileKind, int flags)
+{
+    return file->pMethods->xSync(file, flags);
+}
+
+int FMShimVFS::lock(sqlite3_file *file, FMShimFileKind, int lock)
+{
+    return file->pMethods->xLock(file, lock);
+}
+
+FMDB_END
@@ -0,0 +1,62 @@
+//
+//  FMShimVFS.h
+//  fmdb
+//
+
+#ifndef FMShimVFS_hpp
+#define FMShimVFS_hpp
+
+#include "FMDBDefs.h"
+
+typedef struct sqlite3_file sqlite3_file;
+
+FMDB_BEGIN
+
+enum class FMShimFileKind : int {
+    MainDatabase,
+    WAL,
+    /** The rollback journal. */
+    Journal,
+    /** Temporary databases, statement journals and super-journals. */
+    Other,
+};
+
+struct __FMShimVFSPacket;
+
+/**
+ A VFS handing every call to another one, registered under a unique name to give to `FMDatabase::openWithFlags`.
+
+ Subclasses observe or alter the file operations by overriding `read`, `write`, `sync` and `lock`. Each receives the file of the wrapped VFS, and the default implementations call it. Shims stack: the base VFS can be another shim.
+
+ @warning Close the connections using the VFS before destroying it.
+ */
+class FMShimVFS
+{
+public:
+    virtual ~FMShimVFS();
+    FMShimVFS(const FMShimVFS &) = delete;
+    FMShimVFS& operator=(const FMShimVFS &) = delete;
+
+    /** `false` when `baseName` is not a registered VFS. */
+    bool isRegistered() const;
+    /** The name to give to `openWithFlags`. */
+    const string &name() const;
+    /** The wrapped VFS; empty for the default one, which is `unix` or `win32`. */
+    const string &baseName() const;
+protected:
+    /** @param prefix The name is `prefix` followed by a number. */
+    FMShimVFS(const string &baseName, const string &prefix);
+
+    /* The methods of `sqlite3_io_methods`, called from the threads of the connections. */
+    virtual int read(sqlite3_file *file, FMShimFileKind kind, void *buffer, int amount, long long offset);
+    virtual int write(sqlite3_file *file, FMShimFileKind kind, const void *buffer, int amount, long long offset);
+    virtual int sync(sqlite3_file *file, FMShimFileKind kind, int flags);
+    virtual int lock(sqlite3_file *file, FMShimFileKind kind, int lock);
+private:
+    friend struct __FMShimVFSPacket;
+    __FMShimVFSPacket *_packet;
+};
+
+FMDB_END
+
+#endif /* FMShimVFS_hpp */
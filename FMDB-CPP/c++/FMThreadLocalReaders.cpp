@@ -0,0 +1,194 @@
+//
+//  FMThreadLocalReaders.cpp
+//  fmdb
+//
+
+#include "FMThreadLocalReaders.h"
+#include <sqlite3.h>
+#include <mutex>
+#include <unordered_set>
+
+using namespace std;
+
+FMDB_BEGIN
+
+struct __threadLocalReadersPacket {
+    mutable mutex _mutex;
+    /** The thread connections still open; the threads only keep a weak reference to this packet. */
+    unordered_set<FMDatabase *> _connections;
+    size_t _openingCount = 0;
+    recursive_mutex _overflowMutex;
+    FMDatabase *_overflow = nullptr;
+    int _overflowDepth = 0;
+    unsigned long long _overflowCount = 0;
+
+    /** Close `db` unless the readers were destroyed, or released it, first. */
+    void close(FMDatabase *db)
+    {
+        lock_guard<mutex> locker(_mutex);
+        if (_connections.erase(db)) {
+            delete db;
+        }
+    }
+};
+
+struct __threadReader {
+    weak_ptr<__threadLocalReadersPacket> packet;
+    FMDatabase *db;
+    int depth;
+};
+
+/** The connections of one thread, closed when the thread exits. */
+struct __threadReaders {
+    unordered_map<const void *, __threadReader> readers;
+
+    ~__threadReaders()
+    {
+        for (auto &pair : readers) {
+            auto packet = pair.second.packet.lock();
+            if (packet) {
+                packet->close(pair.second.db);
+            }
+        }
+    }
+};
+
+static thread_local __threadReaders FMDBThreadReaders;
+
+FMThreadLocalReaders::FMThreadLocalReaders(const string &path, int maximumNumberOfConnections/* = 8*/, const string &vfsName/* = FMDatabase::stringNull*/)
+:_path(path)
+,_vfsName(vfsName)
+,_maximumNumberOfConnections(maximumNumberOfConnections)
+,_shouldCacheStatements(true)
+,_packet(make_shared<__threadLocalReadersPacket>())
+{
+    parameterAssert(path.length());
+    parameterAssert(maximumNumberOfConnections > 0);
+}
+
+FMThreadLocalReaders::~FMThreadLocalReaders()
+{
+    {
+        lock_guard<mutex> locker(_packet->_mutex);
+        for (auto db : _packet->_connections) {
+            delete db;
+        }
+        _packet->_connections.clear();
+    }
+    delete _packet->_overflow;
+    _packet->_overflow = nullptr;
+    FMDBThreadReaders.readers.erase(_packet.get());
+}
+
+void FMThreadLocalReaders::setShouldCacheStatements(bool value)
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    _shouldCacheStatements = value;
+}
+
+FMDatabase *FMThreadLocalReaders::openReader() const
+{
+    FMDatabase *db = new FMDatabase(_path);
+    // The connection never leaves its thread, so skip SQLite's connection mutex.
+    int flags = SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX;
+    if (!db->openWithFlags(flags, _vfsName.empty() ? FMDatabase::stringNull : _vfsName)) {
+        fprintf(stderr, "Could not open thread reader for path %s\n", _path.c_str());
+        delete db;
+        return nullptr;
+    }
+    return db;
+}
+
+FMDatabase *FMThreadLocalReaders::threadDatabase()
+{
+    auto &readers = FMDBThreadReaders.readers;
+    auto iter = readers.find(_packet.get());
+    if (iter != readers.end()) {
+        if (!iter->second.packet.expired()) {
+            return iter->second.db;
+        }
+        readers.erase(iter); // left by destroyed readers which lived at the same address.
+    }
+
+    bool shouldCacheStatements;
+    {
+        lock_guard<mutex> locker(_packet->_mutex);
+        if (_packet->_connections.size() + _packet->_openingCount >= (size_t)_maximumNumberOfConnections) {
+            return nullptr;
+        }
+        ++_packet->_openingCount; // reserve the slot while opening outside the lock.
+        shouldCacheStatements = _shouldCacheStatements;
+    }
+    FMDatabase *db = openReader();
+    lock_guard<mutex> locker(_packet->_mutex);
+    --_packet->_openingCount;
+    if (!db) {
+        return nullptr;
+    }
+    db->setShouldCacheStatements(shouldCacheStatements);
+    _packet->_connections.insert(db);
+    readers[_packet.get()] = __threadReader{_packet, db, 0};
+    return db;
+}
+
+void FMThreadLocalReaders::releaseThreadDatabase()
+{
+    auto &readers = FMDBThreadReaders.readers;
+    auto iter = readers.find(_packet.get());
+    if (iter == readers.end()) {
+        return;
+    }
+    _assert(iter->second.depth == 0, "The connection of a thread can't be released inside one of its blocks.");
+    if (!iter->second.packet.expired()) {
+        _packet->close(iter->second.db);
+    }
+    readers.erase(iter);
+}
+
+bool FMThreadLocalReaders::inReadDatabase(const std::function<void (FMDatabase &)> &block)
+{
+    FMDatabase *db = threadDatabase();
+    if (db) {
+        int &depth = FMDBThreadReaders.readers[_packet.get()].depth;
+        ++depth;
+        block(*db);
+        if (--depth == 0) {
+            db->closeOpenResultSets();
+        }
+        return true;
+    }
+
+    lock_guard<recursive_mutex> locker(_packet->_overflowMutex);
+    if (!_packet->_overflow) {
+        _packet->_overflow = openReader();
+        if (!_packet->_overflow) {
+            return false;
+        }
+        _packet->_overflow->setShouldCacheStatements(shouldCacheStatements());
+    }
+    {
+        lock_guard<mutex> locker(_packet->_mutex);
+        ++_packet->_overflowCount;
+    }
+    FMDatabase *overflow = _packet->_overflow;
+    ++_packet->_overflowDepth;
+    block(*overflow);
+    if (--_packet->_overflowDepth == 0) {
+        overflow->closeOpenResultSets();
+    }
+    return true;
+}
+
+size_t FMThreadLocalReaders::countOfOpenDatabases() const
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    return _packet->_connections.size();
+}
+
+unsigned long long FMThreadLocalReaders::overflowCount() const
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    return _packet->_overflowCount;
+}
+
+FMDB_END
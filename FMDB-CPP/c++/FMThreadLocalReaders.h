@@ -0,0 +1,89 @@
+//
+//  FMThreadLocalReaders.h
+//  fmdb
+//
+
+#ifndef FMThreadLocalReaders_hpp
+#define FMThreadLocalReaders_hpp
+
+#include "FMDatabase.h"
+
+FMDB_BEGIN
+
+/**
+ Read-only connections owned by the threads that use them.
+
+ The first read of a thread opens a private `<FMDatabase>` with `SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX`. The thread keeps it, with its statement cache, until it exits: reads never wait for a shared queue, a checkout or SQLite's connection mutex.
+
+    FMThreadLocalReaders readers(path, 8);
+
+    // on any thread:
+    readers.inReadDatabase([](FMDatabase &db) {
+        auto rs = db.executeQuery("select * from foo").lock();
+        while (rs->next()) {
+            //…
+        }
+    });
+
+ At most `maximumNumberOfConnections` thread connections are open at once. Threads arriving after that share one overflow connection, one at a time, until a thread holding a connection exits or calls `releaseThreadDatabase`.
+
+ Like `<FMDatabasePool>` readers, the connections only see the last commit of a writer without blocking it when the database is in WAL mode.
+
+ @warning The readers must outlive the blocks running on them. Destroying them closes the connections of every thread.
+ */
+class FMThreadLocalReaders
+{
+public:
+    /**
+     @param path The database path.
+     @param maximumNumberOfConnections The maximum number of thread connections, the overflow connection not included.
+     @param vfsName The VFS of every connection.
+     */
+    FMThreadLocalReaders(const string &path, int maximumNumberOfConnections = 8, const string &vfsName = FMDatabase::stringNull);
+    ~FMThreadLocalReaders();
+    FMThreadLocalReaders(const FMThreadLocalReaders &) = delete;
+    FMThreadLocalReaders& operator=(const FMThreadLocalReaders &) = delete;
+
+    const string &databasePath() const { return _path; }
+    int maximumNumberOfConnections() const { return _maximumNumberOfConnections; }
+
+    /** Whether new connections cache their prepared statements. Defaults to `true`. */
+    bool shouldCacheStatements() const { return _shouldCacheStatements; }
+    void setShouldCacheStatements(bool value);
+
+    /**
+     Run `block` on the connection of the calling thread, or on the overflow connection if none can be opened.
+
+     Blocks can be nested on one thread. The result sets left open are closed when the outermost block returns, so a connection doesn't keep an old snapshot.
+
+     @return `false` if no connection could be opened.
+     */
+    bool inReadDatabase(const std::function<void(FMDatabase &db)> &block);
+
+    /**
+     The connection of the calling thread, opened if needed.
+
+     @return `nullptr` if `maximumNumberOfConnections` threads already have one, or if it could not be opened.
+     */
+    FMDatabase *threadDatabase();
+    /** Close the connection of the calling thread before the thread exits, leaving its slot to another thread. */
+    void releaseThreadDatabase();
+
+    /** The number of thread connections open. */
+    size_t countOfOpenDatabases() const;
+    /** The number of blocks run on the overflow connection. */
+    unsigned long long overflowCount() const;
+private:
+    FMDatabase *openReader() const;
+
+    string _path;
+    string _vfsName;
+    int _maximumNumberOfConnections;
+    bool _shouldCacheStatements;
+    friend struct __threadLocalReadersPacket;
+    shared_ptr<struct __threadLocalReadersPacket> _packet;
+};
+
+FMDB_END
+
+#endif /* FMThreadLocalReaders_hpp */
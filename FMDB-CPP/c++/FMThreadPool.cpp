@@ -0,0 +1,133 @@
+//
+//  FMThreadPool.cpp
+//  FMDB-CPP
+//
+
+#include "FMThreadPool.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+using namespace std;
+
+FMDB_BEGIN
+
+struct __workerDeque {
+    mutex _mutex;
+    deque<function<void()>> _tasks;
+};
+
+struct __threadPoolPacket {
+    size_t _count;
+    vector<thread> _threads;
+    unique_ptr<__workerDeque[]> _deques;
+    mutex _mutex;
+    condition_variable _condition;
+    atomic<size_t> _pending;
+    atomic<size_t> _nextDeque;
+    bool _stop = false;
+
+    explicit __threadPoolPacket(size_t count) : _count(count), _deques(new __workerDeque[count]), _pending(0), _nextDeque(0) {}
+};
+
+static thread_local const FMThreadPool *FMDBCurrentThreadPool = nullptr;
+static thread_local size_t FMDBCurrentWorkerIndex = 0;
+
+FMThreadPool::FMThreadPool(size_t threadCount/* = 0*/)
+:_stolenTaskCount(0)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(thread::hardware_concurrency(), 1u);
+    }
+    _packet = new __threadPoolPacket(threadCount);
+    _packet->_threads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        _packet->_threads.emplace_back(&FMThreadPool::run, this, i);
+    }
+}
+
+FMThreadPool::~FMThreadPool()
+{
+    {
+        lock_guard<mutex> locker(_packet->_mutex);
+        _packet->_stop = true;
+    }
+    _packet->_condition.notify_all();
+    for (auto &worker : _packet->_threads) {
+        worker.join();
+    }
+    delete _packet;
+    _packet = nullptr;
+}
+
+size_t FMThreadPool::threadCount() const
+{
+    return _packet->_count;
+}
+
+void FMThreadPool::async(const std::function<void ()> &task)
+{
+    size_t count = _packet->_count;
+    size_t index = FMDBCurrentThreadPool == this ? FMDBCurrentWorkerIndex : _packet->_nextDeque.fetch_add(1, memory_order_relaxed) % count;
+    {
+        // Counting under the lock pairs with the check in `run`, so a worker can't miss the wake up.
+        // Count before pushing: a worker may take the task as soon as it is in the deque.
+        lock_guard<mutex> locker(_packet->_mutex);
+        _packet->_pending.fetch_add(1, memory_order_relaxed);
+    }
+    {
+        auto &queue = _packet->_deques[index];
+        lock_guard<mutex> locker(queue._mutex);
+        queue._tasks.push_back(task);
+    }
+    _packet->_condition.notify_one();
+}
+
+bool FMThreadPool::take(size_t index, std::function<void ()> &task)
+{
+    size_t count = _packet->_count;
+    for (size_t i = 0; i < count; ++i) {
+        size_t victim = (index + i) % count;
+        auto &queue = _packet->_deques[victim];
+        lock_guard<mutex> locker(queue._mutex);
+        if (queue._tasks.empty()) {
+            continue;
+        }
+        if (victim == index) {
+            task = std::move(queue._tasks.back());
+            queue._tasks.pop_back();
+        } else {
+            task = std::move(queue._tasks.front());
+            queue._tasks.pop_front();
+            _stolenTaskCount.fetch_add(1, memory_order_relaxed);
+        }
+        _packet->_pending.fetch_sub(1, memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void FMThreadPool::run(size_t index)
+{
+    FMDBCurrentThreadPool = this;
+    FMDBCurrentWorkerIndex = index;
+
+    function<void()> task;
+    while (true) {
+        if (take(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        unique_lock<mutex> locker(_packet->_mutex);
+        _packet->_condition.wait(locker, [this]() {
+            return _packet->_stop || _packet->_pending.load(memory_order_relaxed) > 0;
+        });
+        if (_packet->_stop && _packet->_pending.load(memory_order_relaxed) == 0) {
+            return;
+        }
+    }
+}
+
+FMDB_END
@@ -0,0 +1,48 @@
+//
+//  FMThreadPool.hpp
+//  FMDB-CPP
+//
+
+#ifndef FMThreadPool_hpp
+#define FMThreadPool_hpp
+
+#include "FMDBDefs.h"
+#include <atomic>
+#include <functional>
+
+FMDB_BEGIN
+
+struct __threadPoolPacket;
+
+/**
+ Fixed-size pool of worker threads with work stealing.
+
+ Each worker owns a deque. A task submitted from a worker goes to the back of that worker's deque and is run last-in first-out, while its data is still in cache; tasks submitted from other threads are spread over the workers in turn. An idle worker steals from the front of the other deques, so one slow task doesn't hold back the tasks queued behind it.
+ */
+class FMThreadPool
+{
+public:
+    /** @param threadCount The number of workers. Zero means one per hardware thread. */
+    explicit FMThreadPool(size_t threadCount = 0);
+    /** Run the tasks still queued, then join the workers. */
+    ~FMThreadPool();
+    FMThreadPool(const FMThreadPool &) = delete;
+    FMThreadPool& operator=(const FMThreadPool &) = delete;
+
+    void async(const std::function<void()> &task);
+
+    size_t threadCount() const;
+    /** The number of tasks a worker took from the deque of another worker. */
+    unsigned long long stolenTaskCount() const { return _stolenTaskCount.load(std::memory_order_relaxed); }
+private:
+    void run(size_t index);
+    bool take(size_t index, std::function<void()> &task);
+
+    friend struct __threadPoolPacket;
+    __threadPoolPacket *_packet;
+    std::atomic<unsigned long long> _stolenTaskCount;
+};
+
+FMDB_END
+
+#endif /* FMThreadPool_hpp */
@@ -0,0 +1,123 @@
+//
+//  FMVacuumScheduler.cpp
+//  fmdb
+//
+
+#include "FMVacuumScheduler.h"
+#include <sqlite3.h>
+#include <mutex>
+
+using namespace std;
+using namespace std::chrono;
+
+FMDB_BEGIN
+
+enum {
+    FMDBAutoVacuumNone = 0,
+    FMDBAutoVacuumFull = 1,
+    FMDBAutoVacuumIncremental = 2,
+};
+
+struct __vacuumSchedulerPacket {
+    mutable mutex _mutex;
+    FMVacuumPolicy _policy;
+    FMVacuumStatistics _statistics;
+
+    /** Called on the queue thread while it is idle. */
+    bool idle(FMDatabase &db)
+    {
+        FMVacuumPolicy policy;
+        {
+            lock_guard<mutex> locker(_mutex);
+            policy = _policy;
+        }
+        if (policy.pagesPerSlice <= 0 || db.inTransaction()) {
+            return false;
+        }
+
+        int freePages = db.intForQuery("pragma freelist_count");
+        if (freePages <= policy.minimumFreePages) {
+            lock_guard<mutex> locker(_mutex);
+            _statistics.freePages = freePages;
+            return false;
+        }
+
+        int pages = std::min(policy.pagesPerSlice, freePages - policy.minimumFreePages);
+        auto start = steady_clock::now();
+        // The pragma returns a row per page moved: step it to the end.
+        bool success = db.executeStatements("pragma incremental_vacuum(" + std::to_string(pages) + ")");
+        TimeInterval duration = steady_clock::now() - start;
+        int remainingPages = db.intForQuery("pragma freelist_count");
+
+        lock_guard<mutex> locker(_mutex);
+        _statistics.freePages = remainingPages;
+        if (!success) {
+            return false;
+        }
+        ++_statistics.slices;
+        if (remainingPages < freePages) {
+            _statistics.pagesFreed += freePages - remainingPages;
+        }
+        _statistics.lastSliceTime = duration;
+        _statistics.totalSliceTime += duration;
+        _statistics.longestSliceTime = std::max(_statistics.longestSliceTime, duration);
+        // Another slice after the waiting tasks, as long as this one made progress.
+        return remainingPages < freePages && remainingPages > policy.minimumFreePages;
+    }
+};
+
+FMVacuumScheduler::FMVacuumScheduler(FMDatabaseQueue &queue, const FMVacuumPolicy &policy/* = FMVacuumPolicy()*/)
+:_queue(queue)
+,_idleHandler(0)
+,_packet(new struct __vacuumSchedulerPacket)
+{
+    _packet->_policy = policy;
+    queue.inDatabase([](FMDatabase &db) {
+        int mode = db.intForQuery("pragma auto_vacuum");
+        if (mode == FMDBAutoVacuumIncremental) {
+            return;
+        }
+        db.executeUpdate("pragma auto_vacuum = incremental");
+        // Only a database without tables, or one in full mode, switches without a rebuild.
+        if (mode == FMDBAutoVacuumNone && db.intForQuery("pragma auto_vacuum") != FMDBAutoVacuumIncremental) {
+            db.executeUpdate("vacuum");
+        }
+        if (db.intForQuery("pragma auto_vacuum") != FMDBAutoVacuumIncremental) {
+            fprintf(stderr, "Could not enable incremental vacuum for path %s\n", db.databasePath().c_str());
+        }
+    });
+    __vacuumSchedulerPacket *packet = _packet;
+    _idleHandler = queue.addIdleHandler([packet](FMDatabase &db) {
+        return packet->idle(db);
+    });
+}
+
+FMVacuumScheduler::~FMVacuumScheduler()
+{
+    _queue.removeIdleHandler(_idleHandler);
+    delete _packet;
+    _packet = nullptr;
+}
+
+FMVacuumPolicy FMVacuumScheduler::policy() const
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    return _packet->_policy;
+}
+
+void FMVacuumScheduler::setPolicy(const FMVacuumPolicy &policy)
+{
+    {
+        lock_guard<mutex> locker(_packet->_mutex);
+        _packet->_policy = policy;
+    }
+    _queue.scheduleIdleHandlers();
+}
+
+FMVacuumStatistics FMVacuumScheduler::statistics() const
+{
+    lock_guard<mutex> locker(_packet->_mutex);
+    return _packet->_statistics;
+}
+
+FMDB_END
@@ -0,0 +1,67 @@
+//
+//  FMVacuumScheduler.h
+//  fmdb
+//
+
+#ifndef FMVacuumScheduler_hpp
+#define FMVacuumScheduler_hpp
+
+#include "FMDatabaseQueue.h"
+
+FMDB_BEGIN
+
+/** How much `<FMVacuumScheduler>` vacuums at once. */
+struct FMVacuumPolicy {
+    /** The pages returned to the file system by one slice, a `pragma incremental_vacuum(N)`. */
+    int pagesPerSlice = 64;
+    /** Free pages left in the file: a few free pages are reused by the next inserts anyway. */
+    int minimumFreePages = 16;
+};
+
+struct FMVacuumStatistics {
+    unsigned long long slices = 0;
+    /** Pages removed from the end of the file. */
+    unsigned long long pagesFreed = 0;
+    /** `freelist_count` after the last idle turn. */
+    int freePages = 0;
+    TimeInterval lastSliceTime = TimeInterval(0);
+    TimeInterval longestSliceTime = TimeInterval(0);
+    TimeInterval totalSliceTime = TimeInterval(0);
+};
+
+/**
+ Incremental vacuum of the database of an `<FMDatabaseQueue>`, in small slices while the queue is idle.
+
+ `VACUUM` rewrites the whole file in one transaction, blocking every writer until it is done. With `auto_vacuum = incremental`, SQLite instead keeps the pages needed to move pages around, and `pragma incremental_vacuum(N)` moves up to `N` pages from the end of the file into free pages and truncates the file.
+
+ The scheduler runs as an idle handler of the queue (see `FMDatabaseQueue::addIdleHandler`): after the queue runs out of tasks, it checks `freelist_count` and frees at most `pagesPerSlice` pages in one turn. Tasks submitted meanwhile run before the next slice, so a file shrinks without holding the queue longer than a slice.
+
+    FMDatabaseQueue queue(path);
+    FMVacuumScheduler vacuum(queue);
+
+ The scheduler switches the database to `auto_vacuum = incremental`. A database created with `auto_vacuum = none` and holding tables can only switch with a full `VACUUM`, which the first task of the scheduler runs once.
+
+ @warning The queue must outlive the scheduler.
+ */
+class FMVacuumScheduler
+{
+public:
+    FMVacuumScheduler(FMDatabaseQueue &queue, const FMVacuumPolicy &policy = FMVacuumPolicy());
+    ~FMVacuumScheduler();
+    FMVacuumScheduler(const FMVacuumScheduler &) = delete;
+    FMVacuumScheduler& operator=(const FMVacuumScheduler &) = delete;
+
+    FMVacuumPolicy policy() const;
+    void setPolicy(const FMVacuumPolicy &policy);
+
+    FMVacuumStatistics statistics() const;
+private:
+    FMDatabaseQueue &_queue;
+    unsigned long long _idleHandler;
+    friend struct __vacuumSchedulerPacket;
+    struct __vacuumSchedulerPacket *_packet;
+};
+
+FMDB_END
+
+#endif /* FMVacuumScheduler_hpp */
@@ -0,0 +1,110 @@
+//
+//  FMBlobTests.mm
+//  FMDB-CPP
+//
+
+#import <XCTest/XCTest.h>
+#import "FMBlob.h"
+#import "FMDBTempDBTests.h"
+#include <istream>
+#include <iterator>
+
+#if FMDB_SQLITE_STANDALONE
+#import <sqlite3/sqlite3.h>
+#else
+#import <sqlite3.h>
+#endif
+
+static const int FMBlobTestsSize = 4 * 1024 * 1024 + 123;
+
+@interface FMBlobTests : FMDBTempDBTests
+
+@end
+
+@implementation FMBlobTests
+
++ (void)populateDatabase:(FMDatabase *)db
+{
+    db->executeUpdate("create table attachment (id integer primary key, content blob)");
+}
+
+- (long long)insertPattern
+{
+    long long rowid = FMBlob::insertZeroBlob(*self.db, "attachment", "content", FMBlobTestsSize);
+    XCTAssertGreaterThan(rowid, 0);
+    FMBlob blob(*self.db, "attachment", "content", rowid, true);
+    XCTAssertTrue(blob.isOpen());
+    XCTAssertEqual(blob.size(), FMBlobTestsSize);
+
+    char buffer[8192];
+    for (int offset = 0; offset < FMBlobTestsSize; offset += sizeof(buffer)) {
+        int length = std::min((int)sizeof(buffer), FMBlobTestsSize - offset);
+        for (int i = 0; i < length; ++i) {
+            buffer[i] = (char)((offset + i) * 7);
+        }
+        XCTAssertTrue(blob.write(buffer, length, offset));
+    }
+    char byte = 0;
+    XCTAssertFalse(blob.write(&byte, 1, FMBlobTestsSize), @"A blob can't grow");
+    return rowid;
+}
+
+- (void)testChunkedReadAndWrite
+{
+    long long rowid = [self insertPattern];
+    FMBlob blob(*self.db, "attachment", "content", rowid);
+    char buffer[10000];
+    int chunks = 0;
+    int mismatches = 0;
+    XCTAssertTrue(blob.readChunks(buffer, sizeof(buffer), [&](const void *bytes, int length, int offset) {
+        ++chunks;
+        for (int i = 0; i < length; ++i) {
+            mismatches += ((const char *)bytes)[i] != (char)((offset + i) * 7);
+        }
+        return true;
+    }));
+    XCTAssertEqual(chunks, (FMBlobTestsSize + 9999) / 10000);
+    XCTAssertEqual(mismatches, 0);
+    XCTAssertFalse(blob.write(buffer, 1, 0), @"The handle is read-only");
+}
+
+- (void)testStreamBuffer
+{
+    long long rowid = [self insertPattern];
+    FMBlob blob(*self.db, "attachment", "content", rowid, true);
+    FMBlobStreamBuffer buffer(blob, 4096);
+    std::iostream stream(&buffer);
+
+    stream.seekg(1000000);
+    XCTAssertEqual(stream.get(), (unsigned char)(char)(1000000 * 7));
+    stream.seekg(-1, std::ios_base::end);
+    XCTAssertEqual(stream.get(), (unsigned char)(char)((FMBlobTestsSize - 1) * 7));
+
+    stream.clear();
+    stream.seekp(10);
+    stream.write("written", 7);
+    stream.seekg(0);
+    std::string content((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    XCTAssertEqual(content.size(), FMBlobTestsSize);
+    XCTAssertEqual(content.substr(10, 7), "written");
+}
+
+- (void)testReopen
+{
+    FMBlob blob(*self.db, "attachment", "content", FMBlob::insertZeroBlob(*self.db, "attachment", "content", 4), true);
+    XCTAssertTrue(blob.write("row1", 4, 0));
+    long long second = FMBlob::insertZeroBlob(*self.db, "attachment", "content", 4);
+    XCTAssertTrue(blob.reopen(second));
+    XCTAssertTrue(blob.write("row2", 4, 0));
+    XCTAssertFalse(blob.reopen(second + 1), @"No such row");
+    blob.close();
+
+    auto rs = self.db->executeQuery("select content from attachment order by id").lock();
+    XCTAssertTrue(rs->next());
+    XCTAssertEqual(string((const char *)rs->dataForColumnIndex(0)->data(), 4), "row1");
+    XCTAssertTrue(rs->next());
+    XCTAssertEqual(string((const char *)rs->dataForColumnIndex(0)->data(), 4), "row2");
+    rs->close();
+}
+
+@end
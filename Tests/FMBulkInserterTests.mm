@@ -0,0 +1,133 @@
+//
+//  FMBulkInserterTests.mm
+//  FMDB-CPP
+//
+
+#import <XCTest/XCTest.h>
+#import "FMBulkInserter.h"
+#import "FMDBTempDBTests.h"
+#include <thread>
+
+@interface FMBulkInserterTests : FMDBTempDBTests
+
+@property FMDatabaseQueue *queue;
+
+@end
+
+@implementation FMBulkInserterTests
+
++ (void)populateDatabase:(FMDatabase *)db
+{
+    db->executeUpdate("create table bulk (id integer primary key, name text, score real, payload blob)");
+}
+
+- (void)setUp
+{
+    [super setUp];
+    self.queue = new FMDatabaseQueue(self.databasePath.UTF8String);
+}
+
+- (void)tearDown
+{
+    [super tearDown];
+    delete self.queue;
+}
+
+- (int)countOfRows
+{
+    __block int count = 0;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"count"];
+    self.queue->inDatabase([&](FMDatabase &db) {
+        count = db.intForQuery("select count(*) from bulk");
+        [expectation fulfill];
+    });
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    return count;
+}
+
+- (void)testBatch
+{
+    FMBulkBatch batch(2);
+    batch.append(1).append("one");
+    XCTAssertTrue(batch.endRow());
+    batch.append(2);
+    XCTAssertFalse(batch.endRow(), @"A short row should be dropped");
+    batch.append(3).appendNull();
+    XCTAssertTrue(batch.endRow());
+    XCTAssertEqual(batch.rowCount(), 2);
+
+    batch.clear();
+    XCTAssertTrue(batch.empty());
+}
+
+- (void)testConcurrentProducers
+{
+    FMBulkInserter inserter(*self.queue, "insert into bulk values (?, ?, ?, ?)", 4);
+    inserter.setBatchSize(100);
+    inserter.setTransactionSize(1000);
+
+    vector<std::thread> producers;
+    for (int producer = 0; producer < 4; ++producer) {
+        producers.emplace_back([&, producer]() {
+            for (int b = 0; b < 10; ++b) {
+                FMBulkBatch batch = inserter.makeBatch();
+                for (int row = 0; row < 100; ++row) {
+                    long long id = producer * 1000 + b * 100 + row;
+                    batch.append(id).append("name").append(id * 0.5).append(VariantData{1, 2, 3});
+                    batch.endRow();
+                }
+                XCTAssertTrue(inserter.append(std::move(batch)));
+            }
+        });
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+    inserter.finish();
+
+    auto statistics = inserter.statistics();
+    XCTAssertEqual(statistics.insertedRows, 4000);
+    XCTAssertEqual(statistics.failedRows, 0);
+    XCTAssertEqual(statistics.batches, 40);
+    XCTAssertGreaterThanOrEqual(statistics.transactions, 4);
+    XCTAssertGreaterThan(statistics.rowsPerSecond(), 0);
+    XCTAssertEqual([self countOfRows], 4000);
+}
+
+- (void)testFailedTransactionIsRolledBack
+{
+    FMBulkInserter inserter(*self.queue, "insert into bulk values (?, ?, ?, ?)", 4);
+
+    FMBulkBatch batch = inserter.makeBatch();
+    batch.append(1).append("first").append(1.0).appendNull();
+    batch.endRow();
+    batch.append(1).append("duplicate").append(2.0).appendNull();
+    batch.endRow();
+    inserter.append(std::move(batch));
+    inserter.finish();
+
+    auto statistics = inserter.statistics();
+    XCTAssertEqual(statistics.insertedRows, 0);
+    XCTAssertEqual(statistics.failedRows, 2);
+    XCTAssertEqual([self countOfRows], 0);
+}
+
+- (void)testBulkInsertPerformance
+{
+    __block long long nextId = 0;
+    [self measureBlock:^{
+        FMBulkInserter inserter(*self.queue, "insert into bulk values (?, ?, ?, ?)", 4);
+        for (int b = 0; b < 100; ++b) {
+            FMBulkBatch batch = inserter.makeBatch();
+            for (int row = 0; row < 500; ++row, ++nextId) {
+                batch.append(nextId).append("name").append(nextId * 0.5).appendNull();
+                batch.endRow();
+            }
+            inserter.append(std::move(batch));
+        }
+        inserter.finish();
+        NSLog(@"%.0f rows/s", inserter.statistics().rowsPerSecond());
+    }];
+}
+
+@end
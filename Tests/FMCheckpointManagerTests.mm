@@ -0,0 +1,119 @@
+//
+//  FMCheckpointManagerTests.mm
+//  FMDB-CPP
+//
+
+#import <XCTest/XCTest.h>
+#import "FMCheckpointManager.h"
+#import "FMDBTempDBTests.h"
+
+@interface FMCheckpointManagerTests : FMDBTempDBTests
+
+@property FMDatabaseQueue *queue;
+
+@end
+
+@implementation FMCheckpointManagerTests
+
++ (void)populateDatabase:(FMDatabase *)db
+{
+    db->executeStatements("pragma journal_mode = wal;"
+                          "create table t (a integer primary key, b blob);");
+}
+
+- (void)setUp
+{
+    [super setUp];
+    self.queue = new FMDatabaseQueue(self.databasePath.UTF8String);
+}
+
+- (void)tearDown
+{
+    [super tearDown];
+    delete self.queue;
+}
+
+- (void)waitForQueue
+{
+    XCTestExpectation *ran = [self expectationWithDescription:@"ran"];
+    FMDatabaseQueueTaskOptions options;
+    options.completion = [=](bool success, const Error &error) {
+        [ran fulfill];
+    };
+    self.queue->inDatabase([](FMDatabase &adb) {}, options);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    [NSThread sleepForTimeInterval:0.1]; // the idle turn following the task.
+}
+
+- (void)insertRows:(int)count
+{
+    for (int i = 0; i < count; ++i) {
+        self.queue->inDatabase([](FMDatabase &adb) {
+            adb.executeUpdate("insert into t (b) values (zeroblob(1000))");
+        });
+    }
+    [self waitForQueue];
+}
+
+- (void)testPassiveCheckpointWhenIdle
+{
+    FMCheckpointManager checkpoints(*self.queue);
+    [self insertRows:100];
+
+    FMCheckpointStatistics statistics = checkpoints.statistics();
+    XCTAssertGreaterThan(statistics.passiveCheckpoints, 0);
+    XCTAssertEqual(statistics.restartCheckpoints + statistics.truncateCheckpoints, 0);
+    XCTAssertGreaterThanOrEqual(statistics.framesCheckpointed, 100);
+    XCTAssertEqual(statistics.incompleteCheckpoints, 0);
+    XCTAssertGreaterThan(statistics.walSize, statistics.walFrames * 4096);
+    XCTAssertGreaterThan(statistics.totalCheckpointTime.count(), 0);
+}
+
+- (void)testEscalation
+{
+    FMCheckpointPolicy policy;
+    policy.passiveFrameCount = 0;
+    policy.restartFrameCount = 20;
+    policy.truncateFrameCount = 50;
+    FMCheckpointManager checkpoints(*self.queue, policy);
+    [self insertRows:100];
+
+    FMCheckpointStatistics statistics = checkpoints.statistics();
+    XCTAssertEqual(statistics.passiveCheckpoints, 0);
+    XCTAssertGreaterThan(statistics.restartCheckpoints, 0);
+    XCTAssertLessThan(statistics.walFrames, 20, @"Each restart lets the next writer start the WAL over");
+
+    // A reader holding its snapshot keeps the WAL growing until the truncate threshold.
+    FMDatabase reader(self.databasePath.UTF8String);
+    XCTAssertTrue(reader.open());
+    reader.setMaxBusyRetryTimeInterval(TimeInterval(0));
+    XCTAssertTrue(reader.beginDeferredTransaction());
+    XCTAssertEqual(reader.intForQuery("select count(*) from t"), 100);
+    self.queue->inDatabase([](FMDatabase &adb) {
+        adb.setMaxBusyRetryTimeInterval(TimeInterval(0.01));
+    });
+    [self insertRows:60];
+    statistics = checkpoints.statistics();
+    XCTAssertGreaterThan(statistics.truncateCheckpoints, 0);
+    XCTAssertGreaterThan(statistics.incompleteCheckpoints, 0);
+    XCTAssertTrue(reader.commit());
+
+    [self insertRows:1];
+    statistics = checkpoints.statistics();
+    XCTAssertLessThan(statistics.walFrames, 20);
+}
+
+- (void)testManagerRemoval
+{
+    {
+        FMCheckpointManager checkpoints(*self.queue);
+        [self insertRows:10];
+    }
+    [self insertRows:10];
+
+    FMDatabase db(self.databasePath.UTF8String);
+    XCTAssertTrue(db.open());
+    XCTAssertEqual(db.intForQuery("select count(*) from t"), 20);
+}
+
+@end
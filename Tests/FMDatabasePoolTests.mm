@@ -0,0 +1,142 @@
+//
+//  FMDatabasePoolTests.mm
+//  FMDB-CPP
+//
+
+#import <XCTest/XCTest.h>
+#import "FMDatabasePool.h"
+#import "FMDBTempDBTests.h"
+
+#if FMDB_SQLITE_STANDALONE
+#import <sqlite3/sqlite3.h>
+#else
+#import <sqlite3.h>
+#endif
+
+@interface FMDatabasePoolTests : FMDBTempDBTests
+
+@property FMDatabasePool *pool;
+
+@end
+
+@implementation FMDatabasePoolTests
+
++ (void)populateDatabase:(FMDatabase *)db
+{
+    db->executeUpdate("create table easy (a text)");
+    db->executeUpdate("create table easy2 (a text)");
+
+    db->executeUpdate("insert into easy values (?)", 1001);
+    db->executeUpdate("insert into easy values (?)", 1002);
+    db->executeUpdate("insert into easy values (?)", 1003);
+}
+
+- (void)setUp
+{
+    [super setUp];
+    self.pool = new FMDatabasePool(self.databasePath.UTF8String, 2);
+}
+
+- (void)tearDown
+{
+    [super tearDown];
+    delete self.pool;
+}
+
+- (void)testJournalModeIsWAL
+{
+    self.pool->inDatabase([=](FMDatabase &db) {
+        auto mode = db.stringForQuery("pragma journal_mode");
+        XCTAssertTrue(mode && *mode == "wal");
+    });
+}
+
+- (void)testReaderIsReadOnly
+{
+    self.pool->inReadDatabase([=](FMDatabase &db) {
+        XCTAssertEqual(db.intForQuery("select count(*) from easy"), 3);
+        XCTAssertFalse(db.executeUpdate("insert into easy values (?)", 1004));
+    });
+}
+
+- (void)testCheckoutCheckin
+{
+    XCTAssertEqual(self.pool->countOfOpenDatabases(), 0);
+
+    FMDatabase *db1 = self.pool->checkoutReader();
+    FMDatabase *db2 = self.pool->checkoutReader();
+    XCTAssertTrue(db1 && db2 && db1 != db2);
+    XCTAssertTrue(db1->checkedOut());
+    XCTAssertEqual(self.pool->countOfCheckedOutDatabases(), 2);
+
+    self.pool->checkin(db1);
+    XCTAssertFalse(db1->checkedOut());
+    XCTAssertEqual(self.pool->countOfCheckedInDatabases(), 1);
+
+    FMDatabase *db3 = self.pool->checkoutReader();
+    XCTAssertEqual(db1, db3, @"The checked-in reader should be reused");
+
+    self.pool->checkin(db2);
+    self.pool->checkin(db3);
+    XCTAssertEqual(self.pool->countOfOpenDatabases(), 2);
+
+    self.pool->releaseAllDatabases();
+    XCTAssertEqual(self.pool->countOfOpenDatabases(), 0);
+}
+
+- (void)testIdleReaping
+{
+    self.pool->inReadDatabase([](FMDatabase &db) {});
+    XCTAssertEqual(self.pool->countOfCheckedInDatabases(), 1);
+
+    self.pool->setMaximumIdleTimeInterval(TimeInterval(0.05));
+    [NSThread sleepForTimeInterval:.1];
+    self.pool->releaseIdleDatabases();
+    XCTAssertEqual(self.pool->countOfCheckedInDatabases(), 0);
+}
+
+- (void)testReadersSeeCommittedWrites
+{
+    self.pool->inTransaction([=](FMDatabase &db, bool &rollback) {
+        XCTAssertTrue(db.executeUpdate("insert into easy values (?)", 1004));
+    });
+
+    self.pool->inTransaction([=](FMDatabase &db, bool &rollback) {
+        XCTAssertTrue(db.executeUpdate("insert into easy values (?)", 1005));
+        rollback = true;
+    });
+
+    self.pool->inReadDatabase([=](FMDatabase &db) {
+        XCTAssertEqual(db.intForQuery("select count(*) from easy"), 4);
+    });
+}
+
+- (void)testStressTest
+{
+    size_t ops = 32;
+    dispatch_queue_t dqueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+
+    dispatch_apply(ops, dqueue, ^(size_t nby) {
+        if (nby % 4 == 0) {
+            self.pool->inTransaction([=](FMDatabase &db, bool &rollback) {
+                XCTAssertTrue(db.executeUpdate("insert into easy2 values (?)", (int)nby));
+            });
+        } else {
+            self.pool->inReadDatabase([=](FMDatabase &db) {
+                auto rs = db.executeQuery("select * from easy").lock();
+                int count = 0;
+                while (rs->next()) {
+                    count++;
+                }
+                XCTAssertEqual(count, 3);
+            });
+        }
+    });
+
+    XCTAssertTrue(self.pool->countOfOpenDatabases() <= 2);
+    self.pool->inReadDatabase([=](FMDatabase &db) {
+        XCTAssertEqual(db.intForQuery("select count(*) from easy2"), 8);
+    });
+}
+
+@end
@@ -8,6 +8,8 @@
 
 #import <XCTest/XCTest.h>
 #import "FMDatabaseQueue.h"
+#import "FMResultSet.h"
+#import "FMThreadPool.hpp"
 #import "FMDBTempDBTests.h"
 
 #if FMDB_SQLITE_STANDALONE
@@ -180,4 +182,555 @@
 
 }
 
+- (void)testGroupCommit
+{
+    self.queue->inDatabase([=](FMDatabase &adb) {
+        XCTAssertTrue(adb.executeUpdate("create table grouptest (a integer)"));
+    });
+    self.queue->setGroupCommitWindow(TimeInterval(0.05), 8);
+
+    XCTestExpectation *committed = [self expectationWithDescription:@"committed"];
+    XCTestExpectation *rolledBack = [self expectationWithDescription:@"rolled back"];
+    FMDatabaseQueueTaskOptions options;
+    options.completion = [=](bool success, const Error &error) {
+        XCTAssertTrue(success);
+        XCTAssertTrue(error.isEmpty());
+        [committed fulfill];
+    };
+    self.queue->inTransaction([=](FMDatabase &adb, bool &rollback) {
+        XCTAssertTrue(adb.executeUpdate("insert into grouptest values (1)"));
+    }, options);
+
+    options.completion = [=](bool success, const Error &error) {
+        XCTAssertFalse(success);
+        [rolledBack fulfill];
+    };
+    self.queue->inTransaction([=](FMDatabase &adb, bool &rollback) {
+        XCTAssertTrue(adb.executeUpdate("insert into grouptest values (2)"));
+        rollback = YES;
+    }, options);
+
+    self.queue->inTransaction([=](FMDatabase &adb, bool &rollback) {
+        XCTAssertTrue(adb.executeUpdate("insert into grouptest values (3)"));
+    });
+
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTestExpectation *checked = [self expectationWithDescription:@"checked"];
+    self.queue->inDatabase([=](FMDatabase &adb) {
+        XCTAssertEqual(adb.intForQuery("select count(*) from grouptest"), 2);
+        XCTAssertEqual(adb.intForQuery("select count(*) from grouptest where a = 2"), 0);
+        [checked fulfill];
+    });
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testCompletionAfterClose
+{
+    self.queue->close();
+
+    XCTestExpectation *dropped = [self expectationWithDescription:@"dropped"];
+    FMDatabaseQueueTaskOptions options;
+    options.completion = [=](bool success, const Error &error) {
+        XCTAssertFalse(success);
+        XCTAssertEqual(error.code(), FMDatabaseQueueErrorClosed);
+        [dropped fulfill];
+    };
+    self.queue->inDatabase([=](FMDatabase &adb) {
+        XCTFail(@"A closed queue shouldn't run blocks");
+    }, options);
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+}
+
+- (void)testPriorityLanes
+{
+    // Hold the queue until everything has been enqueued.
+    dispatch_semaphore_t gate = dispatch_semaphore_create(0);
+    self.queue->inDatabase([=](FMDatabase &adb) {
+        dispatch_semaphore_wait(gate, DISPATCH_TIME_FOREVER);
+    });
+
+    __block NSMutableString *order = [NSMutableString string];
+    FMDatabaseQueueTaskOptions background;
+    background.priority = FMDatabaseQueuePriority::Background;
+    for (int i = 0; i < 8; ++i) {
+        self.queue->inDatabase([=](FMDatabase &adb) {
+            [order appendString:@"b"];
+        }, background);
+    }
+    for (int i = 0; i < 8; ++i) {
+        self.queue->inDatabase([=](FMDatabase &adb) {
+            [order appendString:@"i"];
+        });
+    }
+
+    XCTestExpectation *done = [self expectationWithDescription:@"done"];
+    background.completion = [=](bool success, const Error &error) {
+        [done fulfill];
+    };
+    self.queue->inDatabase([=](FMDatabase &adb) {}, background);
+
+    dispatch_semaphore_signal(gate);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    // With the default 4:1 weights the interactive tasks finish long before the background backlog.
+    NSRange lastInteractive = [order rangeOfString:@"i" options:NSBackwardsSearch];
+    XCTAssertTrue(lastInteractive.location < 12, @"%@", order);
+
+    auto statistics = self.queue->laneStatistics(FMDatabaseQueuePriority::Background);
+    XCTAssertEqual(statistics.executedTasks, 9);
+    XCTAssertEqual(statistics.pendingTasks, 0);
+    XCTAssertTrue(statistics.maximumWaitTime >= statistics.averageWaitTime());
+}
+
+- (void)testChunkedJobYields
+{
+    __block int chunks = 0;
+    XCTestExpectation *done = [self expectationWithDescription:@"done"];
+    FMDatabaseQueueTaskOptions options;
+    options.priority = FMDatabaseQueuePriority::Background;
+    options.completion = [=](bool success, const Error &error) {
+        XCTAssertTrue(success);
+        [done fulfill];
+    };
+    self.queue->inDatabaseChunked([=](FMDatabase &adb) {
+        XCTAssertFalse(self.queue->shouldYield());
+        return ++chunks < 5;
+    }, options);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqual(chunks, 5);
+}
+
+- (void)testMaximumQueueDepth
+{
+    self.queue->setMaximumQueueDepth(1);
+
+    dispatch_semaphore_t gate = dispatch_semaphore_create(0);
+    dispatch_semaphore_t started = dispatch_semaphore_create(0);
+    self.queue->inDatabase([=](FMDatabase &adb) {
+        dispatch_semaphore_signal(started);
+        dispatch_semaphore_wait(gate, DISPATCH_TIME_FOREVER);
+    });
+    dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+
+    XCTAssertTrue(self.queue->inDatabase([](FMDatabase &adb) {}));
+    XCTAssertEqual(self.queue->queueDepth(), 1);
+
+    __block long long errorCode = 0;
+    FMDatabaseQueueTaskOptions options;
+    options.enqueueTimeout = TimeInterval(0);
+    options.completion = [&](bool success, const Error &error) {
+        errorCode = error.code();
+    };
+    XCTAssertFalse(self.queue->inDatabase([](FMDatabase &adb) {}, options));
+    XCTAssertEqual(errorCode, FMDatabaseQueueErrorFull);
+
+    options.enqueueTimeout = TimeInterval(0.05);
+    XCTAssertFalse(self.queue->inDatabase([](FMDatabase &adb) {}, options));
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.05 * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        dispatch_semaphore_signal(gate);
+    });
+    XCTAssertTrue(self.queue->inDatabase([](FMDatabase &adb) {}), @"A blocking submit should wait for room");
+
+    auto statistics = self.queue->laneStatistics(FMDatabaseQueuePriority::Interactive);
+    XCTAssertEqual(statistics.rejectedTasks, 1);
+    XCTAssertEqual(statistics.timedOutTasks, 1);
+    XCTAssertEqual(statistics.blockedTasks, 2);
+}
+
+- (void)testStatistics
+{
+    XCTestExpectation *done = [self expectationWithDescription:@"done"];
+    for (int i = 0; i < 10; ++i) {
+        FMDatabaseQueueTaskOptions options;
+        options.tag = (i % 2) ? "odd" : "even";
+        if (i == 9) {
+            options.completion = [=](bool success, const Error &error) {
+                [done fulfill];
+            };
+        }
+        self.queue->inDatabase([=](FMDatabase &adb) {
+            [NSThread sleepForTimeInterval:.001];
+        }, options);
+    }
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    auto statistics = self.queue->statistics();
+    XCTAssertEqual(statistics.depth, 0);
+    XCTAssertTrue(statistics.peakDepth >= 1);
+    XCTAssertEqual(statistics.waitTime.count, 10);
+    XCTAssertEqual(statistics.runTime.count, 10);
+    XCTAssertTrue(statistics.runTime.percentile(50) >= 1000, @"Each task sleeps for 1ms");
+    XCTAssertEqual(statistics.tags.size(), 2);
+    XCTAssertEqual(statistics.tags["odd"].runTime.count, 5);
+
+    self.queue->resetStatistics();
+    XCTAssertEqual(self.queue->statistics().runTime.count, 0);
+}
+
+- (void)testHistogramBuckets
+{
+    FMHistogram histogram;
+    for (unsigned long long value = 0; value < 1000; ++value) {
+        histogram.record(value);
+    }
+    auto snapshot = histogram.snapshot();
+    XCTAssertEqual(snapshot.count, 1000);
+    XCTAssertEqual(snapshot.maximum, 999);
+    XCTAssertEqualWithAccuracy(snapshot.mean(), 499.5, 0.01);
+    XCTAssertEqualWithAccuracy((double)snapshot.percentile(50), 500, 500 * 0.25);
+    XCTAssertEqual(snapshot.percentile(100), 999);
+
+    for (int i = 0; i < FMHistogram::BucketCount; ++i) {
+        XCTAssertEqual(FMHistogram::bucketIndexForValue(FMHistogram::lowerBoundOfBucket(i)), i);
+    }
+}
+
+- (void)testTaskDeadline
+{
+    XCTestExpectation *expired = [self expectationWithDescription:@"expired"];
+    XCTestExpectation *interrupted = [self expectationWithDescription:@"interrupted"];
+
+    FMDatabaseQueueTaskOptions options;
+    options.deadline = steady_clock::now() - std::chrono::milliseconds(1);
+    options.completion = [=](bool success, const Error &error) {
+        XCTAssertFalse(success);
+        XCTAssertEqual(error.code(), FMDatabaseQueueErrorDeadlineExceeded);
+        [expired fulfill];
+    };
+    self.queue->inDatabase([](FMDatabase &adb) {
+        XCTFail(@"An expired task shouldn't run");
+    }, options);
+
+    options.deadline = steady_clock::now() + std::chrono::milliseconds(50);
+    options.completion = [=](bool success, const Error &error) {
+        XCTAssertFalse(success);
+        XCTAssertEqual(error.code(), FMDatabaseQueueErrorDeadlineExceeded);
+        [interrupted fulfill];
+    };
+    self.queue->inTransaction([](FMDatabase &adb, bool &rollback) {
+        XCTAssertTrue(adb.executeUpdate("insert into qfoo values ('deadline')"));
+        auto rs = adb.executeQuery("with recursive c(x) as (select 1 union all select x + 1 from c) select count(*) from c").lock();
+        XCTAssertFalse(rs->next());
+        XCTAssertTrue(adb.deadlineExceeded());
+        XCTAssertEqual(adb.lastError().code(), FMDatabaseErrorDeadlineExceeded);
+    }, options);
+
+    XCTestExpectation *checked = [self expectationWithDescription:@"checked"];
+    self.queue->inDatabase([=](FMDatabase &adb) {
+        XCTAssertEqual(adb.intForQuery("select count(*) from qfoo where foo = 'deadline'"), 0, @"The interrupted transaction should be rolled back");
+        [checked fulfill];
+    });
+
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    auto statistics = self.queue->laneStatistics(FMDatabaseQueuePriority::Interactive);
+    XCTAssertEqual(statistics.expiredTasks, 1);
+    XCTAssertEqual(statistics.interruptedTasks, 1);
+}
+
+- (void)testTransactionRetry
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"retried"];
+    XCTestExpectation *immediate = [self expectationWithDescription:@"immediate"];
+    self.queue->inDatabase([](FMDatabase &adb) {
+        adb.executeStatements("pragma journal_mode=wal");
+    });
+
+    FMDatabase other(self.databasePath.UTF8String);
+    XCTAssertTrue(other.open());
+
+    __block int attempts = 0;
+    FMDatabaseQueueTaskOptions options;
+    options.retryPolicy = FMDatabaseRetryPolicy(3);
+    options.completion = [=](bool success, const Error &error) {
+        XCTAssertTrue(success);
+        [expectation fulfill];
+    };
+    self.queue->inDeferredTransaction([&](FMDatabase &adb, bool &rollback) {
+        ++attempts;
+        adb.intForQuery("select count(*) from qfoo");
+        if (attempts == 1) {
+            XCTAssertTrue(other.executeUpdate("insert into qfoo values ('other')"));
+        }
+        adb.executeUpdate("insert into qfoo values ('retried')");
+    }, options);
+
+    options.completion = [=](bool success, const Error &error) {
+        XCTAssertTrue(success);
+        [immediate fulfill];
+    };
+    self.queue->inImmediateTransaction([](FMDatabase &adb, bool &rollback) {
+        XCTAssertTrue(adb.executeUpdate("insert into qfoo values ('immediate')"));
+    }, options);
+
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTAssertEqual(attempts, 2);
+    XCTAssertEqual(self.queue->laneStatistics(FMDatabaseQueuePriority::Interactive).retries, 1);
+    XCTAssertEqual(other.intForQuery("select count(*) from qfoo where foo = 'retried'"), 1);
+    XCTAssertEqual(other.intForQuery("select count(*) from qfoo where foo = 'immediate'"), 1);
+    other.close();
+}
+
+- (void)testLostLockRollsBack
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"rolled back"];
+    self.queue->inDatabase([](FMDatabase &adb) {
+        adb.executeStatements("pragma journal_mode=wal; create temp table tfoo (foo text)");
+    });
+
+    FMDatabase other(self.databasePath.UTF8String);
+    XCTAssertTrue(other.open());
+
+    FMDatabaseQueueTaskOptions options;
+    options.completion = [=](bool success, const Error &error) {
+        XCTAssertFalse(success);
+        XCTAssertEqual(error.code(), SQLITE_BUSY);
+        [expectation fulfill];
+    };
+    self.queue->inDeferredTransaction([&](FMDatabase &adb, bool &rollback) {
+        XCTAssertTrue(adb.executeUpdate("insert into tfoo values ('before')"));
+        adb.intForQuery("select count(*) from qfoo");
+        XCTAssertTrue(other.executeUpdate("insert into qfoo values ('other')"));
+        XCTAssertFalse(adb.executeUpdate("insert into qfoo values ('lost')"));
+    }, options);
+    __block int count = -1;
+    XCTestExpectation *counted = [self expectationWithDescription:@"counted"];
+    self.queue->inDatabase([&](FMDatabase &adb) {
+        count = adb.intForQuery("select count(*) from tfoo");
+        [counted fulfill];
+    });
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTAssertEqual(count, 0, @"Work done before the lost lock must not be committed");
+    other.close();
+}
+
+- (void)testFailedBeginSkipsBlock
+{
+    XCTestExpectation *expectation = [self expectationWithDescription:@"failed"];
+    self.queue->inDatabase([](FMDatabase &adb) {
+        adb.setMaxBusyRetryTimeInterval(TimeInterval(0.05));
+    });
+    FMDatabase other(self.databasePath.UTF8String);
+    XCTAssertTrue(other.open());
+    XCTAssertTrue(other.beginTransaction(FMDatabaseTransactionMode::Exclusive));
+
+    __block bool ran = false;
+    FMDatabaseQueueTaskOptions options;
+    options.completion = [=](bool success, const Error &error) {
+        XCTAssertFalse(success);
+        [expectation fulfill];
+    };
+    self.queue->inImmediateTransaction([&](FMDatabase &adb, bool &rollback) {
+        ran = true;
+    }, options);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTAssertFalse(ran, @"The block must not run outside of a transaction");
+    XCTAssertTrue(other.rollback());
+    other.close();
+}
+
+- (void)testThreadPool
+{
+    std::atomic<int> count(0);
+    {
+        FMThreadPool pool(3);
+        XCTAssertEqual(pool.threadCount(), 3);
+        for (int i = 0; i < 100; ++i) {
+            pool.async([&]() {
+                pool.async([&]() {
+                    ++count;
+                });
+            });
+        }
+    }
+    XCTAssertEqual(count.load(), 100, @"The pool should run every task before it is destroyed");
+}
+
+- (void)testPipelinedQuery
+{
+    self.queue->inTransaction([](FMDatabase &adb, bool &rollback) {
+        adb.executeUpdate("create table pipe (a integer)");
+        for (int i = 0; i < 1000; ++i) {
+            adb.executeUpdate("insert into pipe values (?)", i);
+        }
+    });
+
+    FMThreadPool pool(4);
+    for (int ordered = 1; ordered >= 0; --ordered) {
+        XCTestExpectation *expectation = [self expectationWithDescription:@"pipeline"];
+        __block vector<long long> values;
+        FMDatabaseQueueRowPipelineOptions options;
+        options.batchSize = 64;
+        options.ordered = ordered;
+        options.taskOptions.completion = [=](bool success, const Error &error) {
+            XCTAssertTrue(success);
+            [expectation fulfill];
+        };
+        self.queue->executePipelinedQuery([](FMDatabase &adb) {
+            return adb.executeQuery("select a from pipe order by a");
+        }, pool, [](const VariantVector &row) {
+            return Variant(row[0].toLongLong() * 2);
+        }, [&](VariantVector &batch) {
+            for (auto &value : batch) {
+                values.push_back(value.toLongLong());
+            }
+        }, options);
+        [self waitForExpectationsWithTimeout:5 handler:nil];
+
+        XCTAssertEqual(values.size(), 1000);
+        if (ordered) {
+            for (size_t i = 0; i < values.size(); ++i) {
+                XCTAssertEqual(values[i], (long long)i * 2);
+            }
+        } else {
+            std::sort(values.begin(), values.end());
+            XCTAssertEqual(values.back(), 1998);
+        }
+    }
+
+    XCTestExpectation *failed = [self expectationWithDescription:@"failed"];
+    FMDatabaseQueueRowPipelineOptions options;
+    options.taskOptions.completion = [=](bool success, const Error &error) {
+        XCTAssertFalse(success);
+        XCTAssertTrue(error.domain() == "FMDatabase");
+        XCTAssertEqual(error.code(), SQLITE_ERROR);
+        [failed fulfill];
+    };
+    self.queue->executePipelinedQuery([](FMDatabase &adb) {
+        return adb.executeQuery("select * from missing");
+    }, pool, [](const VariantVector &row) {
+        return Variant();
+    }, [](VariantVector &batch) {}, options);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTestExpectation *empty = [self expectationWithDescription:@"empty"];
+    FMDatabaseQueue *queue = self.queue;
+    options.taskOptions.completion = [=](bool success, const Error &error) {
+        XCTAssertTrue(success);
+        // No batch: the query finished last, yet the completion runs on the pool and can use the queue.
+        queue->inDatabase([=](FMDatabase &adb) {
+            [empty fulfill];
+        });
+    };
+    self.queue->executePipelinedQuery([](FMDatabase &adb) {
+        return adb.executeQuery("select a from pipe where a < 0");
+    }, pool, [](const VariantVector &row) {
+        return Variant();
+    }, [](VariantVector &batch) {}, options);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testIdleHandlers
+{
+    std::atomic<int> turns(0);
+    XCTestExpectation *idle = [self expectationWithDescription:@"idle"];
+    unsigned long long identifier = self.queue->addIdleHandler([&turns, idle](FMDatabase &adb) {
+        if (++turns == 3) {
+            [idle fulfill];
+        }
+        return turns < 3; // asks for two more turns.
+    });
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    XCTestExpectation *ran = [self expectationWithDescription:@"ran"];
+    FMDatabaseQueueTaskOptions options;
+    options.completion = [=](bool success, const Error &error) {
+        [ran fulfill];
+    };
+    self.queue->inDatabase([](FMDatabase &adb) {}, options);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+
+    self.queue->removeIdleHandler(identifier);
+    int removedAt = turns;
+    XCTAssertGreaterThanOrEqual(removedAt, 3);
+    self.queue->scheduleIdleHandlers();
+    self.queue->inDatabase([](FMDatabase &adb) {});
+    [NSThread sleepForTimeInterval:0.1];
+    XCTAssertEqual(turns, removedAt, @"A removed handler gets no more turns");
+}
+
+- (void)testOnlineBackup
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"FMDBQueueBackup.db"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    self.queue->inDatabase([](FMDatabase &adb) {
+        adb.executeStatements("create table backuptest (a integer primary key, b blob);"
+                              "with recursive c(x) as (select 1 union all select x + 1 from c where x < 500) insert into backuptest (b) select zeroblob(1000) from c;");
+    });
+
+    // Tasks submitted during the backup run between its steps, and their writes are copied along.
+    std::atomic<int> inserted(0);
+    FMDatabaseBackupOptions options;
+    options.pagesPerStep = 10;
+    FMDatabaseBackupProgress last;
+    options.progress = [&](const FMDatabaseBackupProgress &progress) {
+        if (progress.remainingPages > 0) {
+            self.queue->inDatabase([&](FMDatabase &adb) {
+                adb.executeUpdate("insert into backuptest (b) values (zeroblob(10))");
+                ++inserted;
+            });
+        }
+        last = progress;
+        return true;
+    };
+    Error error;
+    XCTAssertTrue(self.queue->backupToPath(path.UTF8String, options, &error));
+    XCTAssertTrue(error.isEmpty());
+    XCTAssertEqual(last.restarts, 0);
+    XCTAssertGreaterThan(inserted, 10);
+
+    FMDatabase copy(path.UTF8String);
+    XCTAssertTrue(copy.open());
+    XCTAssertEqual(copy.intForQuery("select count(*) from backuptest"), 500 + inserted);
+}
+
+- (void)testLoadIntoMemory
+{
+    Error error;
+    XCTAssertTrue(self.queue->loadIntoMemory(TimeInterval(0.1), &error));
+    self.queue->inDatabase([](FMDatabase &adb) {
+        XCTAssertTrue(adb.isInMemory());
+        XCTAssertTrue(adb.executeUpdate("insert into qfoo values ('memory')"));
+    });
+
+    FMDatabase file(self.databasePath.UTF8String);
+    XCTAssertTrue(file.open());
+    [NSThread sleepForTimeInterval:0.5];
+    XCTAssertEqual(file.intForQuery("select count(*) from qfoo"), 4, @"Written back once the queue is idle and the interval passed");
+    FMInMemoryStatistics statistics = self.queue->inMemoryStatistics();
+    XCTAssertEqual(statistics.writeBacks, 1);
+    XCTAssertFalse(statistics.dirty);
+
+    self.queue->inDatabase([](FMDatabase &adb) {
+        XCTAssertTrue(adb.executeUpdate("insert into qfoo values ('on demand')"));
+    });
+    XCTAssertTrue(self.queue->writeBack(&error));
+    XCTAssertEqual(file.intForQuery("select count(*) from qfoo"), 5);
+}
+
+- (void)testWarmUp
+{
+    FMWarmUpOptions options;
+    options.readAhead = true;
+    options.tables = {"qfoo"};
+    XCTestExpectation *expectation = [self expectationWithDescription:@"warm-up"];
+    XCTAssertTrue(self.queue->warmUp(options, [=](bool success, const FMWarmUpStatistics &statistics) {
+        XCTAssertTrue(success);
+        XCTAssertEqual(statistics.rowsScanned, 3);
+        [NSThread sleepForTimeInterval:0.1];
+        [expectation fulfill];
+    }));
+    XCTAssertFalse(self.queue->isReady());
+    XCTAssertFalse(self.queue->waitUntilReady(TimeInterval(0.01)));
+    XCTAssertTrue(self.queue->waitUntilReady());
+    XCTAssertTrue(self.queue->isReady());
+    XCTAssertGreaterThan(self.queue->warmUpStatistics().bytesReadAhead, 0);
+    [self waitForExpectationsWithTimeout:1 handler:nil];
+}
+
 @end
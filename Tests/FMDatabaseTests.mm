@@ -8,6 +8,7 @@
 
 #import "FMDBTempDBTests.h"
 #import "FMDatabase.h"
+#import "FMDatabaseQueue.h"
 //#import "FMDatabaseAdditions.h"
 
 #if FMDB_SQLITE_STANDALONE
@@ -18,6 +19,7 @@
 
 #include "Date.hpp"
 #import "FMResultSet.h"
+#include <thread>
 #import "FMStatement.hpp"
 
 
@@ -84,6 +86,175 @@
     XCTAssertTrue(db.hadError(), @"Should have failed");
 }
 
+- (void)testOpenOptions
+{
+    XCTAssertTrue(FMDatabaseOpenOptions().statements().empty());
+
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"FMDBOpenOptions.db"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    FMDatabaseOpenOptions options = FMDatabaseOpenOptions::OLTPWAL();
+    options.pageSize = 8192;
+    FMDatabase db(path.UTF8String);
+    db.setOpenOptions(options);
+    XCTAssertTrue(db.open());
+    XCTAssertTrue(db.executeUpdate("create table t (a integer)"));
+    XCTAssertEqualObjects(@(db.stringForQuery("pragma journal_mode")->c_str()), @"wal");
+    XCTAssertEqual(db.intForQuery("pragma synchronous"), 1);
+    XCTAssertEqual(db.intForQuery("pragma cache_size"), -8192);
+    XCTAssertEqual(db.intForQuery("pragma foreign_keys"), 1);
+    XCTAssertEqual(db.intForQuery("pragma page_size"), 8192);
+    db.close();
+
+    FMDatabaseQueue queue(path.UTF8String, SQLITE_OPEN_READONLY, FMDatabase::stringNull, FMDatabaseOpenOptions::readOnlyAnalytics());
+    XCTestExpectation *expectation = [self expectationWithDescription:@"queue"];
+    queue.inDatabase([=](FMDatabase &adb) {
+        XCTAssertEqual(adb.longLongForQuery("pragma mmap_size"), 256LL * 1024 * 1024);
+        XCTAssertEqual(adb.intForQuery("pragma temp_store"), 2);
+        [expectation fulfill];
+    });
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+}
+
+- (void)testOnlineBackup
+{
+    XCTAssertTrue(self.db->executeStatements("create table backuptest (a integer primary key, b blob);"
+                                             "with recursive c(x) as (select 1 union all select x + 1 from c where x < 1000) insert into backuptest (b) select zeroblob(1000) from c;"));
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"FMDBBackup.db"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    FMDatabaseBackupOptions options;
+    options.pagesPerStep = 20;
+    options.maximumPagesPerSecond = 2000;
+    FMDatabaseBackupProgress last;
+    FMDatabase writer(self.databasePath.UTF8String);
+    XCTAssertTrue(writer.open());
+    options.progress = [&](const FMDatabaseBackupProgress &progress) {
+        if (progress.pagesCopied == 60) {
+            writer.executeUpdate("insert into backuptest (b) values (zeroblob(10))"); // another connection: starts the copy over.
+        }
+        XCTAssertLessThanOrEqual(progress.pagesCopied, progress.elapsed.count() * 2000 + 20, @"Throttled");
+        last = progress;
+        return true;
+    };
+    Error error;
+    XCTAssertTrue(self.db->backupToPath(path.UTF8String, options, &error));
+    XCTAssertTrue(error.isEmpty());
+    XCTAssertEqual(last.remainingPages, 0);
+    XCTAssertEqual(last.restarts, 1);
+    XCTAssertGreaterThan(last.pagesCopied, (unsigned long long)last.pageCount);
+
+    FMDatabase copy(path.UTF8String);
+    XCTAssertTrue(copy.open());
+    XCTAssertEqual(copy.intForQuery("select count(*) from backuptest"), 1001);
+    copy.close();
+
+    options.maximumPagesPerSecond = 0;
+    options.progress = [](const FMDatabaseBackupProgress &progress) {
+        return progress.pagesCopied < 100;
+    };
+    XCTAssertFalse(self.db->backupToPath(path.UTF8String, options, &error));
+    XCTAssertEqual(error.code(), SQLITE_ABORT);
+}
+
+- (void)testLoadIntoMemory
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"FMDBInMemory.db"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    FMDatabase file(path.UTF8String);
+    XCTAssertTrue(file.open());
+    XCTAssertTrue(file.executeStatements("create table t (a integer primary key, b blob);"
+                                         "with recursive c(x) as (select 1 union all select x + 1 from c where x < 1000) insert into t (b) select randomblob(500) from c;"));
+    file.close();
+
+    FMDatabase db(path.UTF8String);
+    Error error;
+    XCTAssertTrue(db.loadIntoMemory(&error));
+    XCTAssertTrue(db.isInMemory());
+    FMInMemoryStatistics statistics = db.inMemoryStatistics();
+    XCTAssertGreaterThan(statistics.loadTime.count(), 0);
+    XCTAssertGreaterThan(statistics.databaseSize, 500 * 1000);
+    XCTAssertGreaterThanOrEqual(statistics.memoryUsed, statistics.databaseSize);
+    XCTAssertFalse(statistics.dirty);
+
+    XCTAssertTrue(db.executeUpdate("delete from t where a > 500"));
+    XCTAssertTrue(db.inMemoryStatistics().dirty);
+    XCTAssertTrue(file.open());
+    XCTAssertEqual(file.intForQuery("select count(*) from t"), 1000, @"The file is only changed by a write-back");
+
+    XCTAssertTrue(db.writeBack(&error));
+    statistics = db.inMemoryStatistics();
+    XCTAssertFalse(statistics.dirty);
+    XCTAssertEqual(statistics.writeBacks, 1);
+    XCTAssertEqual(file.intForQuery("select count(*) from t"), 500);
+
+    db.setWriteBackInterval(TimeInterval(60));
+    XCTAssertTrue(db.executeUpdate("delete from t where a > 400"));
+    XCTAssertGreaterThan(db.writeBackDelay().count(), 0);
+    XCTAssertTrue(db.writeBackIfNeeded());
+    XCTAssertEqual(db.inMemoryStatistics().writeBacks, 1, @"Not due yet");
+
+    db.close();
+    XCTAssertEqual(file.intForQuery("select count(*) from t"), 400, @"Closing writes back");
+}
+
+- (void)testIOAccounting
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"FMDBIOAccounting.db"];
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    FMDatabase db(path.UTF8String);
+    XCTAssertEqual(db.ioStatistics().bytesWritten(), 0, @"Not counting");
+    FMDatabaseOpenOptions options;
+    options.ioAccounting = true;
+    db.setOpenOptions(options);
+    XCTAssertTrue(db.open());
+
+    XCTAssertTrue(db.executeStatements("create table t (a integer primary key, b blob);"
+                                       "with recursive c(x) as (select 1 union all select x + 1 from c where x < 200) insert into t (b) select randomblob(500) from c;"));
+    FMIOStatistics statistics = db.ioStatistics();
+    XCTAssertGreaterThan(statistics.mainDatabase.writes.bytes, 200 * 500);
+    XCTAssertGreaterThan(statistics.journal.writes.count, 0);
+    XCTAssertGreaterThan(statistics.syncCount(), 0);
+    XCTAssertEqual(statistics.wal.writes.count, 0);
+    XCTAssertEqual(statistics.mainDatabase.writes.count, statistics.mainDatabase.writes.latency.count);
+
+    XCTAssertTrue(db.executeStatements("pragma journal_mode = wal"));
+    db.resetIOStatistics();
+    XCTAssertTrue(db.executeUpdate("update t set b = zeroblob(10) where a = 1"));
+    statistics = db.ioStatistics();
+    XCTAssertGreaterThan(statistics.wal.writes.count, 0);
+    XCTAssertEqual(statistics.mainDatabase.writes.count, 0, @"Pages reach the file at checkpoints");
+    XCTAssertEqual(statistics.journal.writes.count, 0);
+
+    db.close();
+    XCTAssertGreaterThan(db.ioStatistics().mainDatabase.writes.count, 0, @"The last connection checkpoints when closing");
+}
+
+- (void)testWarmUp
+{
+    XCTAssertTrue(self.db->executeStatements("create table warm (a integer, b text); create index warm_b on warm (b); create index warm_expr on warm (a + 1);"
+                                             "with recursive c(x) as (select 1 union all select x + 1 from c where x < 1000) insert into warm select x, hex(randomblob(20)) from c;"));
+    FMWarmUpOptions options;
+    options.readAhead = true;
+    options.readAheadChunkSize = 64 * 1024;
+    options.tables = {"warm"};
+    options.indexes = {"warm_b"};
+    FMWarmUpStatistics statistics;
+    Error error;
+    XCTAssertTrue(self.db->warmUp(options, &statistics, &error));
+    long long fileSize = self.db->longLongForQuery("pragma page_count") * self.db->longLongForQuery("pragma page_size");
+    XCTAssertEqual(statistics.bytesReadAhead, fileSize);
+    XCTAssertEqual(statistics.rowsScanned, 2000);
+    XCTAssertGreaterThan(statistics.cacheUsed, 0);
+    XCTAssertGreaterThanOrEqual(statistics.duration.count(), statistics.readAheadTime.count() + statistics.scanTime.count());
+    XCTAssertFalse(self.db->inTransaction());
+
+    options = FMWarmUpOptions();
+    options.indexes = {"warm_expr", "warm_b"};
+    XCTAssertFalse(self.db->warmUp(options, &statistics, &error), @"Expression indexes can't be scanned");
+    XCTAssertEqual(statistics.rowsScanned, 1000, @"The other steps still run");
+}
+
 - (void)testFailOnUnopenedDatabase
 {
     self.db->close();
@@ -210,6 +381,77 @@
     XCTAssertTrue(self.db->executeUpdate("insert into t1 values (5)"), @"The database shouldn't be locked at this point");
 }
 
+- (void)testBusyStrategy
+{
+    self.db->executeUpdate("create table t1 (a integer)");
+
+    FMDatabase newDB(self.databasePath.UTF8String);
+    newDB.open();
+    XCTAssertEqual(newDB.busyStrategy().yieldCount, FMDatabaseBusyStrategy().yieldCount);
+
+    // A lock held for a couple of milliseconds costs about as much to the waiting connection.
+    XCTAssertTrue(self.db->beginTransaction());
+    XCTAssertTrue(self.db->executeUpdate("insert into t1 values (1)"));
+    std::thread holder([=]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        self.db->commit();
+    });
+    XCTAssertTrue(newDB.executeUpdate("insert into t1 values (2)"));
+    holder.join();
+
+    auto &statistics = newDB.busyStatistics();
+    XCTAssertEqual(statistics.waits, 1);
+    XCTAssertGreaterThan(statistics.retries, 0);
+    XCTAssertEqual(statistics.timeouts, 0);
+    XCTAssertLessThan(statistics.longestWaitTime.count(), 0.05);
+    XCTAssertGreaterThan(statistics.totalWaitTime.count(), 0);
+
+    newDB.resetBusyStatistics();
+    newDB.setBusyStrategy(FMDatabaseBusyStrategy::fixedSleep(TimeInterval(0.01)));
+    newDB.setMaxBusyRetryTimeInterval(TimeInterval(0.05));
+    XCTAssertTrue(self.db->beginTransaction());
+    XCTAssertTrue(self.db->executeUpdate("insert into t1 values (3)"));
+    XCTAssertFalse(newDB.executeUpdate("insert into t1 values (4)"));
+    XCTAssertTrue(self.db->commit());
+    XCTAssertEqual(newDB.busyStatistics().timeouts, 1);
+    XCTAssertGreaterThan(newDB.busyStatistics().longestWaitTime.count(), 0.04);
+
+    XCTAssertEqual(FMDatabaseBusyStrategy().sleepForRetry(0).count(), 0.0001);
+    XCTAssertEqual(FMDatabaseBusyStrategy().sleepForRetry(100).count(), 0.02);
+    newDB.close();
+}
+
+- (void)testTransactionRetryOnBusy
+{
+    self.db->executeStatements("pragma journal_mode=wal; create table t1 (a integer)");
+
+    FMDatabase newDB(self.databasePath.UTF8String);
+    newDB.open();
+
+    // The first attempt reads, then loses its snapshot to newDB and can't upgrade to a write lock.
+    __block int attempts = 0;
+    BOOL committed = self.db->inTransactionWithMode(FMDatabaseTransactionMode::Deferred, [&](bool *rollback) {
+        ++attempts;
+        self.db->intForQuery("select count(*) from t1");
+        if (attempts == 1) {
+            XCTAssertTrue(newDB.executeUpdate("insert into t1 values (1)"));
+        }
+        self.db->executeUpdate("insert into t1 values (2)");
+    }, FMDatabaseRetryPolicy(3));
+
+    XCTAssertTrue(committed);
+    XCTAssertEqual(attempts, 2);
+    XCTAssertEqual(self.db->transactionRetryCount(), 1);
+    XCTAssertGreaterThanOrEqual(self.db->busyErrorCount(), 1);
+    XCTAssertEqual(newDB.intForQuery("select count(*) from t1"), 2);
+
+    XCTAssertTrue(self.db->inTransactionWithMode(FMDatabaseTransactionMode::Immediate, [&](bool *rollback) {
+        XCTAssertTrue(newDB.intForQuery("select count(*) from t1") == 2, @"Readers should go on during an immediate transaction");
+        self.db->executeUpdate("insert into t1 values (3)");
+    }));
+    newDB.close();
+}
+
 - (void)testCaseSensitiveResultDictionary
 {
     // case sensitive result dictionary test
@@ -0,0 +1,94 @@
+//
+//  FMDatabaseURITests.mm
+//  FMDB-CPP
+//
+
+#import <XCTest/XCTest.h>
+#import "FMDatabaseURI.h"
+#import "FMDatabase.h"
+#import "FMDBTempDBTests.h"
+
+#if FMDB_SQLITE_STANDALONE
+#import <sqlite3/sqlite3.h>
+#else
+#import <sqlite3.h>
+#endif
+
+@interface FMDatabaseURITests : FMDBTempDBTests
+
+@end
+
+@implementation FMDatabaseURITests
+
++ (void)populateDatabase:(FMDatabase *)db
+{
+    db->executeStatements("create table t (a integer, b text);"
+                          "with recursive c(x) as (select 1 union all select x + 1 from c where x < 1000) insert into t select x, 'row ' || x from c;");
+}
+
+- (void)testURIString
+{
+    FMDatabaseURI uri("/tmp/a b?#%.db");
+    XCTAssertEqual(uri.toString(), "file:/tmp/a%20b%3F%23%25.db");
+    XCTAssertEqual(uri.openFlags(), SQLITE_OPEN_URI | SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+
+    uri.mode = FMDatabaseURI::Mode::ReadOnly;
+    uri.cache = FMDatabaseURI::Cache::Shared;
+    uri.noLock = true;
+    uri.vfsName = "unix-none";
+    uri.parameters.emplace_back("psow", "1");
+    XCTAssertEqual(uri.toString(), "file:/tmp/a%20b%3F%23%25.db?mode=ro&cache=shared&nolock=1&vfs=unix-none&psow=1");
+    XCTAssertEqual(uri.openFlags(), SQLITE_OPEN_URI | SQLITE_OPEN_READONLY);
+
+    XCTAssertEqual(FMDatabaseURI::immutableFile("/data.db").toString(), "file:/data.db?mode=ro&immutable=1");
+}
+
+- (void)testImmutable
+{
+    FMDatabaseURI uri = FMDatabaseURI::immutableFile(self.databasePath.UTF8String);
+    FMDatabase db(uri.toString());
+    XCTAssertTrue(db.openWithFlags(uri.openFlags()));
+    XCTAssertEqual(db.intForQuery("select count(*) from t"), 1000);
+    XCTAssertFalse(db.executeUpdate("insert into t values (0, 'written')"), @"An immutable database is read-only");
+}
+
+- (void)testSharedMemoryDatabase
+{
+    FMDatabaseURI uri("FMDatabaseURITests");
+    uri.mode = FMDatabaseURI::Mode::Memory;
+    uri.cache = FMDatabaseURI::Cache::Shared;
+    FMDatabase first(uri.toString());
+    FMDatabase second(uri.toString());
+    XCTAssertTrue(first.openWithFlags(uri.openFlags()));
+    XCTAssertTrue(second.openWithFlags(uri.openFlags()));
+    XCTAssertTrue(first.executeUpdate("create table shared (a integer)"));
+    XCTAssertTrue(first.executeUpdate("insert into shared values (42)"));
+    XCTAssertEqual(second.intForQuery("select a from shared"), 42);
+}
+
+- (void)measureReadsWithDatabase:(FMDatabase &)db
+{
+    [self measureBlock:^{
+        for (int i = 0; i < 10000; ++i) {
+            db.intForQuery("select a from t where rowid = ?", i % 1000 + 1);
+        }
+    }];
+}
+
+- (void)testLockingReadPerformance
+{
+    FMDatabase db(self.databasePath.UTF8String);
+    db.openWithFlags(SQLITE_OPEN_READONLY);
+    [self measureReadsWithDatabase:db];
+}
+
+- (void)testImmutableReadPerformance
+{
+    // Each read transaction above locks and unlocks the file and checks the change counter; these don't.
+    FMDatabaseURI uri = FMDatabaseURI::immutableFile(self.databasePath.UTF8String);
+    FMDatabase db(uri.toString());
+    db.openWithFlags(uri.openFlags());
+    [self measureReadsWithDatabase:db];
+}
+
+@end
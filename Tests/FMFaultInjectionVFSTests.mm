@@ -0,0 +1,115 @@
+//
+//  FMFaultInjectionVFSTests.mm
+//  FMDB-CPP
+//
+
+#import <XCTest/XCTest.h>
+#import "FMFaultInjectionVFS.h"
+#import "FMIOAccountingVFS.h"
+#import "FMDBTempDBTests.h"
+
+#if FMDB_SQLITE_STANDALONE
+#import <sqlite3/sqlite3.h>
+#else
+#import <sqlite3.h>
+#endif
+
+@interface FMFaultInjectionVFSTests : FMDBTempDBTests
+
+@end
+
+@implementation FMFaultInjectionVFSTests
+
++ (void)populateDatabase:(FMDatabase *)db
+{
+    db->executeUpdate("create table t (a integer)");
+}
+
+- (void)testSyncLatency
+{
+    FMFaultInjectionVFS fault;
+    FMIOAccountingVFS accounting(fault.name());
+    XCTAssertTrue(accounting.isRegistered(), @"Shims stack");
+    FMDatabase db(self.databasePath.UTF8String);
+    XCTAssertTrue(db.openWithFlags(SQLITE_OPEN_READWRITE, accounting.name()));
+
+    fault.setPolicy(FMFaultOperation::Sync, FMFaultInjectionPolicy::fixedLatency(TimeInterval(0.01)));
+    NSDate *start = [NSDate date];
+    for (int i = 0; i < 5; ++i) {
+        XCTAssertTrue(db.executeUpdate("insert into t values (?)", i));
+    }
+    FMFaultInjectionStatistics statistics = fault.statistics();
+    XCTAssertGreaterThanOrEqual(statistics.syncs.calls, 5);
+    XCTAssertEqualWithAccuracy(statistics.syncs.latency.count(), statistics.syncs.calls * 0.01, 0.0001);
+    XCTAssertGreaterThanOrEqual(-[start timeIntervalSinceNow], statistics.syncs.latency.count());
+    XCTAssertGreaterThanOrEqual(accounting.statistics().mainDatabase.syncs.latency.percentile(50), 10000, @"Seen by the shim above");
+    XCTAssertEqual(statistics.writes.calls, 0, @"No policy");
+}
+
+- (void)testScriptedLatency
+{
+    FMFaultInjectionVFS fault;
+    fault.setPolicy(FMFaultOperation::Read, FMFaultInjectionPolicy::scriptedLatency({TimeInterval(0.001), TimeInterval(0.003)}));
+    FMDatabase db(self.databasePath.UTF8String);
+    XCTAssertTrue(db.openWithFlags(SQLITE_OPEN_READONLY, fault.name()));
+    XCTAssertEqual(db.intForQuery("select count(*) from t"), 0);
+
+    FMFaultInjectionStatistics statistics = fault.statistics();
+    XCTAssertGreaterThan(statistics.reads.calls, 0);
+    double expected = (statistics.reads.calls / 2) * 0.004 + (statistics.reads.calls % 2) * 0.001;
+    XCTAssertEqualWithAccuracy(statistics.reads.latency.count(), expected, 0.0001);
+}
+
+- (void)testInjectedFailures
+{
+    FMFaultInjectionVFS fault;
+    FMDatabase db(self.databasePath.UTF8String);
+    XCTAssertTrue(db.openWithFlags(SQLITE_OPEN_READWRITE, fault.name()));
+
+    fault.setPolicy(FMFaultOperation::Write, FMFaultInjectionPolicy::failures(1));
+    XCTAssertFalse(db.executeUpdate("insert into t values (1)"));
+    XCTAssertEqual(db.lastExtendedErrorCode(), SQLITE_IOERR_WRITE);
+    XCTAssertEqual(fault.statistics().writes.failures, 1);
+
+    fault.setEnabled(false);
+    XCTAssertTrue(db.executeUpdate("insert into t values (2)"));
+
+    fault.setEnabled(true);
+    fault.removeAllPolicies();
+    fault.setPolicy(FMFaultOperation::Lock, FMFaultInjectionPolicy::failures(1));
+    db.setMaxBusyRetryTimeInterval(TimeInterval(0.1));
+    XCTAssertFalse(db.executeUpdate("insert into t values (3)"));
+    XCTAssertEqual(db.lastErrorCode(), SQLITE_BUSY);
+    XCTAssertEqual(db.busyStatistics().timeouts, 1, @"Injected busy locks go through the busy handler");
+
+    fault.removeAllPolicies();
+    XCTAssertEqual(db.intForQuery("select count(*) from t"), 1);
+}
+
+- (void)testSeededFailuresRepeat
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"FMDBFaultInjection.db"];
+    FMFaultInjectionPolicy policy = FMFaultInjectionPolicy::failures(0.1);
+    policy.fileKinds = 1u << (int)FMShimFileKind::Journal;
+
+    int failures[2] = {0, 0};
+    for (int run = 0; run < 2; ++run) {
+        [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+        FMFaultInjectionVFS fault;
+        fault.setSeed(7);
+        FMDatabase db(path.UTF8String);
+        XCTAssertTrue(db.openWithFlags(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, fault.name()));
+        XCTAssertTrue(db.executeUpdate("create table t (a integer)"));
+        fault.setPolicy(FMFaultOperation::Write, policy);
+        for (int i = 0; i < 20; ++i) {
+            failures[run] += !db.executeUpdate("insert into t values (?)", i);
+        }
+        XCTAssertEqual(fault.statistics().writes.failures, failures[run]);
+        db.close();
+    }
+    XCTAssertGreaterThan(failures[0], 0);
+    XCTAssertLessThan(failures[0], 20);
+    XCTAssertEqual(failures[0], failures[1]);
+}
+
+@end
@@ -0,0 +1,136 @@
+//
+//  FMParallelScanTests.mm
+//  FMDB-CPP
+//
+
+#import <XCTest/XCTest.h>
+#import "FMParallelScan.h"
+#import "FMDBTempDBTests.h"
+#include <atomic>
+
+@interface FMParallelScanTests : FMDBTempDBTests
+
+@property FMDatabasePool *pool;
+
+@end
+
+@implementation FMParallelScanTests
+
++ (void)populateDatabase:(FMDatabase *)db
+{
+    db->executeStatements("create table t (a integer, b text);"
+                          "with recursive c(x) as (select 1 union all select x + 1 from c where x < 100000) insert into t select x, 'row ' || x from c;"
+                          "create table empty (a integer)");
+}
+
+- (void)setUp
+{
+    [super setUp];
+    self.pool = new FMDatabasePool(self.databasePath.UTF8String, 4);
+}
+
+- (void)tearDown
+{
+    [super tearDown];
+    delete self.pool;
+}
+
+- (void)testPartitions
+{
+    FMParallelScan scan(*self.pool, "t", 3);
+    auto ranges = scan.partitions();
+    XCTAssertEqual(ranges.size(), 3);
+    XCTAssertEqual(ranges.front().first, 1);
+    XCTAssertEqual(ranges.back().last, 100000);
+    for (size_t i = 1; i < ranges.size(); ++i) {
+        XCTAssertEqual(ranges[i].first, ranges[i - 1].last + 1);
+    }
+    // 100000 = 33334 + 33333 + 33333: the remainder is spread over the first ranges.
+    XCTAssertEqual(ranges[0].last - ranges[0].first + 1, 33334);
+    XCTAssertEqual(ranges[1].last - ranges[1].first + 1, 33333);
+    XCTAssertEqual(ranges[2].last - ranges[2].first + 1, 33333);
+
+    XCTAssertEqual(FMParallelScan(*self.pool, "empty").partitions().size(), 0);
+    XCTAssertEqual(FMParallelScan(*self.pool, "t", 1000000).partitions().size(), 100000, @"A range holds at least one rowid");
+}
+
+- (void)testScan
+{
+    FMParallelScan scan(*self.pool, "t");
+    std::atomic<long long> sum(0);
+    std::atomic<int> count(0);
+    Error error = scan.scan([&](FMResultSet &rs, size_t partition) {
+        XCTAssertLessThan(partition, 4);
+        sum += rs.longLongForColumnIndex(0);
+        ++count;
+    }, "select a, b from t where rowid between ? and ? and a % ? = 0", 2);
+
+    XCTAssertTrue(error.isEmpty());
+    XCTAssertEqual(count.load(), 50000);
+    XCTAssertEqual(sum.load(), 2500050000LL);
+
+    error = scan.scan([](FMResultSet &rs, size_t partition) {}, "select nothing from t where rowid between ? and ?");
+    XCTAssertFalse(error.isEmpty());
+}
+
+- (void)testExecuteQuery
+{
+    FMParallelScan scan(*self.pool, "t", 4);
+    auto result = scan.executeQuery("select a from t where rowid between ? and ? and a % 1000 = 0");
+    XCTAssertTrue(result.succeeded());
+    XCTAssertEqual(result.columnNames.size(), 1);
+    XCTAssertEqual(result.rows.size(), 100);
+    for (size_t i = 0; i < result.rows.size(); ++i) {
+        XCTAssertEqual(result.rows[i][0].toLongLong(), (long long)(i + 1) * 1000, @"Rows should come in partition order");
+    }
+}
+
+- (void)testAggregate
+{
+    FMParallelScan scan(*self.pool, "t");
+    vector<FMAggregate> aggregates{
+        FMAggregate(FMAggregateFunction::Count),
+        FMAggregate(FMAggregateFunction::Sum, "a"),
+        FMAggregate(FMAggregateFunction::Min, "b"),
+        FMAggregate(FMAggregateFunction::Max, "a"),
+        FMAggregate(FMAggregateFunction::Avg, "a"),
+    };
+    auto result = scan.aggregate({"a % 3"}, aggregates, "a > ?", 10);
+    XCTAssertTrue(result.succeeded());
+    XCTAssertEqual(result.columnNames.size(), 6);
+    XCTAssertEqual(result.columnNames[1], "count(*)");
+    XCTAssertEqual(result.rows.size(), 3);
+
+    self.pool->inReadDatabase([&](FMDatabase &db) {
+        auto rs = db.executeQuery("select a % 3, count(*), sum(a), min(b), max(a), avg(a) from t where a > 10 group by a % 3").lock();
+        size_t row = 0;
+        while (rs->next()) {
+            auto &values = result.rows[row++];
+            XCTAssertEqual(values[0].toLongLong(), rs->longLongForColumnIndex(0));
+            XCTAssertEqual(values[1].toLongLong(), rs->longLongForColumnIndex(1));
+            XCTAssertEqual(values[2].toLongLong(), rs->longLongForColumnIndex(2));
+            XCTAssertEqual(FMShardedDatabaseQueue::compareValues(values[3], rs->objectForColumnIndex(3)), 0);
+            XCTAssertEqual(values[4].toLongLong(), rs->longLongForColumnIndex(4));
+            XCTAssertEqualWithAccuracy(values[5].toDouble(), rs->doubleForColumnIndex(5), 1e-9);
+        }
+        XCTAssertEqual(row, 3);
+    });
+
+    auto total = FMParallelScan(*self.pool, "empty").aggregate({}, {FMAggregate(FMAggregateFunction::Count), FMAggregate(FMAggregateFunction::Avg, "a")}, "");
+    XCTAssertEqual(total.rows.size(), 1, @"An aggregate without groups should have one row");
+    XCTAssertEqual(total.rows[0][0].toLongLong(), 0);
+    XCTAssertTrue(total.rows[0][1].isNull());
+}
+
+- (void)testScanPerformance
+{
+    FMParallelScan scan(*self.pool, "t");
+    [self measureBlock:^{
+        std::atomic<long long> length(0);
+        scan.scan([&](FMResultSet &rs, size_t partition) {
+            length += rs.stringForColumnIndex(0)->length();
+        }, "select b from t where rowid between ? and ?");
+    }];
+}
+
+@end
@@ -0,0 +1,134 @@
+//
+//  FMShardedDatabaseQueueTests.mm
+//  FMDB-CPP
+//
+
+#import <XCTest/XCTest.h>
+#import "FMShardedDatabaseQueue.h"
+#import "FMDBTempDBTests.h"
+
+#if FMDB_SQLITE_STANDALONE
+#import <sqlite3/sqlite3.h>
+#else
+#import <sqlite3.h>
+#endif
+
+static const size_t FMDBTestShardCount = 4;
+
+@interface FMShardedDatabaseQueueTests : FMDBTempDBTests
+
+@property FMShardedDatabaseQueue *shards;
+
+@end
+
+@implementation FMShardedDatabaseQueueTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    vector<string> paths;
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    for (size_t i = 0; i < FMDBTestShardCount; ++i) {
+        NSString *path = [self.databasePath stringByAppendingFormat:@".shard%zu", i];
+        [fileManager removeItemAtPath:path error:NULL];
+        paths.push_back(path.UTF8String);
+    }
+    self.shards = new FMShardedDatabaseQueue(paths);
+    self.shards->inEveryDatabase([](FMDatabase &db, size_t shardIndex) {
+        db.executeUpdate("create table item (id integer, name text)");
+    });
+}
+
+- (void)tearDown
+{
+    delete self.shards;
+    [super tearDown];
+}
+
+- (void)testKeyRouting
+{
+    XCTAssertEqual(self.shards->shardCount(), FMDBTestShardCount);
+    XCTAssertEqual(self.shards->shardIndexForKey("user-1"), self.shards->shardIndexForKey(string("user-1")));
+    XCTAssertEqual(self.shards->shardIndexForKey(42), self.shards->shardIndexForKey(42ll));
+
+    for (int key = 0; key < 64; ++key) {
+        self.shards->inTransaction(key, [=](FMDatabase &db, bool &rollback) {
+            XCTAssertTrue(db.executeUpdate("insert into item values (?, 'item')", key));
+        });
+    }
+
+    __block size_t usedShards = 0;
+    self.shards->inEveryDatabase([&](FMDatabase &db, size_t shardIndex) {
+        auto rs = db.executeQuery("select id from item").lock();
+        bool used = false;
+        while (rs->next()) {
+            XCTAssertEqual(self.shards->shardIndexForKey(rs->intForColumnIndex(0)), shardIndex);
+            used = true;
+        }
+        if (used) {
+            ++usedShards;
+        }
+    });
+    XCTAssertEqual(usedShards, FMDBTestShardCount, @"64 keys should reach every shard");
+}
+
+- (void)testScatterGather
+{
+    for (int key = 0; key < 40; ++key) {
+        self.shards->inDatabase(key, [=](FMDatabase &db) {
+            db.executeUpdate("insert into item values (?, 'item')", key);
+        });
+    }
+
+    auto result = self.shards->executeQuery("select count(*) from item");
+    XCTAssertTrue(result.succeeded());
+    XCTAssertEqual(result.rows.size(), FMDBTestShardCount);
+    long long total = 0;
+    for (auto &row : result.rows) {
+        total += row[0].toLongLong();
+    }
+    XCTAssertEqual(total, 40);
+
+    auto failed = self.shards->executeQuery("select * from missing");
+    XCTAssertFalse(failed.succeeded());
+    XCTAssertTrue(failed.error.domain() == "FMDatabase");
+    XCTAssertEqual(failed.error.code(), SQLITE_ERROR);
+}
+
+- (void)testOrderedMerge
+{
+    for (int key = 0; key < 100; ++key) {
+        self.shards->inDatabase(key, [=](FMDatabase &db) {
+            db.executeUpdate("insert into item values (?, 'item' || (? % 10))", key, key);
+        });
+    }
+    self.shards->inDatabase(0, [](FMDatabase &db) {
+        db.executeUpdate("insert into item values (null, 'item0')");
+    });
+
+    auto result = self.shards->executeOrderedQuery({FMShardSortColumn(1), FMShardSortColumn(0, false)},
+                                                   "select id, name from item order by name, id desc");
+    XCTAssertTrue(result.succeeded());
+    XCTAssertEqual(result.columnNames.size(), 2);
+    XCTAssertEqual(result.rows.size(), 101);
+    for (size_t i = 1; i < result.rows.size(); ++i) {
+        auto &previous = result.rows[i - 1];
+        auto &row = result.rows[i];
+        int order = FMShardedDatabaseQueue::compareValues(previous[1], row[1]);
+        XCTAssertTrue(order < 0 || (order == 0 && FMShardedDatabaseQueue::compareValues(previous[0], row[0]) >= 0));
+    }
+    XCTAssertEqual(result.rows.front()[0].toLongLong(), 90);
+    XCTAssertTrue(result.rows[10][0].isNull(), @"NULL sorts last in descending order");
+}
+
+- (void)testCompareValues
+{
+    XCTAssertLessThan(FMShardedDatabaseQueue::compareValues(Variant(), Variant(1)), 0);
+    XCTAssertLessThan(FMShardedDatabaseQueue::compareValues(Variant(2), Variant(2.5)), 0);
+    XCTAssertLessThan(FMShardedDatabaseQueue::compareValues(Variant(100), Variant("1")), 0);
+    XCTAssertEqual(FMShardedDatabaseQueue::compareValues(Variant("abc"), Variant(string("abc"))), 0);
+    XCTAssertGreaterThan(FMShardedDatabaseQueue::compareValues(Variant("b"), Variant("abc")), 0);
+}
+
+@end
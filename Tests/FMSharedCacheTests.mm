@@ -0,0 +1,102 @@
+//
+//  FMSharedCacheTests.mm
+//  FMDB-CPP
+//
+
+#import <XCTest/XCTest.h>
+#import "FMDatabase.h"
+#import "FMDBTempDBTests.h"
+#include <thread>
+
+#if FMDB_SQLITE_STANDALONE
+#import <sqlite3/sqlite3.h>
+#else
+#import <sqlite3.h>
+#endif
+
+@interface FMSharedCacheTests : FMDBTempDBTests
+
+@end
+
+@implementation FMSharedCacheTests
+
++ (void)populateDatabase:(FMDatabase *)db
+{
+    db->executeStatements("create table t (a integer, b text);"
+                          "with recursive c(x) as (select 1 union all select x + 1 from c where x < 1000) insert into t select x, 'row ' || x from c;");
+}
+
+- (void)testWaitForTableLock
+{
+    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_SHAREDCACHE;
+    FMDatabase writer(self.databasePath.UTF8String);
+    FMDatabase reader(self.databasePath.UTF8String);
+    XCTAssertTrue(writer.openWithFlags(flags));
+    XCTAssertTrue(reader.openWithFlags(flags));
+
+    XCTAssertTrue(writer.beginTransaction());
+    XCTAssertTrue(writer.executeUpdate("insert into t values (0, 'locked')"));
+    std::thread committer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        writer.commit();
+    });
+    XCTAssertEqual(reader.intForQuery("select count(*) from t"), 1001, @"The reader should wait for the table lock, then see the commit");
+    committer.join();
+
+    XCTAssertEqual(reader.busyStatistics().waits, 1);
+    XCTAssertGreaterThan(reader.busyStatistics().totalWaitTime.count(), 0);
+    if (FMDatabase::supportsUnlockNotify()) {
+        XCTAssertEqual(reader.busyStatistics().unlockNotifications, 1, @"The wait should block on sqlite3_unlock_notify");
+    } else {
+        // The linked SQLite lacks sqlite3_unlock_notify: the wait sleeps and retries.
+        XCTAssertEqual(reader.busyStatistics().unlockNotifications, 0);
+        XCTAssertGreaterThan(reader.busyStatistics().retries, 0);
+    }
+
+    reader.setMaxBusyRetryTimeInterval(TimeInterval(0.02));
+    XCTAssertTrue(writer.beginTransaction());
+    XCTAssertTrue(writer.executeUpdate("insert into t values (0, 'locked')"));
+    XCTAssertFalse(reader.executeUpdate("insert into t values (1, 'blocked')"));
+    XCTAssertEqual(reader.lastErrorCode(), SQLITE_LOCKED);
+    XCTAssertEqual(reader.busyStatistics().timeouts, 1);
+    XCTAssertTrue(writer.rollback());
+}
+
+- (void)measureConcurrentAccessWithFlags:(int)flags
+{
+    NSString *path = self.databasePath;
+    [self measureBlock:^{
+        vector<std::thread> readers;
+        for (int i = 0; i < 3; ++i) {
+            readers.emplace_back([=]() {
+                FMDatabase db(path.UTF8String);
+                db.openWithFlags(flags);
+                for (int k = 0; k < 200; ++k) {
+                    db.intForQuery("select sum(a) from t where b like 'row 1%'");
+                }
+            });
+        }
+        FMDatabase db(path.UTF8String);
+        db.openWithFlags(flags);
+        for (int k = 0; k < 100; ++k) {
+            db.beginTransaction();
+            db.executeUpdate("update t set a = a + 1 where rowid = ?", k + 1);
+            db.commit();
+        }
+        for (auto &reader : readers) {
+            reader.join();
+        }
+    }];
+}
+
+- (void)testSharedCachePerformance
+{
+    [self measureConcurrentAccessWithFlags:SQLITE_OPEN_READWRITE | SQLITE_OPEN_SHAREDCACHE];
+}
+
+- (void)testPrivateCachePerformance
+{
+    [self measureConcurrentAccessWithFlags:SQLITE_OPEN_READWRITE | SQLITE_OPEN_PRIVATECACHE];
+}
+
+@end
@@ -0,0 +1,78 @@
+//
+//  FMThreadLocalReadersTests.mm
+//  FMDB-CPP
+//
+
+#import <XCTest/XCTest.h>
+#import "FMThreadLocalReaders.h"
+#import "FMDBTempDBTests.h"
+#include <thread>
+#include <atomic>
+
+@interface FMThreadLocalReadersTests : FMDBTempDBTests
+
+@end
+
+@implementation FMThreadLocalReadersTests
+
++ (void)populateDatabase:(FMDatabase *)db
+{
+    db->executeStatements("pragma journal_mode=wal; create table t (a integer)");
+    db->executeUpdate("insert into t values (1)");
+    db->executeUpdate("insert into t values (2)");
+}
+
+- (void)testConnectionPerThread
+{
+    FMThreadLocalReaders readers(self.databasePath.UTF8String, 2);
+
+    __block FMDatabase *first = nullptr;
+    XCTAssertTrue(readers.inReadDatabase([&](FMDatabase &db) {
+        first = &db;
+        readers.inReadDatabase([&](FMDatabase &nested) {
+            XCTAssertEqual(&nested, first, @"Nested blocks should run on the connection of the thread");
+        });
+        XCTAssertEqual(db.intForQuery("select sum(a) from t"), 3);
+    }));
+    XCTAssertEqual(readers.threadDatabase(), first);
+    XCTAssertFalse(first->hasOpenResultSets());
+
+    std::thread([&]() {
+        readers.inReadDatabase([&](FMDatabase &db) {
+            XCTAssertNotEqual(&db, first, @"Each thread should own its connection");
+        });
+        XCTAssertEqual(readers.countOfOpenDatabases(), 2);
+    }).join();
+    XCTAssertEqual(readers.countOfOpenDatabases(), 1, @"The connection of a thread should be closed when it exits");
+
+    readers.releaseThreadDatabase();
+    XCTAssertEqual(readers.countOfOpenDatabases(), 0);
+}
+
+- (void)testOverflowConnection
+{
+    FMThreadLocalReaders readers(self.databasePath.UTF8String, 2);
+    std::atomic<int> sum(0);
+
+    vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&]() {
+            for (int k = 0; k < 10; ++k) {
+                XCTAssertTrue(readers.inReadDatabase([&](FMDatabase &db) {
+                    sum += db.intForQuery("select sum(a) from t");
+                }));
+            }
+            XCTAssertLessThanOrEqual(readers.countOfOpenDatabases(), 2);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50)); // keep the slots taken
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    XCTAssertEqual(sum.load(), 120);
+    XCTAssertGreaterThanOrEqual(readers.overflowCount(), 20);
+    XCTAssertEqual(readers.countOfOpenDatabases(), 0);
+}
+
+@end
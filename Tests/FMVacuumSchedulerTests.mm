@@ -0,0 +1,106 @@
+//
+//  FMVacuumSchedulerTests.mm
+//  FMDB-CPP
+//
+
+#import <XCTest/XCTest.h>
+#import "FMVacuumScheduler.h"
+#import "FMDBTempDBTests.h"
+
+@interface FMVacuumSchedulerTests : FMDBTempDBTests
+
+@property FMDatabaseQueue *queue;
+
+@end
+
+@implementation FMVacuumSchedulerTests
+
++ (void)populateDatabase:(FMDatabase *)db
+{
+    // Created with `auto_vacuum = none`: the scheduler has to rebuild it once.
+    db->executeStatements("create table t (a integer primary key, b blob);"
+                          "with recursive c(x) as (select 1 union all select x + 1 from c where x < 2000) insert into t (b) select zeroblob(1000) from c;");
+}
+
+- (void)setUp
+{
+    [super setUp];
+    self.queue = new FMDatabaseQueue(self.databasePath.UTF8String);
+}
+
+- (void)tearDown
+{
+    [super tearDown];
+    delete self.queue;
+}
+
+- (void)waitForQueue
+{
+    XCTestExpectation *ran = [self expectationWithDescription:@"ran"];
+    FMDatabaseQueueTaskOptions options;
+    options.completion = [=](bool success, const Error &error) {
+        [ran fulfill];
+    };
+    self.queue->inDatabase([](FMDatabase &adb) {}, options);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    [NSThread sleepForTimeInterval:0.2]; // the idle turns following the task.
+}
+
+- (unsigned long long)fileSize
+{
+    return [[[NSFileManager defaultManager] attributesOfItemAtPath:self.databasePath error:nil] fileSize];
+}
+
+- (void)testIncrementalVacuum
+{
+    FMVacuumPolicy policy;
+    policy.pagesPerSlice = 50;
+    unsigned long long sizeBefore = [self fileSize];
+    FMVacuumScheduler vacuum(*self.queue, policy);
+    self.queue->inDatabase([](FMDatabase &adb) {
+        XCTAssertEqual(adb.intForQuery("pragma auto_vacuum"), 2, @"Switched to incremental");
+        XCTAssertTrue(adb.executeUpdate("delete from t where a > 200"));
+        XCTAssertGreaterThan(adb.intForQuery("pragma freelist_count"), 400);
+    });
+    [self waitForQueue];
+
+    FMVacuumStatistics statistics = vacuum.statistics();
+    XCTAssertGreaterThan(statistics.pagesFreed, 400);
+    XCTAssertGreaterThanOrEqual(statistics.slices, statistics.pagesFreed / 50, @"No slice frees more than its budget");
+    XCTAssertLessThanOrEqual(statistics.freePages, policy.minimumFreePages);
+    XCTAssertLessThan([self fileSize], sizeBefore / 2);
+
+    self.queue->inDatabase([](FMDatabase &adb) {
+        XCTAssertEqual(adb.intForQuery("select count(*) from t"), 200);
+        XCTAssertEqualObjects(@(adb.stringForQuery("pragma integrity_check")->c_str()), @"ok");
+    });
+    [self waitForQueue];
+}
+
+- (void)testSlicesLeaveRoomForTasks
+{
+    FMVacuumPolicy policy;
+    policy.pagesPerSlice = 10;
+    FMVacuumScheduler vacuum(*self.queue, policy);
+    self.queue->inDatabase([](FMDatabase &adb) {
+        adb.executeUpdate("delete from t where a > 200");
+    });
+
+    // Foreground tasks keep running between the slices.
+    for (int i = 0; i < 100; ++i) {
+        self.queue->inDatabase([](FMDatabase &adb) {
+            adb.executeUpdate("insert into t (b) values (zeroblob(100))");
+        });
+    }
+    [self waitForQueue];
+
+    FMVacuumStatistics statistics = vacuum.statistics();
+    XCTAssertGreaterThan(statistics.slices, 1);
+    XCTAssertLessThanOrEqual(statistics.freePages, policy.minimumFreePages);
+    self.queue->inDatabase([](FMDatabase &adb) {
+        XCTAssertEqual(adb.intForQuery("select count(*) from t"), 300);
+    });
+    [self waitForQueue];
+}
+
+@end